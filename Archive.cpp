@@ -3,9 +3,19 @@
 //
 
 #include "Archive.hpp"
+#include "Timer.hpp"
+#include "Trace.hpp"
+#include "OperationScope.hpp"
 #include <cstring>
 #include <memory>
 #include <filesystem>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
 
 using namespace std;
 namespace ECE141 {
@@ -13,21 +23,81 @@ namespace ECE141 {
     //Archive class
     // ----------------------------------------------------------------------------------------------------------
 
-    Archive::Archive(const std::string &aFullPath, ECE141::AccessMode aMode){
+    //aFile as it is now, to go with its index into the shared cache
+    static SharedIndexState stateOf(const BlockFile &aFile, uint64_t aGeneration, size_t aBlockCount) {
+        SharedIndexState theState{aGeneration, aFile.fileId()};
+        aFile.stamp(theState.device, theState.modified);
+        theState.blockCount = aBlockCount;
+        return theState;
+    }
+
+    //whether the cached index describes aFile: the same file (inode and device), untouched since
+    //the commit that stored it, and as long as the index says
+    static bool isCurrent(const SharedIndexState &aState, const BlockFile &aFile) {
+        SharedIndexState theNow = stateOf(aFile, aState.generation, aFile.blockCount());
+        return theNow.fileId == aState.fileId && theNow.device == aState.device &&
+               theNow.modified == aState.modified && theNow.blockCount == aState.blockCount;
+    }
+
+    Archive::Archive(const std::string &aFullPath, ECE141::AccessMode aMode, const VolumeLayout *aLayout,
+                     StorageKind aStorage) : theStorage{aStorage} {
         thePath = filesystem::current_path().string();
+        theArcName = aFullPath;
+
+        //in memory nobody else can see the archive: nothing to coordinate, nothing to persist.
+        //opening one copies the file's blocks in (under its lock) and never writes them back
+        if (StorageKind::memory == theStorage) {
+            auto theFile = std::make_shared<BlockFile>();
+            theFile->attach(std::make_unique<MemoryStorage>());
+            if (aMode == AccessMode::AsExisting) {
+                ArchiveLock theLock;
+                theLock.open(aFullPath + ".lock");
+                ArchiveLock::Shared theFileGuard(theLock);
+                BlockFile theSource;
+                if (!theSource.open(aFullPath, false) || !theFile->copyFrom(theSource, 0, 0, theSource.size())) return;
+            }
+            publish(loadIndex(theFile, false));
+            return;
+        }
 
-        //existing
-        if(aMode ==  AccessMode::AsExisting)
-            theArcFile = fstream (aFullPath,std::ios::binary | std::ios::in | std::ios::out);
+        //other processes may have this archive open: coordinate through the lock file and shared index
+        theFileLock.open(aFullPath + ".lock");
+        theFileLock.markOpen(); //for as long as this object lives
+        theCache.attach(aFullPath);
+        theTOC.open(aFullPath);
+
+        if (aMode == AccessMode::AsExisting) { //attach to the cached index when it is current, no scan
+            ArchiveLock::Shared theFileGuard(theFileLock);
+            auto theFile = std::make_shared<BlockFile>();
+            if (!theFile->open(aFullPath, false)) return;
+
+            auto theNext = std::make_shared<ArchiveSnapshot>();
+            SharedIndexState theState;
+            if (theCache.load(theState, theNext->entries) && isCurrent(theState, *theFile)) {
+                theNext->file = theFile;
+                theNext->blockCount = theState.blockCount;
+                theNext->version = theState.generation;
+                theSnapshot = theNext;
+                return;
+            }
+        }
 
-            //creating, truncate
-        else
-            theArcFile = fstream (aFullPath,std::ios::binary | std::ios::in | std::ios::out | std:: ios::trunc);
+        //creating (truncate), or existing with no usable cache: read the table of contents
+        //(or scan the file when it is stale) and share the result
+        ArchiveLock::Exclusive theFileGuard(theFileLock);
+        auto theFile = std::make_shared<BlockFile>();
+        if (aMode == AccessMode::AsNew && theFile->open(aFullPath, false) && theFile->isStriped())
+            theFile->removeVolumes(); //what it replaces
+        const bool isOpen = aLayout ? theFile->create(aFullPath, *aLayout, aFullPath)
+                                    : theFile->open(aFullPath, aMode == AccessMode::AsNew);
+        if (isOpen) publish(loadIndex(theFile, true));
     }
 
     Archive::~Archive(){
-        theArcFile.flush(); //clear buffer
-        theArcFile.close(); //close
+        if (auto theCurrent = pinSnapshot())
+            theCurrent->file->sync(); //clear buffer, file closes with the last snapshot using it
+        //the last opener takes the shared index with it; openers waiting on the marker make a new one
+        if (theCache.isAttached() && theFileLock.tryOnlyOpener()) theCache.unlink();
     }
 
     ArchiveStatus<std::shared_ptr<Archive>> Archive::createArchive(const std::string &anArchiveName) {
@@ -36,14 +106,46 @@ namespace ECE141 {
             aName += ".arc";
 
         try{ //make new archive, return if good
-            auto *newArchive = new Archive(aName,AccessMode::AsNew);
-            return ArchiveStatus{shared_ptr<Archive>(newArchive)};
+            shared_ptr<Archive> newArchive(new Archive(aName,AccessMode::AsNew));
+            if (newArchive->pinSnapshot())
+                return ArchiveStatus{newArchive};
         }
-        catch(...) //else return error
-        {
-            cerr<<"error creating archive"<<'\n';
-            return ArchiveStatus<shared_ptr<Archive>>(ArchiveErrors:: fileOpenError);
+        catch(...) {}
+        //else return error
+        cerr<<"error creating archive"<<'\n';
+        return ArchiveStatus<shared_ptr<Archive>>(ArchiveErrors:: fileOpenError);
+    }
+
+    //a multi-volume archive: the .arc holds the manifest, the blocks go to one volume per folder
+    ArchiveStatus<std::shared_ptr<Archive>> Archive::createArchive(const std::string &anArchiveName, const VolumeLayout &aLayout) {
+        string aName = anArchiveName;
+        if (!has_arc_ext(anArchiveName))
+            aName += ".arc";
+
+        try {
+            shared_ptr<Archive> newArchive(new Archive(aName, AccessMode::AsNew, &aLayout));
+            if (newArchive->pinSnapshot())
+                return ArchiveStatus{newArchive};
+        }
+        catch (...) {}
+        cerr << "error creating archive" << '\n';
+        return ArchiveStatus<shared_ptr<Archive>>(ArchiveErrors::fileOpenError);
+    }
+
+    //kept in memory: a new one never touches the filesystem (the name is only a label)
+    ArchiveStatus<std::shared_ptr<Archive>> Archive::createArchive(const std::string &anArchiveName, StorageKind aStorage) {
+        string aName = anArchiveName;
+        if (!has_arc_ext(anArchiveName))
+            aName += ".arc";
+
+        try {
+            shared_ptr<Archive> newArchive(new Archive(aName, AccessMode::AsNew, nullptr, aStorage));
+            if (newArchive->pinSnapshot())
+                return ArchiveStatus{newArchive};
         }
+        catch (...) {}
+        cerr << "error creating archive" << '\n';
+        return ArchiveStatus<shared_ptr<Archive>>(ArchiveErrors::fileOpenError);
     }
 
     ArchiveStatus<std::shared_ptr<Archive>> Archive::openArchive(const std::string &anArchiveName) {
@@ -52,369 +154,1846 @@ namespace ECE141 {
             aName += ".arc";
 
         try { //make new archive, return if good
-            auto *ExistingArchive = new Archive(aName, AccessMode::AsExisting);
-            return ArchiveStatus{shared_ptr<Archive>(ExistingArchive)};
+            shared_ptr<Archive> ExistingArchive(new Archive(aName, AccessMode::AsExisting));
+            if (ExistingArchive->pinSnapshot())
+                return ArchiveStatus{ExistingArchive};
         }
-        catch (...) //else return error
-        {
-            cerr << "error creating archive" << '\n';
-            return ArchiveStatus<shared_ptr<Archive>>(ArchiveErrors::fileOpenError);
+        catch (...) {}
+        //else return error
+        cerr << "error opening archive" << '\n';
+        return ArchiveStatus<shared_ptr<Archive>>(ArchiveErrors::fileOpenError);
+    }
+
+    //memory: the archive's blocks are read into memory once and served from there; changes stay in memory
+    ArchiveStatus<std::shared_ptr<Archive>> Archive::openArchive(const std::string &anArchiveName, StorageKind aStorage) {
+        string aName = anArchiveName;
+        if (!has_arc_ext(anArchiveName))
+            aName += ".arc";
+
+        try {
+            shared_ptr<Archive> ExistingArchive(new Archive(aName, AccessMode::AsExisting, nullptr, aStorage));
+            if (ExistingArchive->pinSnapshot())
+                return ArchiveStatus{ExistingArchive};
         }
+        catch (...) {}
+        cerr << "error opening archive" << '\n';
+        return ArchiveStatus<shared_ptr<Archive>>(ArchiveErrors::fileOpenError);
     }
 
-    ArchiveStatus<bool> Archive::add(const std::string &aFileName, IDataProcessor* aProcessor) {
-        std::fstream temp;
-        size_t compsize = 0; // Default
-
-        if (aProcessor) { // Check process flag
-            // Process the file using the IDataProcessor
-            // (compress or modify the file content)
-            std::fstream inputFile(aFileName, std::ios::binary | std::ios::in | std::ios::out);
-            if (!inputFile.is_open()) {
-                notifyObservers(ActionType::added, aFileName, false);
-                return ArchiveStatus<bool>(false);
-            }
-
-            std::vector<uint8_t> theVec; // Compress vector
-            read_to_vec(theVec, inputFile);
-            theVec = aProcessor->process(theVec);
-            compsize = theVec.size();
-
-            // Temp file to hold compressed data
-            temp.open("/tmp/TEMP.txt", std::ios::binary | std::ios::out);
-            if (!temp.is_open()) {
-                notifyObservers(ActionType::added, aFileName, false);
-                inputFile.close();
-                return ArchiveStatus<bool>(false);
-            }
-            writeToFile(theVec, temp); // Write to temp file
-            inputFile.close();
-            temp.close(); // Close to clear for edit
-            temp.open("/tmp/TEMP.txt", std::ios::binary | std::ios::in);
-        } else {
-            // No processing, just open the file
-            temp.open(aFileName, std::ios::binary | std::ios::in | std::ios::out);
-            if (!temp.is_open()) {
-                notifyObservers(ActionType::added, aFileName, false);
-                return ArchiveStatus<bool>(false);
+    //visit the head block of every entry (removed ones too), stop when aVisitor returns false
+    void Archive::scanHeads(const BlockFile &aFile, const std::function<bool(size_t, const ChunkHeader&)> &aVisitor) {
+        const size_t theCount = aFile.blockCount();
+        ChunkHeader theHeader;
+        for (size_t theIndex = 0; theIndex < theCount;) {
+            if (!aFile.readHeader(theIndex, theHeader)) break;
+            if (theHeader.partNum > 1) { //stray continuation block, step over it
+                ++theIndex;
+                continue;
             }
+            if (!aVisitor(theIndex, theHeader)) break;
+            theIndex += theHeader.blockCount();
         }
+    }
 
-        temp.clear(); //clear buffer and set pointer
-        temp.seekg(0);
-        temp.seekp(0);
-
-        static size_t pos = 0; // Begin chunking
-        Chunker chunker(temp);
-        bool success = chunker.chunk_em([&](Chunk &chunk) {
-            assign_meta(chunk, pos, aFileName, compsize); // Assign meta
-            // Write the chunk to the output stream
-            theArcFile.write(reinterpret_cast<const char *>(&chunk), kChunkSize);
+    //build the index from the head blocks on disk
+    std::shared_ptr<ArchiveSnapshot> Archive::loadSnapshot(const std::shared_ptr<BlockFile> &aFile) {
+        auto theSnapshot = std::make_shared<ArchiveSnapshot>();
+        theSnapshot->file = aFile;
+        theSnapshot->blockCount = aFile->blockCount();
 
-            pos += kChunkSize;
+        std::vector<EntryInfo> theEntries;
+        scanHeads(*aFile, [&](size_t anIndex, const ChunkHeader &aHeader) {
+            if (aHeader.occupied) theEntries.emplace_back(anIndex, aHeader);
             return true;
         });
+        //sort by name, the last copy of a name in the file wins
+        std::stable_sort(theEntries.begin(), theEntries.end(),
+                         [](const EntryInfo &a, const EntryInfo &b) {return a.name < b.name;});
+        std::vector<EntryInfo> theUnique;
+        for (size_t i = 0; i < theEntries.size(); ++i) {
+            if (i + 1 == theEntries.size() || theEntries[i].name != theEntries[i + 1].name)
+                theUnique.push_back(std::move(theEntries[i]));
+        }
+        theSnapshot->entries = EntryIndex::fromSorted(std::move(theUnique));
+        return theSnapshot;
+    }
 
-        temp.close();
-        std::remove("/tmp/TEMP.txt"); // Remove temp file
+    //the table of contents when it matches aFile, a scan otherwise (written back as the new table if aCanStore)
+    std::shared_ptr<ArchiveSnapshot> Archive::loadIndex(const std::shared_ptr<BlockFile> &aFile, bool aCanStore) {
+        auto theSnapshot = std::make_shared<ArchiveSnapshot>();
+        if (theTOC.load(*aFile, theSnapshot->entries, theSnapshot->blockCount)) {
+            theSnapshot->file = aFile;
+            return theSnapshot;
+        }
+        theSnapshot = loadSnapshot(aFile);
+        if (aCanStore) theTOC.rewrite(aFile->fileId(), theSnapshot->entries, theSnapshot->blockCount);
+        return theSnapshot;
+    }
 
-        if (!success) {
-            notifyObservers(ActionType::added, aFileName, false);
-            return ArchiveStatus<bool>(false);
+    SnapshotPtr Archive::pinSnapshot() const {
+        return std::atomic_load(&theSnapshot);
+    }
+
+    //readers that pinned an older version keep it; new readers (here and in other processes) see aNext,
+    //which goes into the shared index whole (a new or rescanned archive, compact, merge).
+    //caller holds theWriteLock and theFileLock exclusively
+    void Archive::publish(std::shared_ptr<ArchiveSnapshot> aNext) {
+        uint64_t theVersion = theSnapshot ? theSnapshot->version : 0;
+        if (theCache.isAttached()) {
+            aNext->version = theCache.store(stateOf(*aNext->file, theVersion, aNext->blockCount), aNext->entries);
         }
+        else aNext->version = theVersion + 1;
+        swapSnapshot(std::move(aNext));
+    }
 
-        notifyObservers(ActionType::added, aFileName, true);
-        return ArchiveStatus<bool>(true);
+    //the same for a commit that changed only aPut and anErased: the shared index logs just those
+    void Archive::publish(std::shared_ptr<ArchiveSnapshot> aNext, const std::vector<EntryInfo> &aPut,
+                          const std::vector<std::string> &anErased) {
+        uint64_t theVersion = theSnapshot ? theSnapshot->version : 0;
+        if (theCache.isAttached()) {
+            SharedIndexState theState = stateOf(*aNext->file, theVersion, aNext->blockCount);
+            aNext->version = theCache.store(theState, aNext->entries, aPut, anErased);
+        }
+        else aNext->version = theVersion + 1;
+        swapSnapshot(std::move(aNext));
     }
 
-    ArchiveStatus<bool> Archive::extract(const std::string &aFilename, const std::string &aFullPath) {
-        std::ofstream outputFileStream(aFullPath, std::ios::binary | std::ios::out);
-        if (!outputFileStream.is_open()) {
-            std::cerr << "Error: Could not open output file" << std::endl;
-            return ArchiveStatus<bool>(ArchiveErrors::fileOpenError);
+    static void dropExpired(std::vector<std::weak_ptr<const ArchiveSnapshot>> &aVersions) {
+        aVersions.erase(std::remove_if(aVersions.begin(), aVersions.end(),
+                                       [](const std::weak_ptr<const ArchiveSnapshot> &aVersion) {return aVersion.expired();}),
+                        aVersions.end());
+    }
+
+    //caller holds theWriteLock; the outgoing version is remembered for as long as a reader holds it
+    void Archive::swapSnapshot(SnapshotPtr aNext) {
+        SnapshotPtr theOld = std::atomic_exchange(&theSnapshot, std::move(aNext));
+        dropExpired(theRetired);
+        if (theOld) theRetired.push_back(theOld);
+    }
+
+    //true when aCurrent is all anyone can see: no reader in this process holds it or an older version,
+    //and no other Archive (in any process) has the file open. caller holds theWriteLock and theFileLock,
+    //and theReaderGate exclusively so no reader can pin meanwhile. on true the open marker is held
+    //exclusively (other openers wait) until markOpen() gives it back
+    bool Archive::isOnlyHolder(const SnapshotPtr &aCurrent) {
+        return aCurrent.use_count() <= 2 && isOnlyVersion(); //theSnapshot and aCurrent
+    }
+
+    //true when nobody can read a version older than the current one: none is held in this process,
+    //and no other Archive has the file open. caller holds theWriteLock and theFileLock; on true
+    //the open marker is held exclusively until markOpen()
+    bool Archive::isOnlyVersion() {
+        dropExpired(theRetired);
+        return theRetired.empty() && (StorageKind::memory == theStorage || theFileLock.tryOnlyOpener());
+    }
+
+    //the latest version, picking up commits made by other processes since we last looked
+    SnapshotPtr Archive::currentSnapshot() {
+        SnapshotPtr theCurrent = pinSnapshot();
+        if (!theCurrent || !theCache.isAttached() || theCache.generation() == theCurrent->version)
+            return theCurrent; //fast path: nobody else committed
+
+        std::lock_guard<std::mutex> theGuard(theWriteLock);
+        if (theCache.generation()) {
+            ArchiveLock::Shared theFileGuard(theFileLock);
+            return syncSnapshot(false);
         }
+        ArchiveLock::Exclusive theFileGuard(theFileLock); //cache was lost, rebuild it
+        return syncSnapshot(true);
+    }
 
-        if (!theArcFile.is_open()) {
-            std::cerr << "Error: Could not open archive file" << std::endl;
-            notifyObservers(ActionType::extracted, aFilename, false);
-            return ArchiveStatus<bool>(ArchiveErrors::fileOpenError);
+    //catch up with other processes; caller holds theWriteLock and theFileLock
+    //(exclusively if aCanStore, which lets a rescanned index go back into the cache)
+    SnapshotPtr Archive::syncSnapshot(bool aCanStore) {
+        TRACE_SPAN("sync snapshot");
+        SnapshotPtr theCurrent = pinSnapshot();
+        if (!theCurrent || StorageKind::memory == theStorage) return theCurrent;
+        if (theCache.isAttached() && theCache.generation() == theCurrent->version) return theCurrent;
+
+        //compact in another process swaps the file, so follow the path to the new one
+        auto theFile = theCurrent->file;
+        bool isReplaced = theFile->fileId() != BlockFile::pathId(theArcName);
+        if (isReplaced) {
+            theFile = std::make_shared<BlockFile>();
+            if (!theFile->open(theArcName, false)) return theCurrent;
+        }
+
+        std::shared_ptr<ArchiveSnapshot> theNext = std::make_shared<ArchiveSnapshot>();
+        SharedIndexState theState;
+        if (theCache.load(theState, theNext->entries, theCurrent->version, &theCurrent->entries) &&
+            isCurrent(theState, *theFile)) {
+            theNext->file = theFile;
+            theNext->blockCount = theState.blockCount;
+            theNext->version = theState.generation;
+        }
+        else { //no usable cache, the file itself is the truth
+            if (!isReplaced && theFile->blockCount() == theCurrent->blockCount && !theCache.isAttached())
+                return theCurrent;
+            theNext = loadIndex(theFile, aCanStore);
+            if (theCache.isAttached() && aCanStore) {
+                publish(theNext);
+                return pinSnapshot();
+            }
+            theNext->version = theCurrent->version;
         }
+        swapSnapshot(theNext);
+        return theNext;
+    }
+
+    //the latest version, pinned for reading entry data; waits out an in-place update
+    SnapshotPtr Archive::pinForRead() {
+        currentSnapshot(); //catch up with other processes first
+        std::shared_lock<std::shared_mutex> theGate(theReaderGate);
+        return pinSnapshot();
+    }
+
+    ArchiveReader Archive::openReader() {
+        return ArchiveReader(pinForRead(), theFrameCache);
+    }
 
-        theArcFile.seekg(0, std::ios::beg); //set
+    constexpr size_t kRawSegmentBlocks = 32; //raw entries are read (and cached) this many blocks at a time
+    constexpr size_t kSparseSegment = kRawSegmentBlocks * kPayloadSize; //raw bytes per segment, also what a hole spans
 
-        bool foundFile = false;
-        while (!theArcFile.eof() && theArcFile.good()) { //read into each chunk
-            Chunk chunk;
-            memset(&chunk, 0, sizeof(Chunk));
-            size_t prePosition = theArcFile.tellg();
-            theArcFile.read(reinterpret_cast<char*>(&chunk), kChunkSize);
+    constexpr size_t kReadaheadBlocks = 256; //how far ahead of a reader the kernel is asked to fetch
+
+    //keeps the kernel a window ahead of one reader walking an entry: once the reader is within half a
+    //window of what was last asked for, the next window goes out (WILLNEED), so the disk is working
+    //while the current blocks are decoded. entries one read covers never need it
+    class Readahead {
+    public:
+        Readahead(const BlockFile &aFile, const EntryInfo &anEntry) : file{aFile}, entry{anEntry} {}
+
+        void reached(size_t aBlock) { //entry block about to be read
+            if (entry.blocks <= kRawSegmentBlocks || aBlock + kReadaheadBlocks / 2 < ahead) return;
+            const size_t theFrom = std::max(ahead, aBlock), theTo = std::min(entry.blocks, aBlock + kReadaheadBlocks);
+            if (theTo > theFrom) file.advise((entry.head + theFrom) * kChunkSize, (theTo - theFrom) * kChunkSize, AccessHint::willNeed);
+            ahead = std::max(ahead, theTo);
+        }
+
+    protected:
+        const BlockFile &file;
+        const EntryInfo &entry;
+        size_t ahead{0}; //blocks before this one were already asked for
+    };
+
+    //one run of a raw entry's blocks as cached: aCount stored bytes from block aFirst of the entry
+    static SegmentPtr loadSegment(const BlockFile &aFile, FrameCache *aCache, const FrameCache::Key &aKey,
+                                  const EntryInfo &anEntry, size_t aFirst, size_t aStoredEnd, size_t aCount,
+                                  Readahead *anAhead = nullptr) {
+        SegmentPtr theSegment = aCache ? aCache->find(aKey) : nullptr;
+        if (theSegment && theSegment->storedEnd == aStoredEnd && theSegment->data.size() == aCount) return theSegment;
+        //not there, or cached before the entry was appended to: one read for the whole run, then drop the headers
+        if (anAhead) anAhead->reached(aFirst);
+        std::vector<Chunk> theChunks((aCount + kPayloadSize - 1) / kPayloadSize);
+        if (!aFile.readAt((anEntry.head + aFirst) * kChunkSize, theChunks.data(), theChunks.size() * kChunkSize))
+            return nullptr;
+        auto theNew = std::make_shared<FrameSegment>();
+        theNew->storedEnd = aStoredEnd;
+        theNew->data.reserve(aCount);
+        for (auto &theChunk : theChunks)
+            theNew->data.insert(theNew->data.end(), theChunk.data, theChunk.data + std::min(kPayloadSize, aCount - theNew->data.size()));
+        if (aCache) aCache->insert(aKey, theNew);
+        return theNew;
+    }
 
-            if (theArcFile.eof() || !theArcFile.good()) {
-                break;
+    //stream the entry's data (reversing frames if it was processed) to aSink, starting at anOffset.
+    //decoded pieces come from aCache when they are there and go into it when they aren't
+    ArchiveErrors Archive::readEntry(const ArchiveSnapshot &aSnapshot, FrameCache *aCache, const EntryInfo &anEntry,
+                                     size_t anOffset, const DataSink &aSink) {
+        if (anEntry.isDelta()) return readDelta(aSnapshot, aCache, anEntry, anOffset, aSink);
+        if (anEntry.isSparse()) return readSparse(aSnapshot, aCache, anEntry, anOffset, aSink);
+        const BlockFile &theFile = *aSnapshot.file;
+        const bool   isCompressed = anEntry.comp_size != 0;
+        const size_t theStored = anEntry.storedSize();
+        const size_t theBlocks = anEntry.blocks;
+        const uint64_t theFileId = aCache ? theFile.cacheId() : 0;
+
+        Readahead theAhead(theFile, anEntry);
+
+        if (!isCompressed) { //raw data, go straight to the run of blocks holding anOffset
+            if (anOffset >= theStored) return ArchiveErrors::noError;
+            for (size_t s = anOffset / kSparseSegment; s * kSparseSegment < theStored; ++s) {
+                const size_t theStart = s * kSparseSegment, theEnd = std::min(theStored, theStart + kSparseSegment);
+                SegmentPtr theSegment = loadSegment(theFile, aCache, {theFileId, anEntry.head, s}, anEntry,
+                                                    s * kRawSegmentBlocks, theEnd, theEnd - theStart, &theAhead);
+                if (!theSegment) return ArchiveErrors::fileReadError;
+                size_t theSkip = anOffset > theStart ? anOffset - theStart : 0;
+                if (!aSink(reinterpret_cast<const char*>(theSegment->data.data()) + theSkip,
+                           theSegment->data.size() - theSkip)) break;
             }
+            return ArchiveErrors::noError;
+        }
 
-            std::string extractedFilename(chunk.meta.name);
+        size_t theSkip = anOffset;
+        bool   theMore = true;
+        auto emit = [&](const std::vector<uint8_t> &aData) {
+            if (theSkip >= aData.size()) {
+                theSkip -= aData.size();
+                return true;
+            }
+            size_t theStart = theSkip;
+            theSkip = 0;
+            theMore = aSink(reinterpret_cast<const char*>(aData.data()) + theStart, aData.size() - theStart);
+            return theMore;
+        };
+
+        //leading frames already decoded come from the cache
+        size_t theFrame = 0, theStoredPos = 0;
+        while (aCache && theMore && theStoredPos < theStored) {
+            SegmentPtr theSegment = aCache->find({theFileId, anEntry.head, theFrame});
+            if (!theSegment) break;
+            emit(theSegment->data);
+            theStoredPos = theSegment->storedEnd;
+            ++theFrame;
+        }
+        if (!theMore || theStoredPos >= theStored) return ArchiveErrors::noError;
+
+        //the rest from disk, starting in the block that holds the first missing frame
+        Compression theProcessor; //uncompress
+        std::vector<uint8_t> thePending; //processed bytes waiting for a whole frame
+        FrameSink theFrames = [&](std::vector<uint8_t> &&aData, size_t aStoredBytes) {
+            auto theSegment = std::make_shared<FrameSegment>();
+            theSegment->data = std::move(aData);
+            theSegment->storedEnd = theStoredPos += aStoredBytes;
+            if (aCache) aCache->insert({theFileId, anEntry.head, theFrame}, theSegment);
+            ++theFrame;
+            return emit(theSegment->data);
+        };
+
+        //a run of blocks per read, not one at a time
+        std::vector<Chunk> theChunks;
+        size_t theLead = theStoredPos % kPayloadSize; //part of the first block belonging to earlier frames
+        for (size_t i = theStoredPos / kPayloadSize; i < theBlocks && theMore;) {
+            theChunks.resize(std::min(kRawSegmentBlocks, theBlocks - i));
+            theAhead.reached(i);
+            if (!theFile.readAt((anEntry.head + i) * kChunkSize, theChunks.data(), theChunks.size() * kChunkSize))
+                return ArchiveErrors::fileReadError;
+            for (size_t c = 0; c < theChunks.size() && theMore; ++c, ++i) {
+                size_t theCount = std::min(kPayloadSize, theStored - i * kPayloadSize);
+                thePending.insert(thePending.end(), theChunks[c].data + theLead, theChunks[c].data + theCount);
+                theLead = 0;
+                if (!decodeFrames(theProcessor, thePending, theFrames)) {
+                    std::cerr << "Error: Failed to decompress file" << std::endl;
+                    return ArchiveErrors::badProcessor;
+                }
+            }
+        }
+        if (theMore && !thePending.empty()) return ArchiveErrors::badData; //truncated frame
+        return ArchiveErrors::noError;
+    }
 
-            if (extractedFilename == aFilename) {
-                foundFile = true;
+    //a sparse entry keeps only its segments that aren't all zeros, back to back, then a map with a bit
+    //per segment set for the holes. the map is read once (and cached as the segment after the last),
+    //a hole costs nothing but handing out zeros and a data segment is found by counting holes before it
+    ArchiveErrors Archive::readSparse(const ArchiveSnapshot &aSnapshot, FrameCache *aCache, const EntryInfo &anEntry,
+                                      size_t anOffset, const DataSink &aSink) {
+        TRACE_SPAN("sparse");
+        static const std::vector<char> theZeros(kSparseSegment);
+        const BlockFile &theFile = *aSnapshot.file;
+        const uint64_t theFileId = aCache ? theFile.cacheId() : 0;
+        if (anOffset >= anEntry.filesize) return ArchiveErrors::noError;
+        const size_t theSegments = (anEntry.filesize + kSparseSegment - 1) / kSparseSegment;
+        const size_t theMapBytes = (theSegments + 7) / 8;
+        if (anEntry.comp_size < theMapBytes) return ArchiveErrors::badData;
+
+        //the map starts inside some block, read from there to the end
+        const size_t theMapStart = anEntry.comp_size - theMapBytes;
+        SegmentPtr theMap = loadSegment(theFile, aCache, {theFileId, anEntry.head, theSegments}, anEntry,
+                                        theMapStart / kPayloadSize, anEntry.comp_size,
+                                        anEntry.comp_size - theMapStart / kPayloadSize * kPayloadSize);
+        if (!theMap) return ArchiveErrors::fileReadError;
+        const uint8_t *theHoles = theMap->data.data() + theMapStart % kPayloadSize;
+        auto isHole = [&](size_t s) {return (theHoles[s / 8] >> (s % 8)) & 1;};
+        Readahead theAhead(theFile, anEntry);
+
+        size_t theData = 0; //data segments before the first one read
+        for (size_t s = 0; s < anOffset / kSparseSegment && s < theSegments; ++s) theData += !isHole(s);
+        for (size_t s = anOffset / kSparseSegment; s < theSegments; ++s) {
+            const size_t theStart = s * kSparseSegment;
+            const size_t theLength = std::min(kSparseSegment, size_t(anEntry.filesize) - theStart);
+            const size_t theSkip = anOffset > theStart ? anOffset - theStart : 0;
+            const char *theBytes = theZeros.data();
+            SegmentPtr theSegment;
+            if (!isHole(s)) {
+                const size_t theStored = theData++ * kSparseSegment;
+                if (theStored + theLength > theMapStart) return ArchiveErrors::badData;
+                theSegment = loadSegment(theFile, aCache, {theFileId, anEntry.head, s}, anEntry,
+                                         theStored / kPayloadSize, theStored + theLength, theLength, &theAhead);
+                if (!theSegment) return ArchiveErrors::fileReadError;
+                theBytes = reinterpret_cast<const char*>(theSegment->data.data());
+            }
+            if (!aSink(theBytes + theSkip, theLength - theSkip)) break;
+        }
+        return ArchiveErrors::noError;
+    }
 
-                // Check compression
-                if (chunk.meta.comp_size) {
-                    // File is compressed, decompress it
-                    std::vector<uint8_t> compressedData(chunk.data, chunk.data + chunk.meta.comp_size);
-                    std::vector<uint8_t> uncompressedData;
-                    IDataProcessor* theProcessor = new Compression(); //uncompress
-                    uncompressedData = theProcessor->reverseProcess(compressedData);
+    //a delta entry's own bytes: header, this version's signatures, then the operations
+    ArchiveErrors Archive::loadDelta(const ArchiveSnapshot &aSnapshot, FrameCache *aCache, const EntryInfo &anEntry,
+                                     std::vector<uint8_t> &aDelta, DeltaHeader &aHeader) {
+        EntryInfo theStored = anEntry; //read as the plain bytes it is stored as
+        theStored.flags = kBlockUsed;
+        theStored.filesize = anEntry.comp_size;
+        theStored.comp_size = 0;
+        aDelta.clear();
+        aDelta.reserve(theStored.filesize);
+        ArchiveErrors theError = readEntry(aSnapshot, aCache, theStored, 0, [&](const char *aData, size_t aLength) {
+            aDelta.insert(aDelta.end(), aData, aData + aLength);
+            return true;
+        });
+        if (ArchiveErrors::noError != theError) return theError;
+        if (aDelta.size() < sizeof(DeltaHeader)) return ArchiveErrors::badData;
+        memcpy(&aHeader, aDelta.data(), sizeof(DeltaHeader));
+        if (kDeltaMagic != aHeader.magic ||
+            sizeof(DeltaHeader) + size_t(aHeader.signatureCount) * sizeof(BlockSignature) > aDelta.size())
+            return ArchiveErrors::badData;
+        return ArchiveErrors::noError;
+    }
+
+    //rebuild a version from anOffset: literals come from its own data, copies from the version before.
+    //each delta down the chain is loaded once, up front, and serves every copy that reads through it;
+    //only the full version at the bottom is read (and cached) from the file per copy
+    ArchiveErrors Archive::readDelta(const ArchiveSnapshot &aSnapshot, FrameCache *aCache, const EntryInfo &anEntry,
+                                     size_t anOffset, const DataSink &aSink) {
+        TRACE_SPAN("delta");
+        struct Level {
+            const EntryInfo     *entry;
+            std::vector<uint8_t> delta;
+            DeltaHeader          header;
+        };
+        std::vector<Level> theLevels; //anEntry, then each version before it that is also a delta
+        const EntryInfo *theBase = &anEntry;
+        while (theBase->isDelta()) {
+            if (theLevels.size() > std::numeric_limits<uint16_t>::max()) return ArchiveErrors::badData; //a loop
+            theLevels.push_back({theBase, {}, {}});
+            Level &theLevel = theLevels.back();
+            ArchiveErrors theError = loadDelta(aSnapshot, aCache, *theBase, theLevel.delta, theLevel.header);
+            if (ArchiveErrors::noError != theError) return theError;
+            theBase = aSnapshot.entries.find(std::string(theLevel.header.base, strnlen(theLevel.header.base, maxFileName)));
+            if (!theBase) return ArchiveErrors::fileNotFound;
+        }
 
-                    if (!uncompressedData.empty()) {
-                        outputFileStream.write(reinterpret_cast<const char*>(uncompressedData.data()), uncompressedData.size());
-                        delete theProcessor; //free
-                    } else {
-                        std::cerr << "Error: Failed to decompress file" << std::endl;
-                        outputFileStream.close();
-                        return ArchiveStatus<bool>(ArchiveErrors::badProcessor);
+        //one level's ops from anOffset; its copies read the level below
+        std::function<ArchiveErrors(size_t, size_t, const DataSink&)> readLevel =
+            [&](size_t aLevel, size_t anOffset, const DataSink &aSink) {
+            const std::vector<uint8_t> &theDelta = theLevels[aLevel].delta;
+            const DeltaHeader &theHeader = theLevels[aLevel].header;
+            size_t thePos = sizeof(DeltaHeader) + size_t(theHeader.signatureCount) * sizeof(BlockSignature);
+            size_t theTarget = 0; //where the op at thePos lands in this version
+            while (thePos + sizeof(DeltaOp) <= theDelta.size()) {
+                DeltaOp theOp;
+                memcpy(&theOp, theDelta.data() + thePos, sizeof(DeltaOp));
+                thePos += sizeof(DeltaOp);
+                const size_t theSkip = anOffset > theTarget ? std::min<size_t>(anOffset - theTarget, theOp.length) : 0;
+                if (kDeltaLiteral == theOp.kind) {
+                    if (thePos + theOp.length > theDelta.size()) return ArchiveErrors::badData;
+                    if (theSkip < theOp.length &&
+                        !aSink(reinterpret_cast<const char*>(theDelta.data()) + thePos + theSkip, theOp.length - theSkip))
+                        return ArchiveErrors::noError;
+                    thePos += theOp.length;
+                }
+                else if (kDeltaCopy == theOp.kind) {
+                    size_t theLeft = theOp.length - theSkip;
+                    bool   theMore = true;
+                    ArchiveErrors theError = ArchiveErrors::noError;
+                    if (theLeft) {
+                        DataSink theCopy = [&](const char *aData, size_t aLength) {
+                            size_t theCount = std::min(aLength, theLeft);
+                            theLeft -= theCount;
+                            theMore = aSink(aData, theCount);
+                            return theMore && theLeft;
+                        };
+                        theError = aLevel + 1 < theLevels.size() ? readLevel(aLevel + 1, theOp.offset + theSkip, theCopy)
+                                                                 : readEntry(aSnapshot, aCache, *theBase, theOp.offset + theSkip, theCopy);
                     }
-                } else {
-                    // File is not compressed, write it directly
-                    outputFileStream.write(reinterpret_cast<const char*>(chunk.data), std::min(chunk.meta.filesize, static_cast<uint32_t>(kChunkSize - sizeof(ChunkHeader))));
+                    if (ArchiveErrors::noError != theError) return theError;
+                    if (!theMore) return ArchiveErrors::noError;
+                    if (theLeft) return ArchiveErrors::badData; //base ended early
+                }
+                else return ArchiveErrors::badData;
+                theTarget += theOp.length;
+            }
+            return theTarget == theLevels[aLevel].entry->filesize ? ArchiveErrors::noError : ArchiveErrors::badData;
+        };
+        return readLevel(0, anOffset, aSink);
+    }
+
+    //the delta built on aName, if any: versions only ever read from the one just before them,
+    //so that is "<file>;<n+1>", or "<file>" itself when aName is the version before the latest
+    const EntryInfo* Archive::dependentOf(const ArchiveSnapshot &aSnapshot, const std::string &aName) {
+        const size_t theMark = aName.rfind(';');
+        if (std::string::npos == theMark) return nullptr; //the latest version, nothing builds on it
+        const std::string theFile = aName.substr(0, theMark);
+        const size_t theVersion = strtoul(aName.c_str() + theMark + 1, nullptr, 10);
+        for (const std::string &theNext : {theFile + ";" + std::to_string(theVersion + 1), theFile}) {
+            const EntryInfo *theEntry = aSnapshot.entries.find(theNext);
+            DeltaHeader theHeader;
+            if (theEntry && theEntry->isDelta() &&
+                aSnapshot.file->readAt(theEntry->head * kChunkSize + sizeof(ChunkHeader), &theHeader, sizeof(DeltaHeader)) &&
+                aName == std::string(theHeader.base, strnlen(theHeader.base, maxFileName)))
+                return theEntry;
+        }
+        return nullptr;
+    }
+
+    //mark every block of anEntry free on disk (readers of older versions can still read the data)
+    bool Archive::releaseBlocks(BlockFile &aFile, const EntryInfo &anEntry) {
+        for (size_t i = 0; i < anEntry.blocks; ++i) {
+            ChunkHeader theHeader; //only the header changes
+            if (!aFile.readHeader(anEntry.head + i, theHeader)) return false;
+            theHeader.occupied = 0;
+            theHeader.checkSum = theHeader.calc_check_sum();
+            if (!aFile.writeHeader(anEntry.head + i, theHeader)) return false;
+        }
+        return true;
+    }
+
+    //metrics for the archive I/O in anIO; operations fill in the rest
+    static OperationMetrics ioMetrics(const IOStats &anIO) {
+        OperationMetrics theMetrics;
+        theMetrics.bytesIn = anIO.bytesRead;
+        theMetrics.bytesOut = anIO.bytesWritten;
+        theMetrics.blocksRead = anIO.blocksRead;
+        theMetrics.blocksWritten = anIO.blocksWritten;
+        theMetrics.ioWait = anIO.seconds;
+        return theMetrics;
+    }
+
+    ArchiveStatus<bool> Archive::add(const std::string &aFileName, IDataProcessor* aProcessor) {
+        return store(aFileName, aFileName, aProcessor, ActionType::added);
+    }
+
+    ArchiveStatus<bool> Archive::add(const std::string &aName, std::istream &anInput, IDataProcessor* aProcessor) {
+        return store(anInput, aName, aProcessor, ActionType::added, 0);
+    }
+
+    ArchiveStatus<bool> Archive::addFd(const std::string &aName, int aFd, IDataProcessor* aProcessor) {
+        FdInputBuffer theBuffer(aFd);
+        std::istream theInput(&theBuffer);
+        return store(theInput, aName, aProcessor, ActionType::added, 0);
+    }
+
+    //append aFileName's content as entry aName (replacing an older copy), reported to observers as anAction
+    ArchiveStatus<bool> Archive::store(const std::string &aFileName, const std::string &aName,
+                                       IDataProcessor* aProcessor, ActionType anAction) {
+        std::ifstream theInput(aFileName, std::ios::binary);
+        if (!theInput.is_open()) {
+            notifyObservers(anAction, aName, false);
+            return ArchiveStatus<bool>(false);
+        }
+        return store(theInput, aName, aProcessor, anAction, calculateFileSize(aFileName));
+    }
+
+    //anInput until it ends as entry aName. aSizeHint is only what the blocks start out saying,
+    //the head is sized from the bytes that actually arrived (a pipe's length isn't known up front)
+    ArchiveStatus<bool> Archive::store(std::istream &anInput, const std::string &aName,
+                                       IDataProcessor* aProcessor, ActionType anAction, size_t aSizeHint) {
+        TRACE_SPAN("add");
+        OperationScope theScope("add");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        std::unique_lock<std::mutex> theGuard(theWriteLock); //writers go one at a time, readers never wait
+        ArchiveLock::Exclusive theFileGuard(theFileLock); //in every process
+        SnapshotPtr theCurrent = syncSnapshot(true);
+        if (!anInput || !theCurrent) {
+            theFileGuard.release();
+            theGuard.unlock();
+            notifyObservers(anAction, aName, false);
+            return ArchiveStatus<bool>(false);
+        }
+        BlockFile &theArcFile = *theCurrent->file;
+        theTOC.beginUpdate();
+
+        //new entries always go on the end of the archive, past anything a reader can see
+        const size_t thePos = theCurrent->blockCount * kChunkSize;
+        const size_t theFileSize = std::min<size_t>(aSizeHint, UINT32_MAX);
+
+        //read -> process -> meta/checksum -> write, each stage on its own thread
+        //queues are bounded so a slow stage pushes back on the ones before it
+        BoundedQueue<std::vector<uint8_t>> theRawQueue, theProcessedQueue;
+        BoundedQueue<std::vector<Chunk>>   theBlockQueue;
+        PipelineStats theStats;
+        theStats.stages = {{"read"}, {"process"}, {"meta"}, {"write"}};
+        std::atomic<bool> theFailed{false};
+        size_t theStoredSize = 0;
+        Chunk theHead;
+        IOStats theWriterIO; //archive writes happen on the writer thread
+
+        auto fail = [&]() {
+            theFailed = true;
+            theRawQueue.close();
+            theProcessedQueue.close();
+            theBlockQueue.close();
+        };
+
+        auto runStage = [&](StageStats &aStage, const std::function<void()> &aBody) {
+            return std::thread([&aStage, aBody, &fail, theName = OperationScope::current()]() {
+                OperationScope theStageScope(theName); //stage work is charged to the add
+                StageClock theClock(aStage);
+                try { aBody(); }
+                catch (...) { fail(); }
+            });
+        };
+
+        auto theStart = std::chrono::steady_clock::now();
+
+        std::thread theReader = runStage(theStats.stages[0], [&]() {
+            TRACE_SPAN("add.source");
+            StageStats &theStage = theStats.stages[0];
+            Chunker theChunker(anInput);
+            size_t theFrameSize = aProcessor ? kFrameSize : kSparseSegment; //raw: the unit holes are kept in
+            bool theOK = theChunker.chunk_frames(theFrameSize, [&](std::vector<uint8_t> &aFrame) {
+                theStage.items++;
+                theStats.bytesIn += aFrame.size();
+                if (theStats.bytesIn > UINT32_MAX) return false; //sizes are 32 bits on disk
+                return theRawQueue.push(std::move(aFrame), &theStage.waitOut);
+            });
+            if (!theOK) fail();
+            theRawQueue.close();
+        });
+
+        std::vector<uint8_t> theHoles; //bit per raw segment left out for being all zeros
+        std::thread theProcessor = runStage(theStats.stages[1], [&]() {
+            StageStats &theStage = theStats.stages[1];
+            std::vector<uint8_t> theFrame;
+            size_t theSegment = 0;
+            for (; theRawQueue.pop(theFrame, &theStage.waitIn); ++theSegment) {
+                theStage.items++;
+                if (aProcessor) {
+                    theFrame = encodeFrame(*aProcessor, theFrame);
+                    if (theFrame.empty()) { fail(); break; }
+                }
+                else if (isZeroRun(theFrame.data(), theFrame.size())) { //only the map remembers it
+                    theHoles.resize(theSegment / 8 + 1);
+                    theHoles[theSegment / 8] |= static_cast<uint8_t>(1u << (theSegment % 8));
+                    continue;
                 }
+                theStoredSize += theFrame.size();
+                if (!theProcessedQueue.push(std::move(theFrame), &theStage.waitOut)) break;
+            }
+            if (!theHoles.empty()) { //the map follows the data
+                theHoles.resize((theSegment + 7) / 8);
+                theStoredSize += theHoles.size();
+                theProcessedQueue.push(std::vector<uint8_t>(theHoles), &theStage.waitOut);
+            }
+            theProcessedQueue.close();
+        });
 
-                // Move to the next block if the file spans multiple blocks
-                size_t current_size = chunk.meta.comp_size ? chunk.meta.comp_size : chunk.meta.filesize;
-                size_t blocksToMove = current_size / kChunkSize;
-                for (size_t i = 1; i < blocksToMove; ++i) {
-                    theArcFile.seekg(prePosition + i * kChunkSize, std::ios::beg); //track back
-                    theArcFile.read(reinterpret_cast<char*>(&chunk), kChunkSize);
-                    outputFileStream.write(chunk.data, kChunkSize - sizeof(ChunkHeader));
+        std::thread theMeta = runStage(theStats.stages[2], [&]() {
+            StageStats &theStage = theStats.stages[2];
+            std::vector<uint8_t> theFrame;
+            std::vector<Chunk> theBatch;
+            Chunk theChunk;
+            size_t theFill = 0;
+            size_t theBlockPos = thePos;
+            uint16_t thePartNum = 1;
+
+            auto emit = [&]() { //seal the current block and start the next one
+                assign_meta(theChunk, theBlockPos, aName, thePartNum, theFileSize);
+                if (1 == thePartNum) theHead = theChunk;
+                theBatch.push_back(theChunk);
+                theChunk = Chunk();
+                theFill = 0;
+                theBlockPos += kChunkSize;
+                thePartNum++;
+            };
+
+            bool theOpen = true;
+            while (theOpen && theProcessedQueue.pop(theFrame, &theStage.waitIn)) {
+                TRACE_SPAN("add.meta");
+                theStage.items++;
+                for (size_t theOffset = 0; theOffset < theFrame.size();) {
+                    size_t theCount = std::min(kPayloadSize - theFill, theFrame.size() - theOffset);
+                    memcpy(theChunk.data + theFill, theFrame.data() + theOffset, theCount);
+                    theFill += theCount;
+                    theOffset += theCount;
+                    if (kPayloadSize == theFill) emit();
                 }
-                break;
+                if (!theBatch.empty()) {
+                    theOpen = theBlockQueue.push(std::move(theBatch), &theStage.waitOut);
+                    theBatch.clear();
+                }
+            }
+            if (theOpen && (theFill || 1 == thePartNum)) { //short tail block (or empty file)
+                emit();
+                theBlockQueue.push(std::move(theBatch), &theStage.waitOut);
             }
+            theBlockQueue.close();
+        });
+
+        std::thread theWriter = runStage(theStats.stages[3], [&]() {
+            StageStats &theStage = theStats.stages[3];
+            std::vector<Chunk> theBatch;
+            size_t theOffset = thePos;
+            const IOStats theStart = BlockFile::threadStats();
+            while (theBlockQueue.pop(theBatch, &theStage.waitIn)) {
+                theStage.items++;
+                size_t theLength = theBatch.size() * kChunkSize;
+                if (!theArcFile.writeAt(theOffset, theBatch.data(), theLength)) { fail(); break; }
+                theOffset += theLength;
+                theStats.bytesOut += theLength;
+            }
+            theWriterIO = BlockFile::threadStats() - theStart;
+        });
+
+        theReader.join();
+        theProcessor.join();
+        theMeta.join();
+        theWriter.join();
+
+        //stored size (and for a stream the size itself) is only known once the last frame
+        //went through, so the head gets patched
+        const size_t theRawSize = theStats.bytesIn;
+        if (!theFailed && (aProcessor || !theHoles.empty() || theRawSize != theFileSize)) {
+            theHead.meta.filesize = static_cast<uint32_t>(theRawSize);
+            if (aProcessor || !theHoles.empty()) theHead.meta.comp_size = static_cast<uint32_t>(theStoredSize);
+            if (!theHoles.empty()) theHead.meta.occupied |= kBlockSparse;
+            theHead.meta.checkSum = theHead.meta.calc_check_sum();
+            theFailed = !theArcFile.writeHeader(thePos / kChunkSize, theHead.meta);
         }
 
-        outputFileStream.close();
+        std::chrono::duration<double> theElapsed = std::chrono::steady_clock::now() - theStart;
+        theStats.elapsed = theElapsed.count();
+        theAddStats = theStats;
+
+        auto measure = [&]() {
+            IOStats theIO = BlockFile::threadStats() - theIOStart;
+            theIO += theWriterIO;
+            OperationMetrics theMetrics = ioMetrics(theIO);
+            theMetrics.bytesIn = theStats.bytesIn;
+            theMetrics.rawBytes = theRawSize;
+            theMetrics.storedBytes = aProcessor || !theHoles.empty() ? theStoredSize : theRawSize;
+            theMetrics.wallTime = theTimer.stop().elapsed();
+            return theMetrics;
+        };
+
+        if (theFailed) {
+            theArcFile.truncate(thePos); //drop the partial entry
+            theTOC.cancelUpdate();
+            theFileGuard.release();
+            theGuard.unlock();
+            notifyObservers(anAction, aName, false, measure());
+            return ArchiveStatus<bool>(false);
+        }
 
-        if (foundFile) {
-            notifyObservers(ActionType::extracted, aFilename, true);
-            return ArchiveStatus<bool>(true);
-        } else {
-            notifyObservers(ActionType::extracted, aFilename, false);
-            return ArchiveStatus<bool>(ArchiveErrors::fileNotFound);
+        { //same name again replaces the older copy
+            TRACE_SPAN("add.index");
+            auto theNext = std::make_shared<ArchiveSnapshot>(*theCurrent);
+            EntryInfo theEntry(thePos / kChunkSize, theHead.meta);
+            if (const EntryInfo *theOld = theCurrent->entries.find(theEntry.name))
+                releaseBlocks(theArcFile, *theOld);
+            theNext->entries.insert(theEntry);
+            theNext->blockCount += theEntry.blocks;
+            theTOC.put(theEntry, theNext->entries, theNext->blockCount);
+            publish(theNext, {theEntry});
         }
+        theFileGuard.release();
+        theGuard.unlock();
+        notifyObservers(anAction, aName, true, measure());
+        return ArchiveStatus<bool>(true);
     }
 
-    ArchiveStatus<bool> Archive::remove(const std::string& aFilename) {
+    //new content for an existing entry. when nothing else can see the archive the entry is rewritten
+    //where it is: blocks whose payload checksum didn't change are left alone, a shorter entry frees
+    //its tail and a longer one grows into free blocks behind it. otherwise (a reader holds a version,
+    //another Archive has the file open, no room to grow) the new content goes on the end like add
+    ArchiveStatus<size_t> Archive::update(const std::string &aName, const std::string &aNewPath,
+                                          IDataProcessor* aProcessor) {
+        TRACE_SPAN("update");
+        OperationScope theScope("update");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        std::ifstream theInput(aNewPath, std::ios::binary);
+        {
+            std::unique_lock<std::mutex> theGuard(theWriteLock);
+            ArchiveLock::Exclusive theFileGuard(theFileLock);
+            SnapshotPtr theCurrent = syncSnapshot(true);
+            const EntryInfo *theEntry = theCurrent ? theCurrent->entries.find(aName) : nullptr;
+            if (!theEntry || !theInput.is_open() || dependentOf(*theCurrent, aName)) { //a later version reads from it
+                theFileGuard.release();
+                theGuard.unlock();
+                notifyObservers(ActionType::updated, aName, false);
+                return ArchiveStatus<size_t>(!theEntry ? ArchiveErrors::fileNotFound
+                                             : theInput.is_open() ? ArchiveErrors::badAction : ArchiveErrors::fileOpenError);
+            }
 
-        if (!theArcFile.is_open()) {
-            std::cerr << "Error: Could not open archive file" << std::endl;
-            notifyObservers(ActionType::removed, aFilename, false);
-            return ArchiveStatus<bool>(ArchiveErrors::fileOpenError);
+            std::unique_lock<std::shared_mutex> theGate(theReaderGate); //new readers wait from here on
+            if (isOnlyHolder(theCurrent)) {
+                auto theResult = rewriteInPlace(theCurrent, *theEntry, theInput, aProcessor);
+                theFileLock.markOpen();
+                if (theResult.isOK() || theResult.getError() != ArchiveErrors::badBlockCount) {
+                    theGate.unlock();
+                    theFileGuard.release();
+                    theGuard.unlock();
+                    OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+                    if (const EntryInfo *theNew = theResult.isOK() ? pinSnapshot()->entries.find(aName) : nullptr) {
+                        theMetrics.rawBytes = theNew->filesize;
+                        theMetrics.storedBytes = theNew->storedSize();
+                    }
+                    theMetrics.wallTime = theTimer.stop().elapsed();
+                    notifyObservers(ActionType::updated, aName, theResult.isOK(), theMetrics);
+                    return theResult;
+                }
+            }
         }
 
-        theArcFile.seekg(0, std::ios::beg); //find begin
+        //relocate: a fresh copy on the end, the old blocks released once it is in
+        auto theStored = store(aNewPath, aName, aProcessor, ActionType::updated);
+        if (!theStored.isOK() || !theStored.getValue()) return ArchiveStatus<size_t>(ArchiveErrors::fileWriteError);
+        SnapshotPtr theCurrent = pinSnapshot();
+        const EntryInfo *theNew = theCurrent->entries.find(aName);
+        return ArchiveStatus<size_t>(theNew ? theNew->blocks : 0);
+    }
 
-        bool foundFile = false;
-        while (!theArcFile.eof() && theArcFile.good()) {
-            // Read the chunk
-            Chunk chunk;
-//            memset(&chunk, 0, kChunkSize);
-            size_t prePosition = theArcFile.tellg();
-            theArcFile.read(reinterpret_cast<char*>(&chunk), kChunkSize);//read data
+    //blocks an entry with aStored bytes spans, always at least one
+    static size_t blocksFor(size_t aStored) {
+        return std::max<size_t>(1, (aStored + kPayloadSize - 1) / kPayloadSize);
+    }
 
-            if (theArcFile.eof() || !theArcFile.good()) {
-                break; // Exit the loop if reading the chunk fails
+    //rewrite anEntry's blocks with anInput's content, writing only blocks whose payload changed.
+    //caller holds every lock and checked isOnlyHolder. the whole new content is read (and encoded)
+    //before the first write, and every block overwritten is kept so a failed write can be undone:
+    //badBlockCount means the entry is as it was (too big to grow in place, or put back) and should be
+    //relocated instead. not crash safe: the table of contents is left pending until the new version
+    //is committed, so an interrupted rewrite leads to a rescan
+    ArchiveStatus<size_t> Archive::rewriteInPlace(const SnapshotPtr &aCurrent, const EntryInfo &anEntry,
+                                                  std::istream &anInput, IDataProcessor* aProcessor) {
+        TRACE_SPAN("update.inPlace");
+        BlockFile &theArcFile = *aCurrent->file;
+
+        //a source that fails to read fails here, with nothing written yet
+        std::vector<uint8_t> theContent;
+        size_t theFileSize = 0;
+        Chunker theChunker(anInput);
+        bool theOK = theChunker.chunk_frames(aProcessor ? kFrameSize : kSparseSegment, [&](std::vector<uint8_t> &aFrame) {
+            theFileSize += aFrame.size();
+            if (!aProcessor) {
+                theContent.insert(theContent.end(), aFrame.begin(), aFrame.end());
+                return true;
+            }
+            std::vector<uint8_t> theFrame = encodeFrame(*aProcessor, aFrame);
+            theContent.insert(theContent.end(), theFrame.begin(), theFrame.end());
+            return !theFrame.empty();
+        });
+        if (!theOK) return ArchiveStatus<size_t>(aProcessor ? ArchiveErrors::badProcessor : ArchiveErrors::fileReadError);
+        if (theFileSize > UINT32_MAX || theContent.size() > UINT32_MAX) //sizes are 32 bits on disk
+            return ArchiveStatus<size_t>(ArchiveErrors::badBlockCount);
+        const size_t theStoredSize = theContent.size();
+
+        //it may grow up to the next live entry, or without limit when none follows
+        const size_t theBlocks = blocksFor(theStoredSize);
+        size_t theRoom = std::numeric_limits<size_t>::max();
+        for (const EntryInfo &theOther : aCurrent->entries) {
+            if (theOther.head > anEntry.head) theRoom = std::min(theRoom, theOther.head - anEntry.head);
+        }
+        if (theBlocks > theRoom) return ArchiveStatus<size_t>(ArchiveErrors::badBlockCount);
+        const bool isLast = anEntry.head + anEntry.blocks == aCurrent->blockCount;
+        theTOC.beginUpdate();
+
+        std::vector<std::pair<size_t, Chunk>> theUndo; //blocks overwritten so far, with what they held
+        auto undo = [&](ArchiveErrors anError) {
+            bool isRestored = true;
+            for (auto &[theIndex, theChunk] : theUndo) isRestored = theArcFile.writeBlock(theIndex, theChunk) && isRestored;
+            if (anEntry.head + theBlocks > aCurrent->blockCount) //growth past the end
+                isRestored = theArcFile.truncate(aCurrent->blockCount * kChunkSize) && isRestored;
+            theTOC.cancelUpdate();
+            return ArchiveStatus<size_t>(isRestored ? ArchiveErrors::badBlockCount : anError);
+        };
+
+        //a batch at a time: read the old blocks, build the new ones, write the runs that differ.
+        //continuation headers only need to name their entry, so an unchanged block keeps its old one
+        std::vector<Chunk> theOld(kBlocksPerBatch), theNew;
+        std::vector<bool> theChanged;
+        ChunkHeader theHead;
+        size_t theStoredPos = 0, theWritten = 0;
+        for (size_t theFirst = 0; theFirst < theBlocks; theFirst += kBlocksPerBatch) {
+            const size_t theCount = std::min(kBlocksPerBatch, theBlocks - theFirst);
+            const size_t theStart = anEntry.head + theFirst;
+            const size_t theOldCount = theFirst < anEntry.blocks ? std::min(theCount, anEntry.blocks - theFirst) : 0;
+            //blocks already in the file (the old entry, then free ones it grows into) are read to undo
+            const size_t theKnown = theStart < aCurrent->blockCount ? std::min(theCount, aCurrent->blockCount - theStart) : 0;
+            if (theKnown && !theArcFile.readAt(theStart * kChunkSize, theOld.data(), theKnown * kChunkSize))
+                return undo(ArchiveErrors::fileReadError);
+
+            theNew.assign(theCount, Chunk());
+            theChanged.assign(theCount, true);
+            for (size_t i = 0; i < theCount; ++i) {
+                Chunk &theChunk = theNew[i];
+                size_t theBytes = std::min(kPayloadSize, theStoredSize - theStoredPos);
+                memcpy(theChunk.data, theContent.data() + theStoredPos, theBytes);
+                theStoredPos += theBytes;
+                assign_meta(theChunk, (theStart + i) * kChunkSize, anEntry.name,
+                            static_cast<uint16_t>(theFirst + i + 1), theFileSize, aProcessor ? theStoredSize : 0);
+                if (0 == theFirst + i) theHead = theChunk.meta; //always rewritten, it carries the sizes
+                else if (i < theOldCount) theChanged[i] = 0 != memcmp(theOld[i].data, theChunk.data, kPayloadSize);
             }
+            for (size_t i = 0; i < theCount;) {
+                if (!theChanged[i]) { ++i; continue; }
+                size_t theRun = i;
+                for (; i < theCount && theChanged[i]; ++i)
+                    if (i < theKnown) theUndo.emplace_back(theStart + i, theOld[i]);
+                if (!theArcFile.writeAt((theStart + theRun) * kChunkSize, &theNew[theRun], (i - theRun) * kChunkSize))
+                    return undo(ArchiveErrors::fileWriteError);
+                theWritten += i - theRun;
+            }
+        }
 
-            // Check if the chunk's filename matches the specified filename
-            std::string extractedFilename(chunk.meta.name);
+        //a shorter entry gives its tail back: cut off the file's end, or mark the blocks free
+        size_t theBlockCount = std::max(aCurrent->blockCount, anEntry.head + theBlocks);
+        if (theBlocks < anEntry.blocks) {
+            EntryInfo theTail;
+            theTail.head = anEntry.head + theBlocks;
+            theTail.blocks = anEntry.blocks - theBlocks;
+            if (isLast && theArcFile.truncate(theTail.head * kChunkSize)) theBlockCount = theTail.head;
+            else if (!releaseBlocks(theArcFile, theTail)) return undo(ArchiveErrors::fileWriteError);
+        }
 
-            if (extractedFilename == aFilename) {
-                foundFile = true;
+        //decoded pieces of the old content are keyed by the same head
+        theFrameCache->eraseEntry(theArcFile.cacheId(), anEntry.head, //a sparse entry's map is cached past its segments
+                                  std::max(anEntry.blocks / kRawSegmentBlocks, anEntry.filesize / kSparseSegment) + 2);
+
+        TRACE_SPAN("update.index");
+        EntryInfo theEntry(anEntry.head, theHead);
+        auto theNext = std::make_shared<ArchiveSnapshot>(*aCurrent);
+        theNext->entries.insert(theEntry);
+        theNext->blockCount = theBlockCount;
+        theTOC.put(theEntry, theNext->entries, theNext->blockCount);
+        publish(theNext, {theEntry});
+        return ArchiveStatus<size_t>(theWritten);
+    }
 
-                //block moving logic
-                size_t current_size = chunk.meta.comp_size ? chunk.meta.comp_size : chunk.meta.filesize;
-                size_t blocksToRemove = current_size / kChunkSize; //get num blocks
-                for (size_t i = 0; i < blocksToRemove; ++i) {
+    constexpr size_t kMinHeadroom = kBlocksPerBatch; //free blocks left behind an entry moved so it can grow
+
+    //whether anEntry can grow to aBlocks where it is. blocks past the end of the file, and blocks
+    //never used (headroom), are always fine; blocks freed earlier only when no reader anywhere can
+    //still be reading them through an older version
+    bool Archive::canGrowInPlace(const ArchiveSnapshot &aCurrent, const EntryInfo &anEntry, size_t aBlocks) {
+        const size_t theEnd = std::min(anEntry.head + aBlocks, aCurrent.blockCount);
+        bool isFresh = true;
+        for (size_t i = anEntry.head + anEntry.blocks; i < theEnd; ++i) {
+            ChunkHeader theHeader;
+            if (!aCurrent.file->readHeader(i, theHeader) || theHeader.occupied) return false;
+            isFresh = isFresh && 0 == theHeader.partNum;
+        }
+        if (isFresh) return true;
+        if (!isOnlyVersion()) return false;
+        theFileLock.markOpen();
+        return true;
+    }
 
-                    theArcFile.seekg(i*kChunkSize+prePosition, std::ios::beg); //out of bounds??
-                    theArcFile.read(reinterpret_cast<char*>(&chunk), kChunkSize);//read data
-                    chunk.meta.occupied=0;
+    //copy anEntry's blocks to aHead (the old ones stay as they are until the caller releases them)
+    bool Archive::copyBlocks(BlockFile &aFile, const EntryInfo &anEntry, size_t aHead) {
+        TRACE_SPAN("append.move");
+        std::vector<Chunk> theBatch(kBlocksPerBatch);
+        for (size_t theFirst = 0; theFirst < anEntry.blocks; theFirst += kBlocksPerBatch) {
+            const size_t theCount = std::min(kBlocksPerBatch, anEntry.blocks - theFirst);
+            if (!aFile.readAt((anEntry.head + theFirst) * kChunkSize, theBatch.data(), theCount * kChunkSize))
+                return false;
+            for (size_t i = 0; i < theCount; ++i) {
+                ChunkHeader &theHeader = theBatch[i].meta;
+                theHeader.nextBlock = static_cast<uint16_t>(aHead + theFirst + i + 1);
+                theHeader.checkSum = theHeader.calc_check_sum();
+            }
+            if (!aFile.writeAt((aHead + theFirst) * kChunkSize, theBatch.data(), theCount * kChunkSize))
+                return false;
+        }
+        return true;
+    }
 
-                    //get next block in file
-                    theArcFile.seekp(i*kChunkSize+prePosition, std::ios::beg);
-                    theArcFile.write(reinterpret_cast<const char*>(&chunk), kChunkSize);
+    //add aData to the end of an entry: it fills the last block's slack, new blocks follow, and the
+    //head's sizes are updated in place, so the cost is about the size of aData. a processed entry
+    //gets new frames of its own. when the blocks behind the entry are taken it is first moved to
+    //the end, with headroom so the next appends stay cheap. readers of older versions never read
+    //past the sizes they know, so nothing they can see changes
+    ArchiveStatus<size_t> Archive::append(const std::string &aName, const std::vector<uint8_t> &aData) {
+        TRACE_SPAN("append");
+        OperationScope theScope("append");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        std::unique_lock<std::mutex> theGuard(theWriteLock);
+        ArchiveLock::Exclusive theFileGuard(theFileLock);
+        SnapshotPtr theCurrent = syncSnapshot(true);
+        const EntryInfo *theFound = theCurrent ? theCurrent->entries.find(aName) : nullptr;
+
+        auto finish = [&](ArchiveErrors anError, size_t aStoredBytes) {
+            theFileGuard.release();
+            theGuard.unlock();
+            OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+            theMetrics.rawBytes = aData.size();
+            theMetrics.storedBytes = aStoredBytes;
+            theMetrics.wallTime = theTimer.stop().elapsed();
+            notifyObservers(ActionType::appended, aName, ArchiveErrors::noError == anError, theMetrics);
+        };
+        if (!theFound) {
+            finish(theCurrent ? ArchiveErrors::fileNotFound : ArchiveErrors::fileOpenError, 0);
+            return ArchiveStatus<size_t>(theCurrent ? ArchiveErrors::fileNotFound : ArchiveErrors::fileOpenError);
+        }
+        if (theFound->isDelta() || theFound->isSparse()) { //its bytes are operations or a hole map, not the content
+            finish(ArchiveErrors::badAction, 0);
+            return ArchiveStatus<size_t>(ArchiveErrors::badAction);
+        }
+        EntryInfo theEntry = *theFound;
+        BlockFile &theArcFile = *theCurrent->file;
+
+        //what goes on the end of the stored data: aData itself, or frames of it
+        std::vector<uint8_t> theEncoded;
+        if (theEntry.comp_size) {
+            Compression theProcessor;
+            for (size_t theOffset = 0; theOffset < aData.size(); theOffset += kFrameSize) {
+                std::vector<uint8_t> theRaw(aData.begin() + theOffset,
+                                            aData.begin() + std::min(aData.size(), theOffset + kFrameSize));
+                std::vector<uint8_t> theFrame = encodeFrame(theProcessor, theRaw);
+                if (theFrame.empty()) {
+                    finish(ArchiveErrors::badProcessor, 0);
+                    return ArchiveStatus<size_t>(ArchiveErrors::badProcessor);
                 }
+                theEncoded.insert(theEncoded.end(), theFrame.begin(), theFrame.end());
             }
         }
+        const std::vector<uint8_t> &theBytes = theEntry.comp_size ? theEncoded : aData;
+        const size_t theOldStored = theEntry.storedSize();
+        const size_t theNewStored = theOldStored + theBytes.size();
+        if (theEntry.filesize + aData.size() > UINT32_MAX || theNewStored > UINT32_MAX) { //sizes are 32 bits on disk
+            finish(ArchiveErrors::badBlockLength, 0);
+            return ArchiveStatus<size_t>(ArchiveErrors::badBlockLength);
+        }
 
-        if (foundFile) {
-            notifyObservers(ActionType::removed, aFilename, true);
-            return ArchiveStatus<bool>(true);
-        } else {
-            // File not found in the archive
-            notifyObservers(ActionType::removed, aFilename, false);
-            return ArchiveStatus<bool>(ArchiveErrors::fileNotFound);
+        //no room behind it: a copy goes on the end first, the old blocks are released once committed
+        const size_t theBlocks = blocksFor(theNewStored);
+        const size_t theOldCount = theCurrent->blockCount;
+        const size_t theOldHead = theEntry.head;
+        size_t theBlockCount = theOldCount;
+        theTOC.beginUpdate();
+        bool theOK = true;
+        if (theBlocks > theEntry.blocks && !canGrowInPlace(*theCurrent, theEntry, theBlocks)) {
+            theOK = copyBlocks(theArcFile, theEntry, theOldCount);
+            theEntry.head = theOldCount;
+            theBlockCount = theOldCount + theBlocks + std::max(theBlocks / 8, kMinHeadroom);
+            theOK = theOK && theArcFile.truncate(theBlockCount * kChunkSize); //headroom reads back as empty blocks
         }
-    }
 
-    ArchiveStatus<size_t> Archive::list(std::ostream &outputStream) {
-        size_t fileCount = 0;
+        //slack of the last block, then whole new blocks, then the head (which commits it for a rescan)
+        const size_t theFill = theOldStored - (theEntry.blocks - 1) * kPayloadSize;
+        const size_t theSlack = std::min(kPayloadSize - theFill, theBytes.size());
+        const size_t theLast = theEntry.head + theEntry.blocks - 1;
+        const uint32_t theFileSize = static_cast<uint32_t>(theEntry.filesize + aData.size());
+        const uint32_t theCompSize = theEntry.comp_size ? static_cast<uint32_t>(theNewStored) : 0;
+        if (theOK && theSlack)
+            theOK = theArcFile.writeAt(theLast * kChunkSize + sizeof(ChunkHeader) + theFill, theBytes.data(), theSlack);
+
+        std::vector<Chunk> theBatch;
+        for (size_t theOffset = theSlack, i = theEntry.blocks; theOK && i < theBlocks;) {
+            const size_t theFirst = i;
+            theBatch.assign(std::min(kBlocksPerBatch, theBlocks - i), Chunk());
+            for (Chunk &theChunk : theBatch) {
+                const size_t theCount = std::min(kPayloadSize, theBytes.size() - theOffset);
+                memcpy(theChunk.data, theBytes.data() + theOffset, theCount);
+                theOffset += theCount;
+                assign_meta(theChunk, (theEntry.head + i) * kChunkSize, theEntry.name, static_cast<uint16_t>(i + 1),
+                            theFileSize, theCompSize);
+                ++i;
+            }
+            theOK = theArcFile.writeAt((theEntry.head + theFirst) * kChunkSize, theBatch.data(), theBatch.size() * kChunkSize);
+        }
 
-        if (!theArcFile.is_open()) {
-            std::cerr << "Error: Could not open archive file" << std::endl;
-            notifyObservers(ActionType::listed, "", false);
-            return ArchiveStatus<size_t>(fileCount);
+        ChunkHeader theHead;
+        if (theOK) theOK = theArcFile.readHeader(theEntry.head, theHead);
+        if (theOK) {
+            theHead.filesize = theFileSize;
+            theHead.comp_size = theCompSize;
+            theHead.checkSum = theHead.calc_check_sum();
+            theOK = theArcFile.writeHeader(theEntry.head, theHead);
+        }
+        if (!theOK) {
+            theArcFile.truncate(theOldCount * kChunkSize); //drops a copy and any blocks past the old end
+            theTOC.cancelUpdate();
+            finish(ArchiveErrors::fileWriteError, theBytes.size());
+            return ArchiveStatus<size_t>(ArchiveErrors::fileWriteError);
         }
+        if (theEntry.head != theOldHead) releaseBlocks(theArcFile, *theFound);
 
-        std::string theOut;
-        theOut += "###  name                 size          date added\n";
-        theOut += "---------------------------------------------------------------\n";
+        {
+            TRACE_SPAN("append.index");
+            EntryInfo theNew(theEntry.head, theHead);
+            auto theNext = std::make_shared<ArchiveSnapshot>(*theCurrent);
+            theNext->entries.insert(theNew);
+            theNext->blockCount = std::max(theBlockCount, theEntry.head + theBlocks);
+            theTOC.put(theNew, theNext->entries, theNext->blockCount);
+            publish(theNext, {theNew});
+        }
+        finish(ArchiveErrors::noError, theBytes.size());
+        return ArchiveStatus<size_t>(theFileSize);
+    }
 
-        while (!theArcFile.eof() && theArcFile.good()) {
-            // Read the chunk
-            Chunk aChunk;
-            memset(&aChunk, 0, kChunkSize);
-            theArcFile.read(reinterpret_cast<char*>(&aChunk), kChunkSize); //read only the header
+    constexpr size_t kDeltaReadSize = 1024 * 1024; //bytes of the new version fed to the encoder at once
+
+    //add aFileName as the next version of its entry. the version it replaces is kept as "<file>;<n>"
+    //and the new one is stored as a delta against it: the previous version's block signatures
+    //(stored with it, or computed once from a full copy) are matched against the new file with a
+    //rolling hash, so what is written scales with the change. a full copy is stored instead when
+    //the chain of deltas would pass setMaxDeltaChain() or the delta isn't smaller than the file
+    ArchiveStatus<size_t> Archive::addVersion(const std::string &aFileName) {
+        TRACE_SPAN("addVersion");
+        OperationScope theScope("addVersion");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        const std::string theName = extractFilename(aFileName).substr(0, maxFileName - 1);
+        std::ifstream theInput(aFileName, std::ios::binary);
+        std::unique_lock<std::mutex> theGuard(theWriteLock);
+        ArchiveLock::Exclusive theFileGuard(theFileLock);
+        SnapshotPtr theCurrent = syncSnapshot(true);
+        const EntryInfo *thePrev = theCurrent ? theCurrent->entries.find(theName) : nullptr;
+
+        size_t theStoredSize = 0;
+        const size_t theFileSize = calculateFileSize(aFileName);
+        auto finish = [&](ArchiveErrors anError, size_t aVersion = 0) {
+            theFileGuard.release();
+            theGuard.unlock();
+            OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+            theMetrics.rawBytes = theFileSize;
+            theMetrics.storedBytes = theStoredSize;
+            theMetrics.wallTime = theTimer.stop().elapsed();
+            notifyObservers(ActionType::added, theName, ArchiveErrors::noError == anError, theMetrics);
+            return ArchiveErrors::noError == anError ? ArchiveStatus<size_t>(aVersion) : ArchiveStatus<size_t>(anError);
+        };
+        if (!theInput.is_open() || !theCurrent) return finish(ArchiveErrors::fileOpenError);
+        if (!thePrev) { //the first version is a plain entry
+            theFileGuard.release();
+            theGuard.unlock();
+            auto theAdded = store(aFileName, aFileName, nullptr, ActionType::added);
+            if (!theAdded.isOK() || !theAdded.getValue()) return ArchiveStatus<size_t>(ArchiveErrors::fileWriteError);
+            return ArchiveStatus<size_t>(1);
+        }
+        BlockFile &theArcFile = *theCurrent->file;
+        FrameCache *theCache = theFrameCache.get();
+
+        //the previous version's number, depth and signatures
+        Signatures theBaseSignatures;
+        size_t theBaseBlock = 0, thePrevVersion = 1, theDepth = 0;
+        const size_t theMaxChain = theMaxDeltaChain.load();
+        if (thePrev->isDelta()) {
+            std::vector<uint8_t> thePrevDelta;
+            DeltaHeader theHeader;
+            if (ArchiveErrors::noError != loadDelta(*theCurrent, theCache, *thePrev, thePrevDelta, theHeader))
+                return finish(ArchiveErrors::badData);
+            thePrevVersion = theHeader.version;
+            theDepth = theHeader.depth;
+            theBaseBlock = theHeader.blockSize;
+            auto *theFirst = reinterpret_cast<const BlockSignature*>(thePrevDelta.data() + sizeof(DeltaHeader));
+            theBaseSignatures.assign(theFirst, theFirst + theHeader.signatureCount);
+        }
+        else {
+            for (auto &theOld : theCurrent->entries.withPrefix(theName + ";")) //after the newest version kept
+                thePrevVersion = std::max<size_t>(thePrevVersion, strtoul(theOld.name.c_str() + theName.size() + 1, nullptr, 10) + 1);
+            if (theMaxChain) {
+                SignatureBuilder theBuilder(deltaBlockSize(thePrev->filesize));
+                ArchiveErrors theError = readEntry(*theCurrent, theCache, *thePrev, 0, [&](const char *aData, size_t aLength) {
+                    theBuilder.write(reinterpret_cast<const uint8_t*>(aData), aLength);
+                    return true;
+                });
+                if (ArchiveErrors::noError != theError) return finish(theError);
+                theBaseBlock = theBuilder.getBlockSize();
+                theBaseSignatures = theBuilder.get();
+            }
+        }
+        const std::string theOldName = theName + ";" + std::to_string(thePrevVersion);
+        if (theOldName.size() >= maxFileName || theCurrent->entries.find(theOldName)) return finish(ArchiveErrors::badFilename);
+
+        //the delta: header, this version's signatures (for the next one), operations
+        std::vector<uint8_t> theDelta;
+        if (theDepth < theMaxChain) {
+            TRACE_SPAN("addVersion.encode");
+            SignatureBuilder theSignatures(deltaBlockSize(theFileSize));
+            DeltaEncoder theEncoder(theBaseSignatures, theBaseBlock);
+            std::vector<char> theBuffer(kDeltaReadSize);
+            while (theInput.read(theBuffer.data(), theBuffer.size()) || theInput.gcount()) {
+                auto *theData = reinterpret_cast<const uint8_t*>(theBuffer.data());
+                theSignatures.write(theData, theInput.gcount());
+                theEncoder.write(theData, theInput.gcount());
+            }
+            theEncoder.finish();
+
+            DeltaHeader theHeader{};
+            theHeader.magic = kDeltaMagic;
+            theHeader.version = static_cast<uint32_t>(thePrevVersion + 1);
+            theHeader.depth = static_cast<uint16_t>(theDepth + 1);
+            strncpy(theHeader.base, theOldName.c_str(), maxFileName - 1);
+            theHeader.targetSize = static_cast<uint32_t>(theFileSize);
+            theHeader.blockSize = static_cast<uint32_t>(theSignatures.getBlockSize());
+            theHeader.signatureCount = static_cast<uint32_t>(theSignatures.get().size());
+            auto *theBytes = reinterpret_cast<const uint8_t*>(&theHeader);
+            theDelta.assign(theBytes, theBytes + sizeof(DeltaHeader));
+            theBytes = reinterpret_cast<const uint8_t*>(theSignatures.get().data());
+            theDelta.insert(theDelta.end(), theBytes, theBytes + theSignatures.get().size() * sizeof(BlockSignature));
+            theDelta.insert(theDelta.end(), theEncoder.getOps().begin(), theEncoder.getOps().end());
+            if (theDelta.size() >= theFileSize) theDelta.clear(); //changed too much to be worth it
+            theInput.clear();
+            theInput.seekg(0);
+        }
+        const bool isDelta = !theDelta.empty();
+        theStoredSize = isDelta ? theDelta.size() : theFileSize;
+
+        //rename the previous version first: a crash then leaves it under its new name, never a
+        //second "<file>" that a rescan would take over a delta reading from "<file>;<n>"
+        theTOC.beginUpdate();
+        ChunkHeader thePrevHead, theRenamed;
+        bool theOK = theArcFile.readHeader(thePrev->head, thePrevHead);
+        if (theOK) {
+            theRenamed = thePrevHead;
+            memset(theRenamed.name, 0, maxFileName);
+            strncpy(theRenamed.name, theOldName.c_str(), maxFileName - 1);
+            theRenamed.hashNum = Chunk::calc_hash(theOldName);
+            theRenamed.checkSum = theRenamed.calc_check_sum();
+            theOK = theArcFile.writeHeader(thePrev->head, theRenamed);
+        }
 
-            if (theArcFile.eof() || !theArcFile.good()) {
-                break; // Exit the loop if reading the header fails
+        //the new version on the end, like add
+        const size_t theHead = theCurrent->blockCount;
+        const size_t theBlocks = blocksFor(theStoredSize);
+        ChunkHeader theNewHead;
+        std::vector<Chunk> theBatch;
+        size_t theOffset = 0;
+        for (size_t i = 0; theOK && i < theBlocks;) {
+            const size_t theFirst = i;
+            theBatch.assign(std::min(kBlocksPerBatch, theBlocks - i), Chunk());
+            for (Chunk &theChunk : theBatch) {
+                const size_t theCount = std::min(kPayloadSize, theStoredSize - theOffset);
+                if (isDelta) memcpy(theChunk.data, theDelta.data() + theOffset, theCount);
+                else if (!theInput.read(theChunk.data, theCount)) theOK = false;
+                theOffset += theCount;
+                assign_meta(theChunk, (theHead + i) * kChunkSize, theName, static_cast<uint16_t>(i + 1),
+                            theFileSize, isDelta ? theStoredSize : 0);
+                if (0 == i && isDelta) {
+                    theChunk.meta.occupied |= kBlockDelta;
+                    theChunk.meta.checkSum = theChunk.meta.calc_check_sum();
+                }
+                if (0 == i) theNewHead = theChunk.meta;
+                ++i;
             }
+            theOK = theOK && theArcFile.writeAt((theHead + theFirst) * kChunkSize, theBatch.data(), theBatch.size() * kChunkSize);
+        }
+        if (!theOK) {
+            theArcFile.truncate(theHead * kChunkSize);
+            theArcFile.writeHeader(thePrev->head, thePrevHead);
+            theTOC.cancelUpdate();
+            return finish(ArchiveErrors::fileWriteError);
+        }
 
-            // Extract relevant metadata from the header
-            // For example, if the header contains the filename, size, and date added:
-            // convert ms to nice time string
-            time_t t_added = aChunk.meta.dateAdded;
-            std::string date = std::ctime(&t_added);
+        {
+            TRACE_SPAN("addVersion.index");
+            EntryInfo theOld(thePrev->head, theRenamed), theNew(theHead, theNewHead);
+            auto theNext = std::make_shared<ArchiveSnapshot>(*theCurrent);
+            theNext->entries.insert(theOld);
+            theNext->entries.insert(theNew);
+            theNext->blockCount = theHead + theBlocks;
+            theTOC.put(theOld, theNext->entries, theNext->blockCount);
+            theTOC.put(theNew, theNext->entries, theNext->blockCount);
+            publish(theNext, {theOld, theNew});
+        }
+        return finish(ArchiveErrors::noError, thePrevVersion + 1);
+    }
 
-            //set size dependent to compression status
-            size_t current_size = aChunk.meta.comp_size ? aChunk.meta.comp_size : aChunk.meta.filesize;
-            //keep track of filename and filesize
-            uint32_t blocksToMove = current_size/kChunkSize; //skip other blocks, to next file
+    //the file an entry belongs to: "<file>" and its older versions "<file>;<n>" go together
+    static std::string fileOf(const std::string &aName) {
+        return aName.substr(0, aName.find(';'));
+    }
 
-            if (aChunk.meta.occupied) { //formatting
-                theOut += std::to_string(fileCount + 1) + ".\t " + std::string(aChunk.meta.name) + "\t  " + std::to_string(current_size) + "\t\t\t" + date;
-            }
+    //bring anOther's entries onto the end of this archive as they are stored: small entries go
+    //across in batches and a large one's blocks after the head with copy_file_range, and only the
+    //heads are rewritten (address, maybe a new name), so compressed data is never decoded. a file
+    //both archives have comes with all its versions, and is skipped, replaces ours, or is brought
+    //in as "<file>~<n>" as aPolicy says. blocks behind a large entry's head keep the name and
+    //nextBlock they had in anOther; nothing reads them, entries are found from their heads
+    ArchiveStatus<size_t> Archive::merge(Archive &anOther, MergePolicy aPolicy) {
+        TRACE_SPAN("merge");
+        OperationScope theScope("merge");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        SnapshotPtr theTheirs = this == &anOther ? nullptr : anOther.pinForRead(); //caught up with its file, past its gate
+        std::unique_lock<std::mutex> theGuard(theWriteLock);
+        ArchiveLock::Exclusive theFileGuard(theFileLock);
+        SnapshotPtr theCurrent = syncSnapshot(true);
+
+        size_t theRawSize = 0, theStoredSize = 0;
+        auto finish = [&](ArchiveErrors anError, size_t aCount = 0) {
+            theFileGuard.release();
+            theGuard.unlock();
+            OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+            theMetrics.rawBytes = theRawSize;
+            theMetrics.storedBytes = theStoredSize;
+            theMetrics.wallTime = theTimer.stop().elapsed();
+            notifyObservers(ActionType::merged, "", ArchiveErrors::noError == anError, theMetrics);
+            return ArchiveErrors::noError == anError ? ArchiveStatus<size_t>(aCount) : ArchiveStatus<size_t>(anError);
+        };
+        if (!theCurrent) return finish(ArchiveErrors::fileOpenError);
+        if (!theTheirs || theTheirs->file->fileId() == theCurrent->file->fileId()) return finish(ArchiveErrors::badAction);
+
+        std::map<std::string, std::vector<EntryInfo>> theFiles; //their entries by file
+        theTheirs->entries.forEach([&](const EntryInfo &anEntry) {
+            theFiles[fileOf(anEntry.name)].push_back(anEntry);
+            return true;
+        });
 
-            //verify there is valid file
-            if (blocksToMove) {
-                theArcFile.seekg((blocksToMove-1) * kChunkSize, std::ios::cur); //correctly shift
-                ++fileCount;
-            } else {
-                break;
+        //what goes where: each copy keeps its version suffix after the (maybe renamed) file
+        struct Copy {
+            EntryInfo   from;
+            std::string file, stem;
+        };
+        std::vector<Copy> theCopies;
+        std::vector<EntryInfo> theReplaced; //ours, released once theirs are in
+        std::set<std::string> theTaken;     //names copies were given
+        auto isTaken = [&](const std::string &aName) {
+            return theCurrent->entries.find(aName) || theTheirs->entries.find(aName) || theTaken.count(aName);
+        };
+        for (auto &[theFile, theEntries] : theFiles) {
+            bool isClash = false;
+            for (auto &theEntry : theEntries) isClash = isClash || theCurrent->entries.find(theEntry.name);
+            std::string theStem = theFile;
+            if (isClash && MergePolicy::skip == aPolicy) continue;
+            if (isClash && MergePolicy::replace == aPolicy) { //all of our versions go, later ones read from earlier ones
+                if (const EntryInfo *theOurs = theCurrent->entries.find(theFile)) theReplaced.push_back(*theOurs);
+                for (auto &theOurs : theCurrent->entries.withPrefix(theFile + ";")) theReplaced.push_back(theOurs);
+            }
+            if (isClash && MergePolicy::rename == aPolicy) {
+                size_t theSuffix = 0; //longest ";<n>"
+                for (auto &theEntry : theEntries) theSuffix = std::max(theSuffix, theEntry.name.size() - theFile.size());
+                bool isFree = false;
+                for (size_t n = 2; !isFree; ++n) {
+                    const std::string theMark = "~" + std::to_string(n);
+                    if (theSuffix + theMark.size() >= maxFileName) return finish(ArchiveErrors::badFilename);
+                    theStem = theFile.substr(0, maxFileName - 1 - theSuffix - theMark.size()) + theMark;
+                    isFree = true;
+                    for (auto &theEntry : theEntries) isFree = isFree && !isTaken(theStem + theEntry.name.substr(theFile.size()));
+                }
+            }
+            for (auto &theEntry : theEntries) {
+                theCopies.push_back({theEntry, theFile, theStem});
+                theTaken.insert(theStem + theEntry.name.substr(theFile.size()));
+            }
+        }
+        std::sort(theCopies.begin(), theCopies.end(),
+                  [](const Copy &a, const Copy &b) {return a.from.head < b.from.head;});
+
+        //a copied head: new address and name, and the sizes of the version pinned (not of a later append)
+        auto rehead = [](Chunk &aChunk, size_t anIndex, const Copy &aCopy) {
+            ChunkHeader &theHeader = aChunk.meta;
+            const std::string theName = aCopy.stem + aCopy.from.name.substr(aCopy.file.size());
+            memset(theHeader.name, 0, maxFileName);
+            strncpy(theHeader.name, theName.c_str(), maxFileName - 1);
+            theHeader.hashNum = Chunk::calc_hash(theName);
+            theHeader.filesize = aCopy.from.filesize;
+            theHeader.comp_size = aCopy.from.comp_size;
+            theHeader.nextBlock = static_cast<uint16_t>(anIndex + 1);
+            theHeader.checkSum = theHeader.calc_check_sum();
+            if (aCopy.from.isDelta() && aCopy.stem != aCopy.file) { //its base was renamed along with it
+                DeltaHeader theDelta;
+                memcpy(&theDelta, aChunk.data, sizeof(DeltaHeader));
+                std::string theBase(theDelta.base, strnlen(theDelta.base, maxFileName));
+                theBase = aCopy.stem + theBase.substr(std::min(theBase.size(), aCopy.file.size()));
+                memset(theDelta.base, 0, maxFileName);
+                strncpy(theDelta.base, theBase.c_str(), maxFileName - 1);
+                memcpy(aChunk.data, &theDelta, sizeof(DeltaHeader));
+            }
+        };
+
+        theTOC.beginUpdate();
+        BlockFile &theArcFile = *theCurrent->file;
+        const BlockFile &theSource = *theTheirs->file;
+        const size_t theOldCount = theCurrent->blockCount;
+        size_t theHead = theOldCount; //next block written; the batch ends here
+        std::vector<Chunk> theBatch;
+        std::vector<EntryInfo> theMerged;
+        auto flush = [&]() {
+            bool isOK = theBatch.empty() ||
+                        theArcFile.writeAt((theHead - theBatch.size()) * kChunkSize, theBatch.data(), theBatch.size() * kChunkSize);
+            theBatch.clear();
+            return isOK;
+        };
+        bool theOK = true;
+        for (auto theCopy = theCopies.begin(); theOK && theCopy != theCopies.end(); ++theCopy) {
+            TRACE_SPAN("merge.copy");
+            const EntryInfo &theFrom = theCopy->from;
+            if (theFrom.blocks < kBlocksPerBatch) { //read whole, every header gets its address
+                if (theBatch.size() + theFrom.blocks > kBlocksPerBatch) theOK = flush();
+                const size_t theFirst = theBatch.size();
+                theBatch.resize(theFirst + theFrom.blocks);
+                theOK = theOK && theSource.readAt(theFrom.head * kChunkSize, &theBatch[theFirst], theFrom.blocks * kChunkSize);
+                for (size_t i = 1; theOK && i < theFrom.blocks; ++i) {
+                    ChunkHeader &theHeader = theBatch[theFirst + i].meta;
+                    theHeader.nextBlock = static_cast<uint16_t>(theHead + i + 1);
+                    theHeader.checkSum = theHeader.calc_check_sum();
+                }
+                if (theOK) rehead(theBatch[theFirst], theHead, *theCopy);
+                if (theOK) theMerged.emplace_back(theHead, theBatch[theFirst].meta);
             }
+            else { //the blocks after the head first, the head makes it an entry
+                Chunk theChunk;
+                theOK = flush() && theArcFile.copyFrom(theSource, (theFrom.head + 1) * kChunkSize,
+                                                       (theHead + 1) * kChunkSize, (theFrom.blocks - 1) * kChunkSize);
+                theOK = theOK && theSource.readBlock(theFrom.head, theChunk);
+                if (theOK) rehead(theChunk, theHead, *theCopy);
+                theOK = theOK && theArcFile.writeBlock(theHead, theChunk);
+                if (theOK) theMerged.emplace_back(theHead, theChunk.meta);
+            }
+            theHead += theFrom.blocks;
+            theRawSize += theFrom.filesize;
+            theStoredSize += theFrom.storedSize();
+        }
+        theOK = theOK && flush();
+        for (auto &theOurs : theReplaced) theOK = theOK && releaseBlocks(theArcFile, theOurs);
+        if (!theOK) {
+            theArcFile.truncate(theOldCount * kChunkSize);
+            theTOC.cancelUpdate();
+            return finish(ArchiveErrors::fileWriteError);
+        }
 
+        {
+            TRACE_SPAN("merge.index");
+            auto theNext = std::make_shared<ArchiveSnapshot>(*theCurrent);
+            for (auto &theOurs : theReplaced) theNext->entries.erase(theOurs.name);
+            for (auto &theEntry : theMerged) theNext->entries.insert(theEntry);
+            theNext->blockCount = theHead;
+            theTOC.rewrite(theArcFile.fileId(), theNext->entries, theNext->blockCount);
+            publish(theNext);
         }
-        outputStream << theOut; //write to file
+        return finish(ArchiveErrors::noError, theMerged.size());
+    }
 
-        notifyObservers(ActionType::listed, "", true);
-        return ArchiveStatus<size_t>(fileCount);
+    ArchiveStatus<bool> Archive::extract(const std::string &aFilename, const std::string &aFullPath) {
+        TRACE_SPAN("extract");
+        OperationScope theScope("extract");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        ArchiveReader theReader = openReader();
+        auto theResult = theReader.extract(aFilename, aFullPath);
+
+        OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+        if (const EntryInfo *theEntry = theReader.snapshot ? theReader.snapshot->entries.find(aFilename) : nullptr) {
+            theMetrics.rawBytes = theEntry->filesize;
+            theMetrics.storedBytes = theEntry->storedSize();
+            if (theResult.isOK()) theMetrics.bytesOut = theEntry->filesize;
+        }
+        theMetrics.wallTime = theTimer.stop().elapsed();
+        notifyObservers(ActionType::extracted, aFilename, theResult.isOK(), theMetrics);
+        return theResult;
+    }
+
+    ArchiveStatus<size_t> Archive::extract(const std::string &aFilename, const DataSink &aSink) {
+        return measureExtract(aFilename, [&](const ArchiveReader &aReader) {return aReader.extract(aFilename, aSink);});
+    }
+
+    ArchiveStatus<size_t> Archive::extract(const std::string &aFilename, std::ostream &aStream) {
+        return measureExtract(aFilename, [&](const ArchiveReader &aReader) {return aReader.extract(aFilename, aStream);});
+    }
+
+    ArchiveStatus<size_t> Archive::extract(const std::string &aFilename, std::vector<uint8_t> &aBuffer) {
+        return measureExtract(aFilename, [&](const ArchiveReader &aReader) {return aReader.extract(aFilename, aBuffer);});
+    }
+
+    //an extract that doesn't go to a file, timed and reported like one that does
+    ArchiveStatus<size_t> Archive::measureExtract(const std::string &aFilename,
+                                                  const std::function<ArchiveStatus<size_t>(const ArchiveReader&)> &anExtract) {
+        TRACE_SPAN("extract");
+        OperationScope theScope("extract");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        ArchiveReader theReader = openReader();
+        auto theResult = anExtract(theReader);
+
+        OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+        if (const EntryInfo *theEntry = theReader.snapshot ? theReader.snapshot->entries.find(aFilename) : nullptr) {
+            theMetrics.rawBytes = theEntry->filesize;
+            theMetrics.storedBytes = theEntry->storedSize();
+        }
+        if (theResult.isOK()) theMetrics.bytesOut = theResult.getValue();
+        theMetrics.wallTime = theTimer.stop().elapsed();
+        notifyObservers(ActionType::extracted, aFilename, theResult.isOK(), theMetrics);
+        return theResult;
+    }
+
+    ArchiveStatus<size_t> Archive::readRange(const std::string &aFilename, size_t anOffset, size_t aLength,
+                                             std::vector<uint8_t> &aBuffer) {
+        OperationScope theScope("readRange");
+        return openReader().readRange(aFilename, anOffset, aLength, aBuffer);
+    }
+
+    ArchiveStatus<size_t> Archive::extractAll(const std::string &aFolder) {
+        TRACE_SPAN("extractAll");
+        OperationScope theScope("extractAll");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        auto theResult = openReader().extractAll(aFolder);
+        OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+        theMetrics.wallTime = theTimer.stop().elapsed();
+        notifyObservers(ActionType::extracted, "", theResult.isOK(), theMetrics);
+        return theResult;
+    }
+
+    ArchiveStatus<size_t> Archive::extractPrefix(const std::string &aPrefix, const std::string &aFolder) {
+        TRACE_SPAN("extractPrefix");
+        OperationScope theScope("extractPrefix");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        auto theResult = openReader().extractPrefix(aPrefix, aFolder);
+        OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+        theMetrics.wallTime = theTimer.stop().elapsed();
+        notifyObservers(ActionType::extracted, aPrefix, theResult.isOK(), theMetrics);
+        return theResult;
+    }
+
+    ArchiveStatus<bool> Archive::remove(const std::string& aFilename) {
+        TRACE_SPAN("remove");
+        OperationScope theScope("remove");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        std::unique_lock<std::mutex> theGuard(theWriteLock);
+        ArchiveLock::Exclusive theFileGuard(theFileLock);
+        SnapshotPtr theCurrent = syncSnapshot(true);
+
+        if (!theCurrent) {
+            std::cerr << "Error: Could not open archive file" << std::endl;
+            theFileGuard.release();
+            theGuard.unlock();
+            notifyObservers(ActionType::removed, aFilename, false);
+            return ArchiveStatus<bool>(ArchiveErrors::fileOpenError);
+        }
+
+        const EntryInfo *theEntry = theCurrent->entries.find(aFilename);
+        if (!theEntry) {
+            // File not found in the archive
+            theFileGuard.release();
+            theGuard.unlock();
+            notifyObservers(ActionType::removed, aFilename, false);
+            return ArchiveStatus<bool>(ArchiveErrors::fileNotFound);
+        }
+        if (dependentOf(*theCurrent, aFilename)) { //the next version is a delta against it
+            theFileGuard.release();
+            theGuard.unlock();
+            notifyObservers(ActionType::removed, aFilename, false);
+            return ArchiveStatus<bool>(ArchiveErrors::badAction);
+        }
+
+        theTOC.beginUpdate();
+        bool theResult = releaseBlocks(*theCurrent->file, *theEntry);
+        OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+        theMetrics.rawBytes = theEntry->filesize;
+        theMetrics.storedBytes = theEntry->storedSize();
+        if (theResult) {
+            TRACE_SPAN("remove.index");
+            auto theNext = std::make_shared<ArchiveSnapshot>(*theCurrent);
+            theNext->entries.erase(aFilename);
+            theTOC.erase(aFilename, theNext->entries, theNext->blockCount);
+            publish(theNext, {}, {aFilename});
+        }
+        else theTOC.cancelUpdate();
+        theFileGuard.release();
+        theGuard.unlock();
+
+        theMetrics.wallTime = theTimer.stop().elapsed();
+        notifyObservers(ActionType::removed, aFilename, theResult, theMetrics);
+        if (theResult) return ArchiveStatus<bool>(true);
+        return ArchiveStatus<bool>(ArchiveErrors::fileWriteError);
+    }
+
+    ArchiveStatus<size_t> Archive::list(std::ostream &outputStream, const std::string &aPrefix) {
+        TRACE_SPAN("list");
+        OperationScope theScope("list");
+        Timer theTimer;
+        auto theResult = openReader().list(outputStream, aPrefix);
+        OperationMetrics theMetrics;
+        theMetrics.wallTime = theTimer.stop().elapsed();
+        notifyObservers(ActionType::listed, "", theResult.isOK(), theMetrics);
+        return theResult;
     }
 
     ArchiveStatus<size_t> Archive::debugDump(std::ostream &aStream) {
+        TRACE_SPAN("debugDump");
+        OperationScope theScope("debugDump");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
         size_t numBlocks = 0;
         string theOut;
+        SnapshotPtr theCurrent = pinForRead();
 
-        if (!theArcFile.is_open()) {
+        if (!theCurrent) {
             std::cerr << "Error: Could not open archive file" << std::endl;
             notifyObservers(ActionType::dumped, "", false);
             return ArchiveStatus<size_t>(numBlocks);
         }
 
-        // Move to the beginning of the archive file
-        theArcFile.seekg(0, std::ios::beg);
-
         theOut +="###  status            name\n";
         theOut+= "-----------------------------\n";
 
-        while (!theArcFile.eof() && theArcFile.good()) {
-            // Read the chunk header
-            Chunk chunk;
-            theArcFile.read(reinterpret_cast<char *>(&chunk), kChunkSize);
-
-            if (theArcFile.eof() || !theArcFile.good()) {
-                break; // Exit the loop if reading the  fails
+        //every block in order, a batch at a time, with the kernel kept a window ahead. the hints are
+        //for these ranges only: the descriptor is shared with every other reader of the file
+        const BlockFile &theFile = *theCurrent->file;
+        EntryInfo theWhole; //the whole file as one run of blocks
+        theWhole.blocks = theCurrent->blockCount;
+        Readahead theAhead(theFile, theWhole);
+        std::vector<Chunk> theChunks(kBlocksPerBatch);
+        for (bool isRead = true; isRead && numBlocks < theCurrent->blockCount;) {
+            const size_t theCount = std::min(kBlocksPerBatch, theCurrent->blockCount - numBlocks);
+            theAhead.reached(numBlocks);
+            isRead = theFile.readAt(numBlocks * kChunkSize, theChunks.data(), theCount * kChunkSize);
+            for (size_t c = 0; isRead && c < theCount; ++c, ++numBlocks) {
+                const ChunkHeader &theHeader = theChunks[c].meta;
+                std::string status = (theHeader.occupied) ? "used" : "empty";
+                std::string name = (theHeader.occupied) ? std::string(theHeader.name) : ""; //return name when occupied
+
+                theOut += to_string(numBlocks + 1) += ".   "; //formatting
+                theOut += status += "\t";
+                theOut += name += '\n';
             }
-
-            std::string status = (chunk.meta.occupied) ? "used" : "empty";
-            std::string name = (chunk.meta.occupied) ? std::string(chunk.meta.name) : ""; //return name when occupied
-
-            theOut += to_string(numBlocks + 1) += ".   "; //formatting
-            theOut += status += "\t";
-            theOut += name += '\n';
-
-            //next
-            theArcFile.seekg(0, std::ios::cur);
-
-            ++numBlocks;
         }
         aStream<<theOut;
 
-        notifyObservers(ActionType::dumped, "", true);
+        OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+        theMetrics.bytesOut = theOut.size();
+        theMetrics.wallTime = theTimer.stop().elapsed();
+        notifyObservers(ActionType::dumped, "", true, theMetrics);
         return ArchiveStatus<size_t>(numBlocks);
     }
 
     ArchiveStatus<size_t> Archive::compact() {
+        TRACE_SPAN("compact");
+        OperationScope theScope("compact");
+        Timer theTimer;
+        const IOStats theIOStart = BlockFile::threadStats();
+        std::unique_lock<std::mutex> theGuard(theWriteLock);
+        ArchiveLock::Exclusive theFileGuard(theFileLock);
+        SnapshotPtr theCurrent = syncSnapshot(true);
+
+        if (!theCurrent) {
+            std::cerr << "Error: Could not open archive file" << std::endl;
+            theFileGuard.release();
+            theGuard.unlock();
+            notifyObservers(ActionType::compacted, "", false);
+            return ArchiveStatus<size_t>(0);
+        }
 
-        //temporary filename
-        std::fstream compactedFile("temp_archive", std::ios::binary);
-        if (!compactedFile.is_open()) {
+        //temporary filename, next to the archive so the rename stays on one device. a striped archive
+        //gets a new generation of volumes, the old ones stay readable until the manifest is renamed
+        const string theTempName = theArcName + ".compact";
+        const bool isInMemory = StorageKind::memory == theStorage;
+        auto compactedFile = std::make_shared<BlockFile>();
+        VolumeLayout theLayout = theCurrent->file->getLayout();
+        ++theLayout.generation;
+        if (!(isInMemory ? compactedFile->attach(std::make_unique<MemoryStorage>())
+              : theCurrent->file->isStriped() ? compactedFile->create(theTempName, theLayout, theArcName)
+                                              : compactedFile->open(theTempName, true))) {
             std::cerr << "Error: Could not create compacted archive file" << std::endl;
+            theFileGuard.release();
+            theGuard.unlock();
+            notifyObservers(ActionType::compacted, "", false);
             return ArchiveStatus<size_t>(0);
         }
 
-        if (!theArcFile.is_open()) {
-            std::cerr << "Error: Could not open archive file" << std::endl;
+        //copy live entries down in their on-disk order, renumbering their blocks
+        std::vector<EntryInfo> theEntries;
+        theCurrent->entries.forEach([&](const EntryInfo &anEntry) {
+            theEntries.push_back(anEntry);
+            return true;
+        });
+        std::sort(theEntries.begin(), theEntries.end(),
+                  [](const EntryInfo &a, const EntryInfo &b) {return a.head < b.head;});
+
+        //each entry is read with the kernel a window ahead of the copy (hints for its own blocks only,
+        //readers share the descriptor). the old file's pages are dropped once it has been replaced
+        const BlockFile &theSource = *theCurrent->file;
+        auto theNext = std::make_shared<ArchiveSnapshot>();
+        theNext->file = compactedFile;
+        size_t compactedSize = 0;
+        bool theResult = true;
+        std::vector<Chunk> theChunks(kBlocksPerBatch);
+        for (auto &theEntry : theEntries) {
+            TRACE_SPAN("compact.copy");
+            size_t theHead = compactedSize;
+            Readahead theAhead(theSource, theEntry);
+            for (size_t i = 0; i < theEntry.blocks && theResult;) {
+                const size_t theCount = std::min(kBlocksPerBatch, theEntry.blocks - i);
+                theAhead.reached(i);
+                theResult = theSource.readAt((theEntry.head + i) * kChunkSize, theChunks.data(), theCount * kChunkSize);
+                for (size_t c = 0; c < theCount; ++c) {
+                    theChunks[c].meta.nextBlock = static_cast<uint16_t>(compactedSize + c + 1);
+                    theChunks[c].meta.checkSum = theChunks[c].meta.calc_check_sum();
+                }
+                theResult = theResult && compactedFile->writeAt(compactedSize * kChunkSize, theChunks.data(), theCount * kChunkSize);
+                compactedSize += theCount;
+                i += theCount;
+            }
+            if (!theResult) break;
+            theEntry.head = theHead;
+            theNext->entries.insert(theEntry);
+        }
+        theNext->blockCount = compactedSize;
+
+        if (theResult) theResult = compactedFile->sync();
+        if (!theResult) {
+            compactedFile->removeVolumes();
+            compactedFile->close();
+            if (!isInMemory) std::remove(theTempName.c_str());
+            theFileGuard.release();
+            theGuard.unlock();
             notifyObservers(ActionType::compacted, "", false);
-            return ArchiveStatus<size_t>(0);
+            return ArchiveStatus<size_t>(ArchiveErrors::fileWriteError);
         }
 
-        // Move to the beginning of the archive file
-        theArcFile.seekg(0, std::ios::beg);
+        { //swap the compacted file in; readers still holding the old version keep the old inode open
+            TRACE_SPAN("compact.index");
+            if (!isInMemory) renamefile(theTempName, theArcName);
+            theTOC.rewrite(compactedFile->fileId(), theNext->entries, theNext->blockCount);
+            publish(theNext);
+            theCurrent->file->removeVolumes();
+            theSource.advise(0, 0, AccessHint::dontNeed); //replaced: only readers of older versions still use it
+        }
+        theFileGuard.release();
+        theGuard.unlock();
 
-        size_t compactedSize = 0;
+        OperationMetrics theMetrics = ioMetrics(BlockFile::threadStats() - theIOStart);
+        theMetrics.wallTime = theTimer.stop().elapsed();
+        notifyObservers(ActionType::compacted, "", true, theMetrics);
+        return ArchiveStatus<size_t>(compactedSize);
+    }
 
-        while (!theArcFile.eof() && theArcFile.good()) {
-            // Read the chunk
-            Chunk chunk;
-            memset(&chunk, 0, kChunkSize);
-            theArcFile.read(reinterpret_cast<char *>(&chunk), kChunkSize);
+    //ArchiveReader
+    // ----------------------------------------------------------------------------------------------------------
 
-            if (theArcFile.eof() || !theArcFile.good()) {
-                break; // Exit the loop if reading the chunk fails
-            }
+    ArchiveStatus<bool> ArchiveReader::extract(const std::string &aFilename, const std::string &aFullPath) const {
+        const EntryInfo *theEntry = snapshot ? snapshot->entries.find(aFilename) : nullptr;
+        if (!theEntry) return ArchiveStatus<bool>(ArchiveErrors::fileNotFound);
 
-            // Check if the chunk is occupied
-            if (chunk.meta.occupied) {
-                // Write the chunk to the compacted archive file
-                compactedFile.write(reinterpret_cast<const char *>(&chunk), kChunkSize);
-                compactedSize += chunk.meta.filesize / kChunkSize;
-            }
-            compactedSize *= kChunkSize;
+        std::ofstream outputFileStream(aFullPath, std::ios::binary | std::ios::out);
+        if (!outputFileStream.is_open()) {
+            std::cerr << "Error: Could not open output file" << std::endl;
+            return ArchiveStatus<bool>(ArchiveErrors::fileOpenError);
+        }
+
+        //runs of zeros are skipped over rather than written, so they come back as holes in the file
+        bool isHoleAtEnd = false;
+        ArchiveErrors theResult = Archive::readEntry(*snapshot, cache.get(), *theEntry, 0, [&](const char *aData, size_t aLength) {
+            TRACE_SPAN("extract.output");
+            isHoleAtEnd = isZeroRun(reinterpret_cast<const uint8_t*>(aData), aLength);
+            if (isHoleAtEnd) outputFileStream.seekp(aLength, std::ios::cur);
+            else outputFileStream.write(aData, aLength);
+            return outputFileStream.good();
+        });
+        if (ArchiveErrors::noError == theResult && !outputFileStream.good())
+            theResult = ArchiveErrors::fileWriteError;
+        outputFileStream.close();
+        std::error_code theError; //a hole at the end still has to count toward the size
+        if (ArchiveErrors::noError == theResult && isHoleAtEnd)
+            std::filesystem::resize_file(aFullPath, theEntry->filesize, theError);
+        if (theError) theResult = ArchiveErrors::fileWriteError;
+
+        if (ArchiveErrors::noError != theResult) return ArchiveStatus<bool>(theResult);
+        return ArchiveStatus<bool>(true);
+    }
+
+    //same walk (and decoding) as a file extract, the pieces just go to aSink instead of a file
+    ArchiveStatus<size_t> ArchiveReader::extract(const std::string &aFilename, const DataSink &aSink) const {
+        const EntryInfo *theEntry = snapshot ? snapshot->entries.find(aFilename) : nullptr;
+        if (!theEntry) return ArchiveStatus<size_t>(ArchiveErrors::fileNotFound);
+
+        size_t theCount = 0;
+        ArchiveErrors theResult = Archive::readEntry(*snapshot, cache.get(), *theEntry, 0, [&](const char *aData, size_t aLength) {
+            TRACE_SPAN("extract.output");
+            theCount += aLength;
+            return aSink(aData, aLength);
+        });
+        if (ArchiveErrors::noError != theResult) return ArchiveStatus<size_t>(theResult);
+        return ArchiveStatus<size_t>(theCount);
+    }
 
-            //close old file
-            theArcFile.flush();
-            theArcFile.close();
+    ArchiveStatus<size_t> ArchiveReader::extract(const std::string &aFilename, std::ostream &aStream) const {
+        auto theResult = extract(aFilename, [&](const char *aData, size_t aLength) {
+            aStream.write(aData, aLength);
+            return aStream.good();
+        });
+        if (theResult.isOK() && !aStream.good()) return ArchiveStatus<size_t>(ArchiveErrors::fileWriteError);
+        return theResult;
+    }
+
+    ArchiveStatus<size_t> ArchiveReader::extract(const std::string &aFilename, std::vector<uint8_t> &aBuffer) const {
+        aBuffer.clear();
+        if (const EntryInfo *theEntry = snapshot ? snapshot->entries.find(aFilename) : nullptr)
+            aBuffer.reserve(theEntry->filesize); //one allocation, the size is in the index
+        return extract(aFilename, [&](const char *aData, size_t aLength) {
+            aBuffer.insert(aBuffer.end(), aData, aData + aLength);
+            return true;
+        });
+    }
+
+    ArchiveStatus<size_t> ArchiveReader::readRange(const std::string &aFilename, size_t anOffset, size_t aLength,
+                                                   std::vector<uint8_t> &aBuffer) const {
+        aBuffer.clear();
+        const EntryInfo *theEntry = snapshot ? snapshot->entries.find(aFilename) : nullptr;
+        if (!theEntry) return ArchiveStatus<size_t>(ArchiveErrors::fileNotFound);
+
+        aBuffer.reserve(std::min<size_t>(aLength, theEntry->filesize));
+        ArchiveErrors theResult = Archive::readEntry(*snapshot, cache.get(), *theEntry, anOffset, [&](const char *aData, size_t aCount) {
+            size_t theTake = std::min(aCount, aLength - aBuffer.size());
+            aBuffer.insert(aBuffer.end(), aData, aData + theTake);
+            return aBuffer.size() < aLength; //stop once the range is filled
+        });
+        if (ArchiveErrors::noError != theResult) return ArchiveStatus<size_t>(theResult);
+        return ArchiveStatus<size_t>(aBuffer.size());
+    }
+
+    EntryIndex::Range ArchiveReader::withPrefix(const std::string &aPrefix) const {
+        if (!snapshot) return {};
+        return snapshot->entries.withPrefix(aPrefix);
+    }
 
+    EntryIndex::Range ArchiveReader::range(const std::string &aLow, const std::string &aHigh) const {
+        if (!snapshot) return {};
+        return snapshot->entries.range(aLow, aHigh);
+    }
 
-            //rename or throw error
-            const string old = "compactedFile";
-            const string aNew = "theArcFile";
+    ArchiveStatus<size_t> ArchiveReader::list(std::ostream &outputStream, const std::string &aPrefix) const {
+        size_t fileCount = 0;
+        if (!snapshot) {
+            std::cerr << "Error: Could not open archive file" << std::endl;
+            return ArchiveStatus<size_t>(fileCount);
+        }
 
-            renamefile(old,aNew);
+        outputStream << "###  name                 size          date added\n";
+        outputStream << "---------------------------------------------------------------\n";
 
-            notifyObservers(ActionType::compacted, "", true);
-            return ArchiveStatus<size_t>(compactedSize);
+        //one line per entry straight from the index, nothing is read from the archive
+        for (const EntryInfo &anEntry : withPrefix(aPrefix)) {
+            time_t t_added = anEntry.dateAdded;
+            char date[32] = "\n";
+            ctime_r(&t_added, date); //thread safe, same format as ctime
+            //set size dependent to compression status
+            outputStream << ++fileCount << ".\t " << anEntry.name << "\t  " << anEntry.storedSize() << "\t\t\t" << date;
         }
-        notifyObservers(ActionType::compacted, "", false);
-        return ArchiveStatus<size_t>(compactedSize);
+        return ArchiveStatus<size_t>(fileCount);
+    }
+
+    ArchiveStatus<size_t> ArchiveReader::extractAll(const std::string &aFolder) const {
+        return extractPrefix("", aFolder);
+    }
+
+    ArchiveStatus<size_t> ArchiveReader::extractPrefix(const std::string &aPrefix, const std::string &aFolder) const {
+        size_t theCount = 0;
+        if (!snapshot) return ArchiveStatus<size_t>(ArchiveErrors::fileOpenError);
+
+        for (const EntryInfo &anEntry : withPrefix(aPrefix)) {
+            auto theStatus = extract(anEntry.name, aFolder + "/" + anEntry.name);
+            if (!theStatus.isOK()) return ArchiveStatus<size_t>(theStatus.getError());
+            theCount++;
+        }
+        return ArchiveStatus<size_t>(theCount);
     }
 
     ArchiveStatus<std::string> Archive::getFullPath() const {
-        return ArchiveStatus<string>(thePath);
+        return ArchiveStatus<string>(theArcName);
     }
 
+    //0 when aPath can't be sized (missing, unreadable): callers find out when they open it
     size_t Archive::calculateFileSize(const string & aPath) {
-        size_t filesize = filesystem::file_size(aPath);
-        return filesize;
+        std::error_code theError;
+        size_t filesize = filesystem::file_size(aPath, theError);
+        return theError ? 0 : filesize;
     }
 
     void Archive ::read_to_vec(vector<uint8_t> &vec, fstream &inputFile) {
@@ -445,31 +2024,20 @@ namespace ECE141 {
         }
     }
 
-    void Archive::assign_meta(Chunk &chunk, size_t aPos, const string &aName, size_t compsize) {
-        static uint16_t partNum = 1; // Part 1, 2, 3, ...
-        static size_t thefileSize = kChunkSize; // Min
-        static size_t compressedsize = 0;
-        static string thename;
-
-        if (thename != aName) { // Only needed once for every unique file
-            thename = aName;
-            partNum = 1;
-            thefileSize = closestMultipleOf1024(calculateFileSize(aName));
-            compressedsize = closestMultipleOf1024(compsize); //if 0 just zero
-        }
-
+    void Archive::assign_meta(Chunk &chunk, size_t aPos, const string &aName, uint16_t aPartNum,
+                              size_t aFileSize, size_t compsize) {
         //chunk pos logic
         chunk.meta.occupied = true;
-        chunk.meta.partNum = partNum++;
+        chunk.meta.partNum = aPartNum; // Part 1, 2, 3, ...
         chunk.meta.hashNum = ECE141::Chunk::calc_hash(aName);
 
-        string temp = extractFilename(aName.substr(0, 29)); // Ensure the filename does not exceed 29 characters
+        string temp = extractFilename(aName).substr(0, 29); // Ensure the filename does not exceed 29 characters
         strncpy(chunk.meta.name, temp.c_str(), 29);
         chunk.meta.name[29] = '\0'; // Null-terminate the string
 
-        //file size logic
-        chunk.meta.comp_size = compressedsize ? compressedsize : 0;
-        chunk.meta.filesize = thefileSize ? thefileSize : kChunkSize;
+        //file size logic, real byte counts (blockCount() derives the span)
+        chunk.meta.comp_size = static_cast<uint32_t>(compsize);
+        chunk.meta.filesize = static_cast<uint32_t>(aFileSize);
 
         chunk.meta.nextBlock = static_cast<uint16_t>((aPos + kChunkSize) / kChunkSize);
         //time stamp
@@ -479,13 +2047,54 @@ namespace ECE141 {
         chunk.meta.checkSum = chunk.meta.calc_check_sum(); //checksum for integrity
     }
 
+    std::vector<uint8_t> Archive::encodeFrame(IDataProcessor &aProcessor, const std::vector<uint8_t> &aRaw) {
+        TRACE_SPAN("process");
+        std::vector<uint8_t> theData = aProcessor.process(aRaw);
+        if (theData.empty() && !aRaw.empty()) return theData; //processor failed
+
+        FrameHeader theHeader{static_cast<uint32_t>(aRaw.size()), static_cast<uint32_t>(theData.size())};
+        std::vector<uint8_t> theFrame(sizeof(FrameHeader) + theData.size());
+        memcpy(theFrame.data(), &theHeader, sizeof(FrameHeader));
+        memcpy(theFrame.data() + sizeof(FrameHeader), theData.data(), theData.size());
+        return theFrame;
+    }
+
+    //reverse every complete frame sitting in aPending, leave a partial one for later
+    bool Archive::decodeFrames(IDataProcessor &aProcessor, std::vector<uint8_t> &aPending, const FrameSink &aSink) {
+        size_t theOffset = 0;
+        while (aPending.size() - theOffset >= sizeof(FrameHeader)) {
+            FrameHeader theHeader;
+            memcpy(&theHeader, aPending.data() + theOffset, sizeof(FrameHeader));
+            size_t theEnd = theOffset + sizeof(FrameHeader) + theHeader.storedSize;
+            if (theEnd > aPending.size()) break;
+
+            std::vector<uint8_t> theData(aPending.begin() + theOffset + sizeof(FrameHeader), aPending.begin() + theEnd);
+            {
+                TRACE_SPAN("reverse process");
+                theData = aProcessor.reverseProcess(theData);
+            }
+            if (theData.size() != theHeader.rawSize) return false;
+            size_t theStoredBytes = theEnd - theOffset;
+            theOffset = theEnd;
+            if (!aSink(std::move(theData), theStoredBytes)) break;
+        }
+        aPending.erase(aPending.begin(), aPending.begin() + theOffset);
+        return true;
+    }
+
     //Archive Observer
     //-----------------------------------------------------------------------------------------------------------------
     //visitor pattern here, what observer does with info
     void ArchiveObserver::operator()(ECE141::ActionType anAction, const std::string &aName, bool status) {
     }
 
+    void ArchiveObserver::operator()(ActionType anAction, const std::string &aName, bool status,
+                                     const OperationMetrics &/*aMetrics*/) {
+        (*this)(anAction, aName, status);
+    }
+
     bool Archive::addObserver(std::shared_ptr<ArchiveObserver> anObserver) {
+        std::lock_guard<std::mutex> theGuard(theObserverLock);
         // Check if the observer is already in the list
         auto it = std::find(observers.begin(), observers.end(), anObserver);
         if (it != observers.end()) {
@@ -496,15 +2105,22 @@ namespace ECE141 {
         return true;
     }
 
-    void Archive:: notifyObservers(ActionType action, const string& filename, bool success) {
-        for (const auto& observer : observers) { //call to each observer with functor
-            (*observer)(action, filename, success);
+    void Archive:: notifyObservers(ActionType action, const string& filename, bool success,
+                                   const OperationMetrics &aMetrics) {
+        std::vector<std::shared_ptr<ArchiveObserver>> theObservers;
+        {
+            std::lock_guard<std::mutex> theGuard(theObserverLock); //operations may finish on many threads
+            theObservers = observers;
+        }
+        for (const auto& observer : theObservers) { //call to each observer with functor
+            (*observer)(action, filename, success, aMetrics);
         }
     }
 
     //Compressor
     //-----------------------------------------------------------------------------------------------------------------
     std::vector<uint8_t> Compression::process(const std::vector<uint8_t> &input) {
+        ScopedTimer theTimer(HotCounter::compress);
         std::vector<uint8_t> output;
         output.resize(compressBound(input.size())); // Get the maximum possible size of the compressed data
         uLongf compressedSize = output.size();
@@ -518,6 +2134,7 @@ namespace ECE141 {
     }
 
     std::vector<uint8_t> Compression::reverseProcess(const std::vector<uint8_t> &input) {
+        ScopedTimer theTimer(HotCounter::decompress);
         std::vector<uint8_t> output;
         output.resize(MAX_CHUNK_COUNT*kChunkSize); // Initial guess at the uncompressed size, max is 33 chunks
         uLongf uncompressedSize = output.size();
@@ -15,20 +15,56 @@
 #include <optional>
 #include <stdexcept>
 #include <filesystem>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <shared_mutex>
 #include <zlib.h>
+#include "BlockFile.hpp"
 #include "Chunkers.hpp"
+#include "Delta.hpp"
+#include "EntryIndex.hpp"
+#include "SharedIndex.hpp"
+#include "TableOfContents.hpp"
+#include "FrameCache.hpp"
+#include "Pipeline.hpp"
+#include "Timer.hpp"
 #include "helpers.h"
 
 namespace ECE141 {
 
     constexpr size_t MAX_CHUNK_COUNT = 33; //a top limit based on size of XLarge files
+    constexpr size_t kFrameSize = 32 * kChunkSize; //raw bytes per independently processed frame
+    constexpr size_t kBlocksPerBatch = 32; //blocks handed between add stages at once
+    constexpr size_t kDefaultDeltaChain = 8; //deltas read at most to rebuild a version
 
-    enum class ActionType {added, extracted, removed, listed, dumped, compacted};
+    static_assert(kFrameSize <= MAX_CHUNK_COUNT * kChunkSize, "a frame must fit the reverseProcess buffer");
+
+    enum class ActionType {added, extracted, removed, listed, dumped, compacted, updated, appended, merged};
+    enum class MergePolicy {skip, replace, rename}; //what merge does with a file both archives have
     enum class AccessMode {AsNew, AsExisting}; //you can change values (but not names) of this enum
 
+    //what one operation cost, handed to observers along with its result
+    struct OperationMetrics {
+        size_t bytesIn{0};       //read from the source (add) or from the archive (everything else)
+        size_t bytesOut{0};      //written to the archive (add, compact) or to the caller (extract)
+        size_t blocksRead{0};
+        size_t blocksWritten{0};
+        size_t rawBytes{0};      //entry data before processing...
+        size_t storedBytes{0};   //...and as stored in the archive
+        double wallTime{0.0};    //seconds
+        double ioWait{0.0};      //seconds spent in archive file reads, writes and syncs
+
+        double compressionRatio() const {return storedBytes ? double(rawBytes) / storedBytes : 1.0;}
+    };
+
     //observer pattern
     struct ArchiveObserver {
+       virtual ~ArchiveObserver() = default;
        virtual void operator()(ActionType anAction,const std::string &aName, bool status);
+       //the same event with its metrics; forwards to the call above unless overridden
+       virtual void operator()(ActionType anAction, const std::string &aName, bool status,
+                               const OperationMetrics &aMetrics);
     };
 
     class IDataProcessor {
@@ -46,6 +82,12 @@ namespace ECE141 {
         ~Compression()= default ;
     };
 
+    //processed data is stored as a run of frames, each one reversible on its own
+    struct __attribute__((packed)) FrameHeader {
+        uint32_t rawSize;    //bytes before processing
+        uint32_t storedSize; //bytes that follow this header
+    };
+
     enum class ArchiveErrors {
         noError=0,
         fileNotFound=1, fileExists, fileOpenError, fileReadError, fileWriteError, fileCloseError,
@@ -92,39 +134,167 @@ namespace ECE141 {
         ArchiveErrors error;
     };
 
+    using DataSink = std::function<bool(const char*, size_t)>; //return false to stop the data early
+    using FrameSink = std::function<bool(std::vector<uint8_t>&&, size_t)>; //a decoded frame and the stored bytes it took
+
+    //one published version of the archive: the file its blocks live in plus the entry index.
+    //a snapshot never changes once published, readers pin one and never take a lock
+    struct ArchiveSnapshot {
+        uint64_t                   version{0};
+        std::shared_ptr<BlockFile> file;
+        size_t                     blockCount{0}; //blocks in use when this version was published
+        EntryIndex                 entries;
+    };
+    using SnapshotPtr = std::shared_ptr<const ArchiveSnapshot>;
+
+    //a pinned view of one version; a long scan sees a stable archive while add/remove carry on
+    class ArchiveReader {
+    public:
+        ArchiveStatus<bool>   extract(const std::string &aFilename, const std::string &aFullPath) const;
+        ArchiveStatus<size_t> extract(const std::string &aFilename, const DataSink &aSink) const; //returns bytes handed over
+        ArchiveStatus<size_t> extract(const std::string &aFilename, std::ostream &aStream) const;
+        ArchiveStatus<size_t> extract(const std::string &aFilename, std::vector<uint8_t> &aBuffer) const; //replaces aBuffer's content
+        ArchiveStatus<size_t> readRange(const std::string &aFilename, size_t anOffset, size_t aLength,
+                                        std::vector<uint8_t> &aBuffer) const;
+        ArchiveStatus<size_t> list(std::ostream &aStream, const std::string &aPrefix = "") const;
+        ArchiveStatus<size_t> extractAll(const std::string &aFolder) const; //every entry into aFolder
+        ArchiveStatus<size_t> extractPrefix(const std::string &aPrefix, const std::string &aFolder) const;
+
+        uint64_t getVersion() const {return snapshot ? snapshot->version : 0;}
+        size_t   getCount() const {return snapshot ? snapshot->entries.size() : 0;}
+
+        //entries of the pinned version in name order, streamed straight from the index
+        EntryIndex::const_iterator begin() const {return snapshot ? snapshot->entries.begin() : EntryIndex::const_iterator();}
+        EntryIndex::const_iterator end() const {return snapshot ? snapshot->entries.end() : EntryIndex::const_iterator();}
+        EntryIndex::Range withPrefix(const std::string &aPrefix) const;
+        EntryIndex::Range range(const std::string &aLow, const std::string &aHigh) const; //[aLow, aHigh)
+
+    protected:
+        friend class Archive;
+        ArchiveReader(SnapshotPtr aSnapshot, std::shared_ptr<FrameCache> aCache)
+            : snapshot{std::move(aSnapshot)}, cache{std::move(aCache)} {}
+        SnapshotPtr snapshot;
+        std::shared_ptr<FrameCache> cache; //decoded data shared by every reader of the archive
+    };
+
     //Archive interface
+    //readers (extract, readRange, list, debugDump) work on a pinned snapshot and never block;
+    //writers (add, remove, compact, update) are serialized, also against other processes, and publish
+    //a new snapshot when they commit. the one exception is update rewriting an entry in place, which
+    //only happens while no reader holds any version and holds new readers off until it is done.
+    //observers may be called from many threads at once
     class Archive {
     protected:
         std::vector<std::shared_ptr<IDataProcessor>> processors;
         std::vector<std::shared_ptr<ArchiveObserver>> observers;
 
-        Archive(const std::string &aFullPath, AccessMode aMode);  //protected on purpose
+        Archive(const std::string &aFullPath, AccessMode aMode, const VolumeLayout *aLayout =nullptr,
+                StorageKind aStorage =StorageKind::file);  //protected on purpose
         string thePath;
-        std::fstream theArcFile;
+        string theArcName; //archive file name (with .arc)
+        SnapshotPtr theSnapshot; //latest version, swapped atomically
+        std::vector<std::weak_ptr<const ArchiveSnapshot>> theRetired; //older versions, until their last reader lets go
+        std::shared_mutex theReaderGate; //readers pin under it shared, an in-place update takes it exclusively
+        std::mutex theWriteLock; //writers are serialized in this process...
+        ArchiveLock theFileLock; //...and across processes
+        SharedIndex theCache;    //index shared with other processes using this archive
+        TableOfContents theTOC;  //index persisted next to the archive, read at open instead of scanning
+        std::shared_ptr<FrameCache> theFrameCache{std::make_shared<FrameCache>()};
+        std::mutex theObserverLock;
+        PipelineStats theAddStats; //stage timings of the last add
+        std::atomic<size_t> theMaxDeltaChain{kDefaultDeltaChain};
+        StorageKind theStorage{StorageKind::file}; //memory: private to this object, no lock, shared index or toc
 
+        SnapshotPtr pinSnapshot() const;
+        SnapshotPtr pinForRead();
+        SnapshotPtr currentSnapshot();
+        SnapshotPtr syncSnapshot(bool aCanStore);
+        void publish(std::shared_ptr<ArchiveSnapshot> aNext);
+        void publish(std::shared_ptr<ArchiveSnapshot> aNext, const std::vector<EntryInfo> &aPut,
+                     const std::vector<std::string> &anErased = {});
+        void swapSnapshot(SnapshotPtr aNext);
+        bool isOnlyHolder(const SnapshotPtr &aCurrent);
+        bool isOnlyVersion();
+        bool canGrowInPlace(const ArchiveSnapshot &aCurrent, const EntryInfo &anEntry, size_t aBlocks);
+        static bool copyBlocks(BlockFile &aFile, const EntryInfo &anEntry, size_t aHead);
+        ArchiveStatus<bool> store(const std::string &aFileName, const std::string &aName,
+                                  IDataProcessor* aProcessor, ActionType anAction);
+        ArchiveStatus<bool> store(std::istream &anInput, const std::string &aName,
+                                  IDataProcessor* aProcessor, ActionType anAction, size_t aSizeHint);
+        ArchiveStatus<size_t> rewriteInPlace(const SnapshotPtr &aCurrent, const EntryInfo &anEntry,
+                                             std::istream &anInput, IDataProcessor* aProcessor);
+        std::shared_ptr<ArchiveSnapshot> loadIndex(const std::shared_ptr<BlockFile> &aFile, bool aCanStore);
+        static std::shared_ptr<ArchiveSnapshot> loadSnapshot(const std::shared_ptr<BlockFile> &aFile);
+        static void scanHeads(const BlockFile &aFile, const std::function<bool(size_t, const ChunkHeader&)> &aVisitor);
+        static ArchiveErrors readEntry(const ArchiveSnapshot &aSnapshot, FrameCache *aCache, const EntryInfo &anEntry,
+                                       size_t anOffset, const DataSink &aSink);
+        static bool releaseBlocks(BlockFile &aFile, const EntryInfo &anEntry);
+        static ArchiveErrors readSparse(const ArchiveSnapshot &aSnapshot, FrameCache *aCache, const EntryInfo &anEntry,
+                                        size_t anOffset, const DataSink &aSink);
+        static ArchiveErrors readDelta(const ArchiveSnapshot &aSnapshot, FrameCache *aCache, const EntryInfo &anEntry,
+                                       size_t anOffset, const DataSink &aSink);
+        static ArchiveErrors loadDelta(const ArchiveSnapshot &aSnapshot, FrameCache *aCache, const EntryInfo &anEntry,
+                                       std::vector<uint8_t> &aDelta, DeltaHeader &aHeader);
+        ArchiveStatus<size_t> measureExtract(const std::string &aFilename,
+                                             const std::function<ArchiveStatus<size_t>(const ArchiveReader&)> &anExtract);
+        static const EntryInfo* dependentOf(const ArchiveSnapshot &aSnapshot, const std::string &aName);
 
+        friend class ArchiveReader;
 
     public:
         ~Archive();
 
         static ArchiveStatus<std::shared_ptr<Archive>> createArchive(const std::string &anArchiveName);
+        static ArchiveStatus<std::shared_ptr<Archive>> createArchive(const std::string &anArchiveName, const VolumeLayout &aLayout);
+        static ArchiveStatus<std::shared_ptr<Archive>> createArchive(const std::string &anArchiveName, StorageKind aStorage);
         static ArchiveStatus<std::shared_ptr<Archive>> openArchive(const std::string &anArchiveName);
+        static ArchiveStatus<std::shared_ptr<Archive>> openArchive(const std::string &anArchiveName, StorageKind aStorage); //memory: a private copy
 
         bool addObserver(std::shared_ptr<ArchiveObserver> anObserver);
 
         ArchiveStatus<bool>      add(const std::string &aFilename, IDataProcessor* aProcessor =nullptr);//add file to archive
+        ArchiveStatus<bool>      add(const std::string &aName, std::istream &anInput, IDataProcessor* aProcessor =nullptr);//read anInput to its end, length needn't be known
+        ArchiveStatus<bool>      addFd(const std::string &aName, int aFd, IDataProcessor* aProcessor =nullptr);//same from a descriptor (pipe, socket)
         ArchiveStatus<bool>      extract(const std::string &aFilename, const std::string &aFullPath);//Extracting a copy of a file from the archive
+        ArchiveStatus<size_t>    extract(const std::string &aFilename, const DataSink &aSink);//hand the content to aSink a piece at a time, returns bytes
+        ArchiveStatus<size_t>    extract(const std::string &aFilename, std::ostream &aStream);//write the content to aStream
+        ArchiveStatus<size_t>    extract(const std::string &aFilename, std::vector<uint8_t> &aBuffer);//the whole content in memory
         ArchiveStatus<bool>      remove(const std::string &aFilename);//Removing a file from the archive (permanently)
+        ArchiveStatus<size_t>    update(const std::string &aName, const std::string &aNewPath,
+                                        IDataProcessor* aProcessor =nullptr);//replace an entry's content, returns blocks written
+        ArchiveStatus<size_t>    append(const std::string &aName, const std::vector<uint8_t> &aData);//add to the end of an entry, returns its new size
+        ArchiveStatus<size_t>    addVersion(const std::string &aFilename);//next version of an entry, stored as a delta; returns its number
+        ArchiveStatus<size_t>    merge(Archive &anOther, MergePolicy aPolicy =MergePolicy::skip);//copy anOther's entries in (its current version, pinned as a reader would), returns how many
+        void                     setMaxDeltaChain(size_t aLength) {theMaxDeltaChain = aLength;} //0 stores every version in full
+        ArchiveStatus<size_t>    readRange(const std::string &aFilename, size_t anOffset, size_t aLength,
+                                           std::vector<uint8_t> &aBuffer);//copy part of a file, returns bytes read
+        ArchiveStatus<size_t>    extractAll(const std::string &aFolder);//extract every file into aFolder
+        ArchiveStatus<size_t>    extractPrefix(const std::string &aPrefix, const std::string &aFolder);//every name starting with aPrefix
+
+        ArchiveReader            openReader();//pin the current version for a series of reads
 
-        ArchiveStatus<size_t>    list(std::ostream &aStream);//Listing the names of all files in the archive
+        ArchiveStatus<size_t>    list(std::ostream &aStream, const std::string &aPrefix = "");//Listing the names of all files in the archive (or those starting with aPrefix)
         ArchiveStatus<size_t>    debugDump(std::ostream &aStream);//Performing a diagnostic "dump" of all the blocks in the file
 
         ArchiveStatus<size_t>    compact();
         ArchiveStatus<std::string> getFullPath() const; //get archive path (including .arc extension)
+        const PipelineStats&     getAddStats() const {return theAddStats;}
+
+        //decoded frames (and runs of raw blocks) of recently read entries, shared by all readers
+        void                     setCacheBudget(size_t aBytes) {theFrameCache->setBudget(aBytes);}
+        FrameCache::Stats        getCacheStats() const {return theFrameCache->getStats();}
+
+        //time spent in checksum, hash, codec and file I/O, summed over every thread in the process
+        static HotCounterValues  getHotCounters() {return HotCounters::read();}
+        static void              resetHotCounters() {HotCounters::reset();}
 
         //notify observer of any change
-        void notifyObservers(ActionType action, const std::string& filename, bool success);
-        static void assign_meta(Chunk &chunk, size_t aPos,const string &aName,size_t compsize = 0);
+        void notifyObservers(ActionType action, const std::string& filename, bool success,
+                             const OperationMetrics &aMetrics = OperationMetrics());
+        static void assign_meta(Chunk &chunk, size_t aPos, const string &aName, uint16_t aPartNum,
+                                size_t aFileSize, size_t compsize = 0);
+        static std::vector<uint8_t> encodeFrame(IDataProcessor &aProcessor, const std::vector<uint8_t> &aRaw);
+        static bool decodeFrames(IDataProcessor &aProcessor, std::vector<uint8_t> &aPending, const FrameSink &aSink);
         static size_t calculateFileSize(const string& aPath);
         static void read_to_vec(vector<uint8_t> &aVec, fstream &aFile); //reads stream data into vector
         static void writeToFile(const std::vector<uint8_t>& vec, std::fstream& file);
@@ -0,0 +1,188 @@
+//
+//  Benchmarking.hpp
+//
+//  micro-benchmarks for every Archive operation, reported as JSON
+//
+
+#ifndef Benchmarking_h
+#define Benchmarking_h
+
+#include "Archive.hpp"
+#include "Timer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <filesystem>
+#include <ostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ECE141 {
+
+    //one measured operation, one JSON object in the report
+    struct BenchResult {
+        std::string op;
+        size_t      size{0};        //bytes in the file being worked on
+        bool        compressed{false};
+        size_t      fill{0};        //entries already in the archive
+        size_t      bytes{0};       //bytes moved per op (0 when throughput makes no sense)
+        std::vector<double> samples{}; //seconds per op
+
+        double total() const {
+            double theTotal = 0.0;
+            for (auto theSample : samples) theTotal += theSample;
+            return theTotal;
+        }
+
+        double percentile(double aFraction) const {
+            if (samples.empty()) return 0.0;
+            std::vector<double> theSorted(samples);
+            std::sort(theSorted.begin(), theSorted.end());
+            size_t theIndex = static_cast<size_t>(aFraction * (theSorted.size() - 1) + 0.5);
+            return theSorted[theIndex];
+        }
+
+        void toJSON(std::ostream &aStream) const {
+            double theTotal = total();
+            aStream << "{\"op\": \"" << op << "\", \"size\": " << size
+                    << ", \"compressed\": " << (compressed ? "true" : "false")
+                    << ", \"fill\": " << fill << ", \"iterations\": " << samples.size()
+                    << ", \"ops_per_sec\": " << (theTotal > 0 ? samples.size() / theTotal : 0.0)
+                    << ", \"mb_per_sec\": ";
+            if (bytes && theTotal > 0) aStream << (bytes * samples.size()) / theTotal / (1024.0 * 1024.0);
+            else aStream << "null";
+            aStream << ", \"p50_ms\": " << percentile(0.50) * 1000.0
+                    << ", \"p99_ms\": " << percentile(0.99) * 1000.0 << "}";
+        }
+    };
+
+    struct Benchmarking {
+
+        std::string         folder;
+        std::vector<size_t> sizes{1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 256 * 1024 * 1024, 1024 * 1024 * 1024};
+        std::vector<size_t> fills{0, 1000};
+        size_t              iterations{20};            //per op, fewer for big files (see countFor)
+        size_t              bytesPerOp{256 * 1024 * 1024}; //rough cap on data moved per measured op
+        StorageKind         storage{StorageKind::file};    //memory takes the disk out of the numbers
+        std::vector<BenchResult> results;
+
+        explicit Benchmarking(const std::string &aFolder) : folder(aFolder) {}
+
+        //text from a small vocabulary, compresses roughly like the test files
+        void makeFile(const std::string &aFullPath, size_t aSize) {
+            static const char* theWords[] = {"class", "happy", "coding", "pattern", "design", "method",
+                                             "dyad", "story", "monad", "data", "compile", "debug"};
+            std::string theBlock;
+            while (theBlock.size() < 1024 * 1024) {
+                theBlock += theWords[rand() % 12];
+                theBlock += (rand() % 10) ? ", " : "\n";
+            }
+            std::ofstream theFile(aFullPath, std::ios::binary | std::ios::trunc);
+            for (size_t theLeft = aSize; theLeft;) {
+                size_t theCount = std::min(theLeft, theBlock.size());
+                theFile.write(theBlock.data(), theCount);
+                theLeft -= theCount;
+            }
+        }
+
+        size_t countFor(size_t aSize) const {
+            return std::max<size_t>(1, std::min(iterations, bytesPerOp / aSize));
+        }
+
+        //archive with aFill small entries already in it
+        std::shared_ptr<Archive> makeArchive(const std::string &aName, size_t aFill) {
+            auto theArchive = Archive::createArchive(folder + "/" + aName, storage).getValue();
+            std::string theFiller(folder + "/bench_filler.txt");
+            makeFile(theFiller, 4096);
+            for (size_t i = 0; i < aFill; i++) {
+                std::string theName(folder + "/fill" + std::to_string(i) + ".txt");
+                std::filesystem::copy_file(theFiller, theName, std::filesystem::copy_options::overwrite_existing);
+                theArchive->add(theName);
+                std::remove(theName.c_str());
+            }
+            return theArchive;
+        }
+
+        template<typename Setup, typename Op>
+        BenchResult measure(const std::string &anOp, size_t aSize, bool aCompressed, size_t aFill,
+                            size_t aBytes, size_t aCount, Setup aSetup, Op anOperation) {
+            BenchResult theResult{anOp, aSize, aCompressed, aFill, aBytes};
+            Timer theTimer;
+            for (size_t i = 0; i < aCount; i++) {
+                aSetup();
+                theTimer.start();
+                anOperation();
+                theTimer.stop();
+                theResult.samples.push_back(theTimer.elapsed());
+            }
+            return theResult;
+        }
+
+        void runSize(size_t aSize, bool aCompressed, size_t aFill) {
+            std::string theName("bench" + std::to_string(aSize) + ".dat");
+            std::string theSource(folder + "/" + theName);
+            std::string theOut(folder + "/bench_out.dat");
+            makeFile(theSource, aSize);
+
+            auto theArchive = makeArchive("bench", aFill);
+            Compression theCompression;
+            IDataProcessor *theProcessor = aCompressed ? &theCompression : nullptr;
+            std::ofstream theNull; //unopened stream swallows list/dump output
+            size_t theCount = countFor(aSize);
+            auto noSetup = [](){};
+
+            //adding the same name again replaces the entry, so every add does the full work
+            results.push_back(measure("add", aSize, aCompressed, aFill, aSize, theCount, noSetup,
+                                      [&]() { theArchive->add(theSource, theProcessor); }));
+            results.push_back(measure("extract", aSize, aCompressed, aFill, aSize, theCount, noSetup,
+                                      [&]() { theArchive->extract(theName, theOut); }));
+            results.push_back(measure("list", aSize, aCompressed, aFill, 0, iterations, noSetup,
+                                      [&]() { theArchive->list(theNull); }));
+            results.push_back(measure("debugDump", aSize, aCompressed, aFill, 0, std::min<size_t>(iterations, 5), noSetup,
+                                      [&]() { theArchive->debugDump(theNull); }));
+            results.push_back(measure("remove", aSize, aCompressed, aFill, 0, theCount,
+                                      [&]() { theArchive->add(theSource, theProcessor); },
+                                      [&]() { theArchive->remove(theName); }));
+
+            //each compact has the freed blocks of one removed copy to squeeze out
+            size_t theArcSize = 0;
+            results.push_back(measure("compact", aSize, aCompressed, aFill, 0, std::min<size_t>(theCount, 5),
+                                      [&]() {
+                                          theArchive->add(theSource, theProcessor);
+                                          theArchive->remove(theName);
+                                      },
+                                      [&]() { theArcSize = theArchive->compact().getValue() * kChunkSize; }));
+            results.back().bytes = theArcSize;
+
+            std::remove(theSource.c_str());
+            std::remove(theOut.c_str());
+        }
+
+        void run(std::ostream &aProgress) {
+            for (auto theSize : sizes) {
+                for (bool isCompressed : {false, true}) {
+                    for (auto theFill : fills) {
+                        aProgress << "size " << theSize << (isCompressed ? " compressed" : "")
+                                  << " fill " << theFill << "\n";
+                        runSize(theSize, isCompressed, theFill);
+                    }
+                }
+            }
+        }
+
+        void report(std::ostream &aStream) const {
+            aStream << "{\"benchmark\": \"archive_bench\", \"chunk_size\": " << kChunkSize << ", \"results\": [\n";
+            const char *thePrefix = "  ";
+            for (auto &theResult : results) {
+                aStream << thePrefix;
+                theResult.toJSON(aStream);
+                thePrefix = ",\n  ";
+            }
+            aStream << "\n]}\n";
+        }
+    };
+
+}
+
+#endif /* Benchmarking_h */
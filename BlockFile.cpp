@@ -0,0 +1,343 @@
+//
+//  BlockFile.cpp
+//
+
+#include "BlockFile.hpp"
+#include "Trace.hpp"
+#include "Timer.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <vector>
+
+namespace ECE141 {
+
+    constexpr size_t kCopyBufferSize = 256 * 1024; //per pread/pwrite when copy_file_range can't be used
+    constexpr const char* kManifestTag = "ECE141 volumes";
+    constexpr size_t kMaxManifest = 64 * 1024;
+
+    BlockFile::~BlockFile() {
+        close();
+    }
+
+    bool BlockFile::open(const std::string &aPath, bool aTruncate) {
+        close();
+        int theFlags = O_RDWR;
+        if (aTruncate) theFlags |= O_CREAT | O_TRUNC;
+        auto theFile = std::make_unique<FileStorage>();
+        if (!theFile->open(aPath, theFlags)) return false;
+        storage = std::move(theFile);
+        return aTruncate || loadManifest();
+    }
+
+    bool BlockFile::attach(std::unique_ptr<Storage> aStorage) {
+        close();
+        storage = std::move(aStorage);
+        return isOpen();
+    }
+
+    std::string VolumeLayout::volumePath(const std::string &anArchive, size_t anIndex) const {
+        return folders[anIndex] + "/" + std::filesystem::path(anArchive).filename().string() + "." +
+               std::to_string(generation) + "." + std::to_string(anIndex) + ".vol";
+    }
+
+    //empty volumes first, then the manifest naming them, so a manifest never points at a missing volume
+    bool BlockFile::create(const std::string &aPath, const VolumeLayout &aLayout, const std::string &aVolumeName) {
+        close();
+        if (aLayout.folders.empty() || !aLayout.stripeBlocks) return false;
+        layout = aLayout;
+        std::ostringstream theManifest;
+        theManifest << kManifestTag << "\ngeneration " << layout.generation << "\nstripe " << layout.stripeBlocks
+                    << "\nlimit " << layout.volumeLimit << "\n";
+        for (size_t i = 0; i < layout.folders.size(); ++i) {
+            layout.folders[i] = std::filesystem::absolute(layout.folders[i]).string();
+            volumePaths.push_back(layout.volumePath(aVolumeName, i));
+            auto theVolume = std::make_unique<FileStorage>();
+            if (!theVolume->open(volumePaths.back(), O_RDWR | O_CREAT | O_TRUNC)) {
+                close();
+                return false;
+            }
+            volumes.push_back(std::move(theVolume));
+            theManifest << "volume " << volumePaths.back() << "\n";
+        }
+        const std::string theText = theManifest.str();
+        auto theFile = std::make_unique<FileStorage>();
+        if (!theFile->open(aPath, O_RDWR | O_CREAT | O_TRUNC) ||
+            theFile->write(0, theText.data(), theText.size()) != static_cast<ssize_t>(theText.size())) {
+            close();
+            return false;
+        }
+        storage = std::move(theFile);
+        return true;
+    }
+
+    //a plain archive starts with a block header, whose first byte is never 'E'
+    bool BlockFile::loadManifest() {
+        const size_t theTag = strlen(kManifestTag);
+        std::vector<char> theText(kMaxManifest);
+        ssize_t theCount = storage->read(0, theText.data(), theText.size());
+        if (theCount < static_cast<ssize_t>(theTag) || memcmp(theText.data(), kManifestTag, theTag)) return true;
+
+        std::istringstream theManifest(std::string(theText.data(), theCount));
+        std::string theLine;
+        bool isMissing = false;
+        while (!isMissing && std::getline(theManifest, theLine)) {
+            const size_t theSpace = theLine.find(' ');
+            const std::string theKey = theLine.substr(0, theSpace);
+            const std::string theValue = std::string::npos == theSpace ? "" : theLine.substr(theSpace + 1);
+            if ("generation" == theKey) layout.generation = static_cast<uint32_t>(std::stoul(theValue));
+            else if ("stripe" == theKey) layout.stripeBlocks = std::stoul(theValue);
+            else if ("limit" == theKey) layout.volumeLimit = std::stoul(theValue);
+            else if ("volume" == theKey) {
+                volumePaths.push_back(theValue);
+                layout.folders.push_back(std::filesystem::path(theValue).parent_path().string());
+                auto theVolume = std::make_unique<FileStorage>();
+                isMissing = !theVolume->open(theValue, O_RDWR);
+                volumes.push_back(std::move(theVolume));
+            }
+        }
+        if (volumes.empty() || isMissing || !layout.stripeBlocks) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t BlockFile::nextInstance() {
+        static std::atomic<uint64_t> theNext{1};
+        return theNext.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void BlockFile::close() {
+        instance = nextInstance(); //whatever opens next is another file to the frame cache
+        storage.reset();
+        volumes.clear();
+        volumePaths.clear();
+        layout = VolumeLayout();
+    }
+
+    void BlockFile::removeVolumes() {
+        for (auto &thePath : volumePaths) ::unlink(thePath.c_str());
+    }
+
+    //the volume and offset in it where anOffset lives, and how many of aLength bytes follow it there
+    size_t BlockFile::locate(size_t anOffset, size_t aLength, Storage *&aStorage, size_t &aPosition) const {
+        if (volumes.empty()) {
+            aStorage = storage.get();
+            aPosition = anOffset;
+            return aLength;
+        }
+        const size_t theStripe = layout.stripeBlocks * kChunkSize;
+        const size_t theIndex = anOffset / theStripe, theInside = anOffset % theStripe;
+        aStorage = volumes[theIndex % volumes.size()].get();
+        aPosition = theIndex / volumes.size() * theStripe + theInside;
+        return std::min(aLength, theStripe - theInside);
+    }
+
+    IOStats& BlockFile::threadStats() {
+        static thread_local IOStats theStats;
+        return theStats;
+    }
+
+    //blocks spanned by [anOffset, anOffset + aLength)
+    static size_t blocksSpanned(size_t anOffset, size_t aLength) {
+        return aLength ? (anOffset + aLength - 1) / kChunkSize - anOffset / kChunkSize + 1 : 0;
+    }
+
+    bool BlockFile::readAt(size_t anOffset, void *aBuffer, size_t aLength) const {
+        TRACE_SPAN("pread");
+        IOStats &theStats = threadStats();
+        theStats.blocksRead += blocksSpanned(anOffset, aLength);
+        uint64_t theStart = readTicks();
+
+        auto *theBuffer = static_cast<char*>(aBuffer);
+        bool theResult = isOpen();
+        while (aLength && theResult) { //pread may come back short, keep going
+            Storage *theStorage;
+            size_t thePosition;
+            const size_t thePiece = locate(anOffset, aLength, theStorage, thePosition);
+            ssize_t theCount = theStorage->read(thePosition, theBuffer, thePiece);
+            if (theCount < 0 && EINTR == errno) continue;
+            if (theCount <= 0) { theResult = false; break; }
+            theBuffer += theCount;
+            anOffset += theCount;
+            aLength -= theCount;
+            theStats.bytesRead += theCount;
+        }
+        uint64_t theTicks = readTicks() - theStart;
+        HotCounters::add(HotCounter::fileRead, theTicks);
+        theStats.seconds += theTicks * nanosPerTick() * 1e-9;
+        return theResult;
+    }
+
+    bool BlockFile::writeAt(size_t anOffset, const void *aBuffer, size_t aLength) {
+        TRACE_SPAN("pwrite");
+        IOStats &theStats = threadStats();
+        theStats.blocksWritten += blocksSpanned(anOffset, aLength);
+        uint64_t theStart = readTicks();
+
+        auto *theBuffer = static_cast<const char*>(aBuffer);
+        bool theResult = isOpen();
+        while (aLength && theResult) {
+            Storage *theStorage;
+            size_t thePosition;
+            const size_t thePiece = locate(anOffset, aLength, theStorage, thePosition);
+            if (layout.volumeLimit && thePosition + thePiece > layout.volumeLimit) { theResult = false; break; } //volume full
+            ssize_t theCount = theStorage->write(thePosition, theBuffer, thePiece);
+            if (theCount < 0 && EINTR == errno) continue;
+            if (theCount <= 0) { theResult = false; break; }
+            theBuffer += theCount;
+            anOffset += theCount;
+            aLength -= theCount;
+            theStats.bytesWritten += theCount;
+        }
+        uint64_t theTicks = readTicks() - theStart;
+        HotCounters::add(HotCounter::fileWrite, theTicks);
+        theStats.seconds += theTicks * nanosPerTick() * 1e-9;
+        return theResult;
+    }
+
+    //copy_file_range moves the bytes without a trip through user space (and shares the extents on
+    //filesystems that can); across filesystems, for memory or where it isn't supported it falls back to pread/pwrite
+    bool BlockFile::copyFrom(const BlockFile &aSource, size_t aSourceOffset, size_t anOffset, size_t aLength) {
+        TRACE_SPAN("copy_file_range");
+        IOStats &theStats = threadStats();
+        uint64_t theStart = readTicks();
+        const size_t theLength = aLength;
+        off_t theIn = static_cast<off_t>(aSourceOffset), theOut = static_cast<off_t>(anOffset);
+        const int theSource = aSource.isOpen() ? aSource.storage->descriptor() : -1;
+        const int theTarget = isOpen() ? storage->descriptor() : -1;
+        while (aLength && !isStriped() && !aSource.isStriped() && theSource >= 0 && theTarget >= 0) {
+            ssize_t theCount = ::copy_file_range(theSource, &theIn, theTarget, &theOut, aLength, 0);
+            if (theCount < 0 && EINTR == errno) continue;
+            if (theCount <= 0) break;
+            aLength -= theCount;
+        }
+        const size_t theCopied = theLength - aLength;
+        theStats.bytesRead += theCopied;
+        theStats.bytesWritten += theCopied;
+        theStats.blocksRead += blocksSpanned(aSourceOffset, theCopied);
+        theStats.blocksWritten += blocksSpanned(anOffset, theCopied);
+        uint64_t theTicks = readTicks() - theStart;
+        HotCounters::add(HotCounter::fileWrite, theTicks);
+        theStats.seconds += theTicks * nanosPerTick() * 1e-9;
+
+        std::vector<char> theBuffer(aLength ? std::min<size_t>(aLength, kCopyBufferSize) : 0);
+        for (size_t theDone = theCopied; aLength;) {
+            const size_t theCount = std::min(aLength, theBuffer.size());
+            if (!aSource.readAt(aSourceOffset + theDone, theBuffer.data(), theCount) ||
+                !writeAt(anOffset + theDone, theBuffer.data(), theCount))
+                return false;
+            theDone += theCount;
+            aLength -= theCount;
+        }
+        return true;
+    }
+
+    //a hint only, nothing to report when it's ignored. a range of a striped file goes to each volume
+    //piece by piece; whole-file hints (sequential scans) go to every volume as they are
+    void BlockFile::advise(size_t anOffset, size_t aLength, AccessHint aHint) const {
+        TRACE_SPAN("fadvise");
+        if (!isOpen()) return;
+        if (!aLength) {
+            storage->advise(0, 0, aHint);
+            for (auto &theVolume : volumes) theVolume->advise(0, 0, aHint);
+            return;
+        }
+        while (aLength) {
+            Storage *theStorage;
+            size_t thePosition;
+            const size_t thePiece = locate(anOffset, aLength, theStorage, thePosition);
+            theStorage->advise(thePosition, thePiece, aHint);
+            anOffset += thePiece;
+            aLength -= thePiece;
+        }
+    }
+
+    size_t BlockFile::size() const {
+        if (volumes.empty()) return isOpen() ? storage->size() : 0;
+
+        //the end of the last stripe any volume holds
+        const size_t theStripe = layout.stripeBlocks * kChunkSize;
+        size_t theSize = 0;
+        for (size_t v = 0; v < volumes.size(); ++v) {
+            const size_t theLength = volumes[v]->size();
+            if (!theLength) continue;
+            const size_t theRow = (theLength - 1) / theStripe;
+            theSize = std::max(theSize, (theRow * volumes.size() + v) * theStripe + theLength - theRow * theStripe);
+        }
+        return theSize;
+    }
+
+    uint64_t BlockFile::fileId() const {
+        return isOpen() ? storage->id() : 0;
+    }
+
+    void BlockFile::stamp(uint64_t &aDevice, int64_t &aModified) const {
+        aDevice = 0;
+        aModified = 0;
+        struct stat theStat{};
+        if (!isOpen() || storage->descriptor() < 0 || ::fstat(storage->descriptor(), &theStat)) return;
+        aDevice = static_cast<uint64_t>(theStat.st_dev);
+        aModified = theStat.st_mtim.tv_sec * 1000000000LL + theStat.st_mtim.tv_nsec;
+        for (auto &theVolume : volumes) { //blocks are written to the volumes, not the manifest
+            if (theVolume->descriptor() >= 0 && !::fstat(theVolume->descriptor(), &theStat))
+                aModified = std::max<int64_t>(aModified, theStat.st_mtim.tv_sec * 1000000000LL + theStat.st_mtim.tv_nsec);
+        }
+    }
+
+    uint64_t BlockFile::pathId(const std::string &aPath) {
+        struct stat theStat{};
+        if (::stat(aPath.c_str(), &theStat)) return 0;
+        return static_cast<uint64_t>(theStat.st_ino);
+    }
+
+    bool BlockFile::sync() {
+        TRACE_SPAN("fdatasync");
+        uint64_t theStart = readTicks();
+        bool theResult = isOpen() && storage->sync();
+        for (auto &theVolume : volumes) theResult = theVolume->sync() && theResult;
+        uint64_t theTicks = readTicks() - theStart;
+        HotCounters::add(HotCounter::fileSync, theTicks);
+        threadStats().seconds += theTicks * nanosPerTick() * 1e-9;
+        return theResult;
+    }
+
+    bool BlockFile::truncate(size_t aSize) {
+        if (volumes.empty()) return isOpen() && storage->truncate(aSize);
+
+        //whole stripes each volume keeps, plus the part of the one aSize ends in
+        const size_t theStripe = layout.stripeBlocks * kChunkSize;
+        const size_t theFull = aSize / theStripe, theLast = theFull % volumes.size();
+        bool theResult = true;
+        for (size_t v = 0; v < volumes.size(); ++v) {
+            size_t theLength = (theFull / volumes.size() + (v < theLast ? 1 : 0)) * theStripe;
+            if (v == theLast) theLength += aSize % theStripe;
+            theResult = volumes[v]->truncate(theLength) && theResult;
+        }
+        return theResult;
+    }
+
+    bool BlockFile::readBlock(size_t anIndex, Chunk &aChunk) const {
+        return readAt(anIndex * kChunkSize, &aChunk, kChunkSize);
+    }
+
+    bool BlockFile::readHeader(size_t anIndex, ChunkHeader &aHeader) const {
+        return readAt(anIndex * kChunkSize, &aHeader, sizeof(ChunkHeader));
+    }
+
+    bool BlockFile::writeBlock(size_t anIndex, const Chunk &aChunk) {
+        return writeAt(anIndex * kChunkSize, &aChunk, kChunkSize);
+    }
+
+    bool BlockFile::writeHeader(size_t anIndex, const ChunkHeader &aHeader) {
+        return writeAt(anIndex * kChunkSize, &aHeader, sizeof(ChunkHeader));
+    }
+
+}
@@ -0,0 +1,109 @@
+//
+//  BlockFile.hpp
+//
+//  positional access to the archive's storage (a file, its volumes, or memory), no shared cursor
+//
+
+#ifndef BlockFile_hpp
+#define BlockFile_hpp
+
+#include <string>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "Chunkers.hpp"
+#include "Storage.hpp"
+
+namespace ECE141 {
+
+    //running totals of the I/O one thread did through any BlockFile; an operation
+    //diffs them before and after to find what it cost
+    struct IOStats {
+        size_t bytesRead{0}, bytesWritten{0};
+        size_t blocksRead{0}, blocksWritten{0}; //blocks touched, a header counts as its block
+        double seconds{0.0};                    //time spent inside pread/pwrite
+
+        IOStats operator-(const IOStats &anOther) const {
+            return {bytesRead - anOther.bytesRead, bytesWritten - anOther.bytesWritten,
+                    blocksRead - anOther.blocksRead, blocksWritten - anOther.blocksWritten,
+                    seconds - anOther.seconds};
+        }
+        IOStats& operator+=(const IOStats &anOther) {
+            bytesRead += anOther.bytesRead;
+            bytesWritten += anOther.bytesWritten;
+            blocksRead += anOther.blocksRead;
+            blocksWritten += anOther.blocksWritten;
+            seconds += anOther.seconds;
+            return *this;
+        }
+    };
+
+    constexpr size_t kDefaultStripeBlocks = 32;
+
+    //a multi-volume archive: the .arc file holds a manifest and the blocks are striped across one
+    //volume file per folder, stripeBlocks at a time, so each volume can sit on its own disk
+    struct VolumeLayout {
+        std::vector<std::string> folders;
+        size_t   stripeBlocks{kDefaultStripeBlocks};
+        size_t   volumeLimit{0}; //bytes a volume may grow to, 0 for no limit
+        uint32_t generation{0};  //compact writes the next one, so old volumes stay readable until it commits
+
+        std::string volumePath(const std::string &anArchive, size_t anIndex) const;
+    };
+
+    //every call names its own offset, so any number of threads can read at once.
+    //a striped file splits each call at stripe boundaries and goes to each volume directly
+    class BlockFile {
+    public:
+        BlockFile() = default;
+        ~BlockFile();
+
+        BlockFile(const BlockFile&) = delete;
+        BlockFile& operator=(const BlockFile&) = delete;
+
+        bool     open(const std::string &aPath, bool aTruncate); //follows a volume manifest
+        bool     create(const std::string &aPath, const VolumeLayout &aLayout, const std::string &aVolumeName);
+        bool     attach(std::unique_ptr<Storage> aStorage); //blocks kept somewhere other than a file of their own
+        void     close();
+        bool     isOpen() const {return storage != nullptr;}
+        bool     isStriped() const {return !volumes.empty();}
+        const VolumeLayout& getLayout() const {return layout;}
+        void     removeVolumes(); //unlink the volume files, open descriptors keep them readable
+
+        bool     readAt(size_t anOffset, void *aBuffer, size_t aLength) const;
+        bool     writeAt(size_t anOffset, const void *aBuffer, size_t aLength);
+        bool     copyFrom(const BlockFile &aSource, size_t aSourceOffset, size_t anOffset, size_t aLength); //in the kernel when it can
+        void     advise(size_t anOffset, size_t aLength, AccessHint aHint) const; //aLength 0: the whole file
+        size_t   size() const;
+        uint64_t fileId() const; //inode, changes when the file is replaced (compact)
+        uint64_t cacheId() const {return instance;} //never reused in this process (an inode is), names it to caches
+        static uint64_t pathId(const std::string &aPath); //inode the path names right now
+        void     stamp(uint64_t &aDevice, int64_t &aModified) const; //st_dev, and the latest st_mtime (ns) of the file or a volume
+        bool     sync();
+        bool     truncate(size_t aSize);
+
+        //block helpers, anIndex counts kChunkSize blocks
+        bool     readBlock(size_t anIndex, Chunk &aChunk) const;
+        bool     readHeader(size_t anIndex, ChunkHeader &aHeader) const;
+        bool     writeBlock(size_t anIndex, const Chunk &aChunk);
+        bool     writeHeader(size_t anIndex, const ChunkHeader &aHeader);
+        size_t   blockCount() const {return size() / kChunkSize;}
+
+        static IOStats& threadStats(); //this thread's totals
+
+    protected:
+        bool     loadManifest();
+        size_t   locate(size_t anOffset, size_t aLength, Storage *&aStorage, size_t &aPosition) const;
+
+        std::unique_ptr<Storage> storage;               //the archive, or its manifest when striped
+        std::vector<std::unique_ptr<Storage>> volumes;  //striped volumes, none for a plain file
+        std::vector<std::string> volumePaths;
+        VolumeLayout layout;
+        uint64_t instance{nextInstance()}; //a new one each time the object is closed or reopened
+
+        static uint64_t nextInstance();
+    };
+
+}
+
+#endif /* BlockFile_hpp */
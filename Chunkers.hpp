@@ -15,6 +15,7 @@
 #include <array>
 #include <utility>
 #include <cstdint>
+#include <vector>
 #include "Debug.h"
 
 using namespace std;
@@ -27,6 +28,11 @@ namespace ECE141 {
 
     // '''''''''''''''''''''''''''''''''''''''--------Chunks
 
+    //bits of ChunkHeader::occupied
+    constexpr uint8_t kBlockUsed = 0x01;
+    constexpr uint8_t kBlockDelta = 0x02; //head of an entry stored as a delta against its previous version
+    constexpr uint8_t kBlockSparse = 0x04; //head of an entry whose all-zero segments were left out, a map follows its data
+
     //pack so that spacing is ideal for inc.
     struct __attribute__((packed)) ChunkHeader {
         ChunkHeader():occupied{false},partNum{0},nextBlock{0},checkSum{0},hashNum{0},filesize{0},dateAdded{0},comp_size{0}{
@@ -35,7 +41,7 @@ namespace ECE141 {
 
         ~ChunkHeader()=default;
 
-        uint8_t occupied = false;    // 1 byte, used or not
+        uint8_t occupied = false;    // 1 byte, used or not (kBlock bits)
         uint16_t hashNum;    // 2 bytes, reference number to refer to block instead of filename
         char name[maxFileName];
         time_t dateAdded;
@@ -47,8 +53,14 @@ namespace ECE141 {
 
         // Method to calculate checksum based on data in the block
         uint32_t calc_check_sum();
+
+        //bytes of the entry as stored in the archive (compressed size when processed)
+        size_t storedSize() const {return comp_size ? comp_size : filesize;}
+        size_t blockCount() const; //blocks the entry spans, always at least one
     };
 
+    constexpr size_t kPayloadSize = kChunkSize - sizeof(ChunkHeader); //data bytes per block
+
     //what a block is, two types regular block of data, TOC block, holds metadata
         struct Chunk {
             Chunk() {
@@ -60,24 +72,46 @@ namespace ECE141 {
 
             //members
             ChunkHeader meta; //metadat is 13 bytes
-             char data[kChunkSize-sizeof(ChunkHeader)]; //a buffer
+             char data[kPayloadSize]; //a buffer
     };
 
+    static_assert(sizeof(Chunk) == kChunkSize, "a chunk must fill exactly one block");
+
 //------------------------------------Chunking
 
+    //true when aLength bytes at aData are all zero (stops at the first one that isn't)
+    bool isZeroRun(const uint8_t *aData, size_t aLength);
+
+    //lets a file descriptor (a pipe, a socket) be read as an istream. a failed read
+    //throws, which the stream turns into badbit, so it can't pass for the end of input
+    class FdInputBuffer : public std::streambuf {
+    public:
+        explicit FdInputBuffer(int aFd) : fd{aFd} {}
+
+    protected:
+        int_type underflow() override;
+
+        static constexpr size_t kBufferSize = 64 * 1024;
+        int  fd;
+        char buffer[kBufferSize];
+    };
+
     using ChunkCallback = std::function<bool(Chunk&)>; //call back to process each chunk individually
+    using FrameCallback = std::function<bool(std::vector<uint8_t>&)>; //call back for each raw frame
     //making blocks
     //chunker chunks indiscriminately
     struct Chunker {
 
-        Chunker(fstream &anInput);
+        Chunker(istream &anInput);
         ~Chunker()=default;
 
         //chunking algo
         bool chunk_em(ChunkCallback callback);
+        //reads the input in frames of up to aFrameSize bytes (last one may be short)
+        bool chunk_frames(size_t aFrameSize, FrameCallback callback);
 
     protected:
-        std::fstream &input;
+        std::istream &input;
     };
 
 
@@ -0,0 +1,138 @@
+//
+//  Delta.cpp
+//
+
+#include "Delta.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ECE141 {
+
+    constexpr size_t kMinDeltaBlock = 1024;
+    constexpr size_t kMaxDeltaBlock = 64 * 1024;
+    constexpr size_t kDeltaWindow = 1024 * 1024; //unmatched bytes held before they go out as a literal
+
+    size_t deltaBlockSize(size_t aFileSize) {
+        size_t theSize = static_cast<size_t>(std::sqrt(static_cast<double>(aFileSize)));
+        theSize = (theSize + 63) & ~size_t(63);
+        return std::min(kMaxDeltaBlock, std::max(kMinDeltaBlock, theSize));
+    }
+
+    void SignatureBuilder::write(const uint8_t *aData, size_t aLength) {
+        auto sign = [&](const uint8_t *aBlock) {
+            RollingHash theHash;
+            theHash.reset(aBlock, blockSize);
+            signatures.push_back({theHash.digest(), hashName(aBlock, blockSize)});
+        };
+        if (!partial.empty()) {
+            size_t theCount = std::min(blockSize - partial.size(), aLength);
+            partial.insert(partial.end(), aData, aData + theCount);
+            aData += theCount;
+            aLength -= theCount;
+            if (partial.size() < blockSize) return;
+            sign(partial.data());
+            partial.clear();
+        }
+        for (; aLength >= blockSize; aData += blockSize, aLength -= blockSize) sign(aData);
+        partial.assign(aData, aData + aLength);
+    }
+
+    DeltaEncoder::DeltaEncoder(const Signatures &aBase, size_t aBaseBlockSize)
+        : base{aBase}, blockSize{aBaseBlockSize} {
+        for (uint32_t i = 0; i < base.size(); ++i) lookup[base[i].weak].push_back(i);
+    }
+
+    void DeltaEncoder::write(const uint8_t *aData, size_t aLength) {
+        window.insert(window.end(), aData, aData + aLength);
+        process(false);
+        if (pos - start >= kDeltaWindow) { //a long unmatched stretch goes out as it is
+            addLiteral(window.data() + start, pos - start);
+            start = pos;
+        }
+        window.erase(window.begin(), window.begin() + start);
+        pos -= start;
+        start = 0;
+    }
+
+    void DeltaEncoder::finish() {
+        process(true);
+        addLiteral(window.data() + start, window.size() - start);
+        window.clear();
+        pos = start = 0;
+    }
+
+    //window[start, pos) didn't match anything, a copy flushes it as a literal first
+    void DeltaEncoder::process(bool aFinal) {
+        while (window.size() - pos >= blockSize && (aFinal || window.size() - pos > blockSize)) {
+            if (!rolled) {
+                rolling.reset(window.data() + pos, blockSize);
+                rolled = true;
+            }
+            uint32_t theIndex;
+            if (match(theIndex)) {
+                addLiteral(window.data() + start, pos - start);
+                addCopy(size_t(theIndex) * blockSize, blockSize);
+                start = pos += blockSize;
+                rolled = false;
+                continue;
+            }
+            if (window.size() - pos == blockSize) break; //nothing left to slide into
+            rolling.roll(window[pos], window[pos + blockSize]);
+            ++pos;
+        }
+    }
+
+    //the base block with window[pos..]'s hashes, preferring the one that extends the last copy
+    bool DeltaEncoder::match(uint32_t &anIndex) const {
+        auto theIt = lookup.find(rolling.digest());
+        if (theIt == lookup.end()) return false;
+        const uint64_t theStrong = hashName(window.data() + pos, blockSize);
+        bool isFound = false;
+        for (uint32_t theCandidate : theIt->second) {
+            if (base[theCandidate].strong != theStrong) continue;
+            anIndex = theCandidate;
+            isFound = true;
+            if (SIZE_MAX != lastOp && kDeltaCopy == ops[lastOp]) {
+                DeltaOp theLast;
+                memcpy(&theLast, ops.data() + lastOp, sizeof(DeltaOp));
+                if (size_t(theLast.offset) + theLast.length == size_t(theCandidate) * blockSize) break;
+            }
+        }
+        return isFound;
+    }
+
+    void DeltaEncoder::addCopy(size_t anOffset, size_t aLength) {
+        copyBytes += aLength;
+        if (SIZE_MAX != lastOp && kDeltaCopy == ops[lastOp]) {
+            DeltaOp theLast;
+            memcpy(&theLast, ops.data() + lastOp, sizeof(DeltaOp));
+            if (size_t(theLast.offset) + theLast.length == anOffset) { //runs on from the last copy
+                theLast.length += static_cast<uint32_t>(aLength);
+                memcpy(ops.data() + lastOp, &theLast, sizeof(DeltaOp));
+                return;
+            }
+        }
+        DeltaOp theOp{kDeltaCopy, static_cast<uint32_t>(anOffset), static_cast<uint32_t>(aLength)};
+        lastOp = ops.size();
+        ops.insert(ops.end(), reinterpret_cast<uint8_t*>(&theOp), reinterpret_cast<uint8_t*>(&theOp) + sizeof(DeltaOp));
+    }
+
+    void DeltaEncoder::addLiteral(const uint8_t *aData, size_t aLength) {
+        if (!aLength) return;
+        literalBytes += aLength;
+        if (SIZE_MAX != lastOp && kDeltaLiteral == ops[lastOp]) { //its bytes are the tail of ops, extend them
+            DeltaOp theLast;
+            memcpy(&theLast, ops.data() + lastOp, sizeof(DeltaOp));
+            theLast.length += static_cast<uint32_t>(aLength);
+            memcpy(ops.data() + lastOp, &theLast, sizeof(DeltaOp));
+        }
+        else {
+            DeltaOp theOp{kDeltaLiteral, 0, static_cast<uint32_t>(aLength)};
+            lastOp = ops.size();
+            ops.insert(ops.end(), reinterpret_cast<uint8_t*>(&theOp), reinterpret_cast<uint8_t*>(&theOp) + sizeof(DeltaOp));
+        }
+        ops.insert(ops.end(), aData, aData + aLength);
+    }
+
+}
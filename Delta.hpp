@@ -0,0 +1,119 @@
+//
+//  Delta.hpp
+//
+//  rsync-style deltas between versions of a file: block signatures of the old version,
+//  a rolling hash over the new one, and a list of copy/literal operations
+//
+
+#ifndef Delta_hpp
+#define Delta_hpp
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "Chunkers.hpp"
+#include "NameHash.hpp"
+
+namespace ECE141 {
+
+    constexpr uint64_t kDeltaMagic = 0x4543453134316474; //"ECE141dt"
+
+    //start of a delta entry's data, followed by the signatures of this version and then the operations
+    struct __attribute__((packed)) DeltaHeader {
+        uint64_t magic;
+        uint32_t version;        //this version's number, the first (full) one is 1
+        uint16_t depth;          //deltas between this version and a full copy
+        char     base[maxFileName]; //entry the copies read from (the previous version)
+        uint32_t targetSize;     //bytes this version rebuilds to
+        uint32_t blockSize;      //of the signatures below
+        uint32_t signatureCount;
+    };
+
+    static_assert(sizeof(DeltaHeader) <= kPayloadSize, "the header is read straight from the head block");
+
+    struct __attribute__((packed)) BlockSignature {
+        uint32_t weak;   //rolling hash
+        uint64_t strong; //hashName of the block
+    };
+    using Signatures = std::vector<BlockSignature>;
+
+    enum DeltaOpKind : uint8_t {kDeltaCopy = 1, kDeltaLiteral = 2};
+
+    struct __attribute__((packed)) DeltaOp {
+        uint8_t  kind;
+        uint32_t offset; //in the base (copies)
+        uint32_t length; //bytes produced; a literal's bytes follow the op
+    };
+
+    //rsync's checksum: two 16-bit sums that slide along one byte at a time
+    class RollingHash {
+    public:
+        void reset(const uint8_t *aData, size_t aLength) {
+            a = b = 0;
+            length = static_cast<uint32_t>(aLength);
+            for (size_t i = 0; i < aLength; ++i) {
+                a += aData[i];
+                b += static_cast<uint32_t>(aLength - i) * aData[i];
+            }
+        }
+        void roll(uint8_t anOut, uint8_t anIn) {
+            a += anIn - anOut;
+            b += a - length * anOut;
+        }
+        uint32_t digest() const {return (a & 0xffff) | (b << 16);}
+
+    protected:
+        uint32_t a{0}, b{0}, length{0};
+    };
+
+    //signature block size for a file: about the square root of its size, so the table stays small
+    size_t deltaBlockSize(size_t aFileSize);
+
+    //signatures of every whole block of a stream fed in pieces (a short last block gets none)
+    class SignatureBuilder {
+    public:
+        explicit SignatureBuilder(size_t aBlockSize) : blockSize{aBlockSize} {}
+        void write(const uint8_t *aData, size_t aLength);
+        const Signatures& get() const {return signatures;}
+        size_t getBlockSize() const {return blockSize;}
+
+    protected:
+        size_t blockSize;
+        std::vector<uint8_t> partial;
+        Signatures signatures;
+    };
+
+    //turns the new version, fed in order, into operations against the base's signatures:
+    //a block found anywhere in the base becomes a copy, bytes in between become literals
+    class DeltaEncoder {
+    public:
+        DeltaEncoder(const Signatures &aBase, size_t aBaseBlockSize);
+        void write(const uint8_t *aData, size_t aLength);
+        void finish();
+
+        const std::vector<uint8_t>& getOps() const {return ops;}
+        size_t copied() const {return copyBytes;}
+        size_t literal() const {return literalBytes;}
+
+    protected:
+        void process(bool aFinal);
+        bool match(uint32_t &anIndex) const;
+        void addCopy(size_t anOffset, size_t aLength);
+        void addLiteral(const uint8_t *aData, size_t aLength);
+
+        const Signatures &base;
+        size_t blockSize;
+        std::unordered_map<uint32_t, std::vector<uint32_t>> lookup; //weak hash -> base blocks
+        std::vector<uint8_t> window; //bytes not yet turned into operations
+        size_t start{0};             //window[start, pos) matched nothing so far
+        size_t pos{0};               //next byte of window to match
+        RollingHash rolling;
+        bool   rolled{false};        //rolling covers window[pos, pos + blockSize)
+        std::vector<uint8_t> ops;
+        size_t lastOp{SIZE_MAX};     //offset of the last op in ops, for merging
+        size_t copyBytes{0}, literalBytes{0};
+    };
+
+}
+
+#endif /* Delta_hpp */
@@ -0,0 +1,158 @@
+//
+//  EntryIndex.cpp
+//
+
+#include "EntryIndex.hpp"
+#include <algorithm>
+
+namespace ECE141 {
+
+    static bool nameLess(const EntryInfo &anEntry, const std::string &aName) {
+        return anEntry.name < aName;
+    }
+
+    //compare 8 hashes per step into a bit mask (the compiler turns the inner loop into vector compares),
+    //then check names only for the set bits
+    size_t EntryIndex::Leaf::find(uint64_t aHash, const std::string &aName) const {
+        const uint64_t *theHashes = hashes.data();
+        const size_t theCount = hashes.size();
+        for (size_t i = 0; i < theCount; i += 8) {
+            const size_t theEnd = std::min(theCount, i + 8);
+            unsigned theMask = 0;
+            for (size_t j = i; j < theEnd; j++) theMask |= unsigned(theHashes[j] == aHash) << (j - i);
+            for (; theMask; theMask &= theMask - 1) {
+                size_t thePos = i + __builtin_ctz(theMask);
+                if (entries[thePos].name == aName) return thePos;
+            }
+        }
+        return npos;
+    }
+
+    //last leaf whose first name is <= aName (0 when aName sorts first)
+    size_t EntryIndex::leafFor(const std::string &aName) const {
+        auto theIt = std::upper_bound(leaves.begin(), leaves.end(), aName,
+            [](const std::string &aKey, const std::shared_ptr<const Leaf> &aLeaf) {
+                return aKey < aLeaf->entries.front().name;
+            });
+        return theIt == leaves.begin() ? 0 : (theIt - leaves.begin()) - 1;
+    }
+
+    EntryIndex EntryIndex::fromSorted(std::vector<EntryInfo> &&anEntries) {
+        EntryIndex theIndex;
+        for (size_t theStart = 0; theStart < anEntries.size(); theStart += kLeafSize / 2) { //half full, room to grow
+            size_t theEnd = std::min(anEntries.size(), theStart + kLeafSize / 2);
+            auto theLeaf = std::make_shared<Leaf>();
+            theLeaf->entries.assign(std::make_move_iterator(anEntries.begin() + theStart),
+                                    std::make_move_iterator(anEntries.begin() + theEnd));
+            for (auto &theEntry : theLeaf->entries) theLeaf->hashes.push_back(hashName(theEntry.name));
+            theIndex.leaves.push_back(std::move(theLeaf));
+        }
+        theIndex.count = anEntries.size();
+        theIndex.rebuildFilter(2 * theIndex.count);
+        return theIndex;
+    }
+
+    //a fresh filter for this copy only; older copies keep the one they had
+    void EntryIndex::rebuildFilter(size_t aCapacity) {
+        filter = std::make_shared<NameFilter>(aCapacity);
+        for (auto &theLeaf : leaves) {
+            for (uint64_t theHash : theLeaf->hashes) filter->add(theHash);
+        }
+    }
+
+    //hash once: the filter turns most misses away, the leaf scan compares hashes before names
+    const EntryInfo* EntryIndex::find(const std::string &aName) const {
+        if (leaves.empty()) return nullptr;
+        const uint64_t theHash = hashName(aName);
+        if (filter && !filter->mayContain(theHash)) return nullptr;
+        const Leaf &theLeaf = *leaves[leafFor(aName)];
+        size_t thePos = theLeaf.find(theHash, aName);
+        return Leaf::npos != thePos ? &theLeaf.entries[thePos] : nullptr;
+    }
+
+    void EntryIndex::insert(const EntryInfo &anEntry) {
+        const uint64_t theHash = hashName(anEntry.name);
+        if (!filter || filter->isFull()) rebuildFilter(2 * count + 2);
+        filter->add(theHash);
+        if (leaves.empty()) {
+            auto theLeaf = std::make_shared<Leaf>();
+            theLeaf->insert(0, anEntry, theHash);
+            leaves.push_back(std::move(theLeaf));
+            count = 1;
+            return;
+        }
+
+        size_t theSlot = leafFor(anEntry.name);
+        auto theLeaf = std::make_shared<Leaf>(*leaves[theSlot]); //copy, never touch a shared leaf
+        size_t thePos = theLeaf->find(theHash, anEntry.name);
+        if (Leaf::npos != thePos) {
+            theLeaf->entries[thePos] = anEntry;
+        }
+        else {
+            auto &theEntries = theLeaf->entries;
+            thePos = std::lower_bound(theEntries.begin(), theEntries.end(), anEntry.name, nameLess) - theEntries.begin();
+            theLeaf->insert(thePos, anEntry, theHash);
+            count++;
+        }
+
+        if (theLeaf->size() > kLeafSize) { //split in half
+            const size_t theHalf = theLeaf->size() / 2;
+            auto theRight = std::make_shared<Leaf>();
+            theRight->entries.assign(theLeaf->entries.begin() + theHalf, theLeaf->entries.end());
+            theRight->hashes.assign(theLeaf->hashes.begin() + theHalf, theLeaf->hashes.end());
+            theLeaf->entries.resize(theHalf);
+            theLeaf->hashes.resize(theHalf);
+            leaves.insert(leaves.begin() + theSlot + 1, theRight);
+        }
+        leaves[theSlot] = theLeaf;
+    }
+
+    bool EntryIndex::erase(const std::string &aName) {
+        if (leaves.empty()) return false;
+        const uint64_t theHash = hashName(aName);
+        if (filter && !filter->mayContain(theHash)) return false;
+        size_t theSlot = leafFor(aName);
+        size_t thePos = leaves[theSlot]->find(theHash, aName);
+        if (Leaf::npos == thePos) return false;
+
+        auto theLeaf = std::make_shared<Leaf>(*leaves[theSlot]);
+        theLeaf->erase(thePos);
+        count--;
+
+        if (!theLeaf->size()) leaves.erase(leaves.begin() + theSlot);
+        else leaves[theSlot] = theLeaf;
+        return true;
+    }
+
+    EntryIndex::const_iterator EntryIndex::lowerBound(const std::string &aName) const {
+        if (leaves.empty()) return end();
+        size_t theSlot = leafFor(aName);
+        const auto &theEntries = leaves[theSlot]->entries;
+        size_t thePos = std::lower_bound(theEntries.begin(), theEntries.end(), aName, nameLess) - theEntries.begin();
+        return thePos < theEntries.size() ? const_iterator(&leaves, theSlot, thePos) : const_iterator(&leaves, theSlot + 1);
+    }
+
+    EntryIndex::Range EntryIndex::range(const std::string &aLow, const std::string &aHigh) const {
+        const_iterator theFirst = lowerBound(aLow);
+        if (aHigh.empty()) return {theFirst, end()};
+        return aHigh <= aLow ? Range{theFirst, theFirst} : Range{theFirst, lowerBound(aHigh)};
+    }
+
+    EntryIndex::Range EntryIndex::withPrefix(const std::string &aPrefix) const {
+        //every name with the prefix sorts below the prefix with its last byte bumped
+        std::string theEnd(aPrefix);
+        while (!theEnd.empty() && static_cast<unsigned char>(theEnd.back()) == 0xFF) theEnd.pop_back();
+        if (theEnd.empty()) return {lowerBound(aPrefix), end()};
+        theEnd.back() = static_cast<char>(static_cast<unsigned char>(theEnd.back()) + 1);
+        return {lowerBound(aPrefix), lowerBound(theEnd)};
+    }
+
+    void EntryIndex::forEach(const std::function<bool(const EntryInfo&)> &aVisitor) const {
+        for (auto &theLeaf : leaves) {
+            for (auto &theEntry : theLeaf->entries) {
+                if (!aVisitor(theEntry)) return;
+            }
+        }
+    }
+
+}
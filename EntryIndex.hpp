@@ -0,0 +1,148 @@
+//
+//  EntryIndex.hpp
+//
+//  in-memory index of archive entries, shared between snapshots
+//
+
+#ifndef EntryIndex_hpp
+#define EntryIndex_hpp
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Chunkers.hpp"
+#include "NameFilter.hpp"
+#include "NameHash.hpp"
+
+namespace ECE141 {
+
+    //what a snapshot knows about one entry (mirrors its head block)
+    struct EntryInfo {
+        std::string name;
+        size_t      head{0};      //first block
+        size_t      blocks{1};    //blocks the entry spans
+        uint32_t    filesize{0};
+        uint32_t    comp_size{0};
+        time_t      dateAdded{0};
+        uint8_t     flags{kBlockUsed}; //the head's occupied bits
+
+        EntryInfo() = default;
+        EntryInfo(size_t aHead, const ChunkHeader &aHeader)
+            : name{aHeader.name}, head{aHead}, blocks{aHeader.blockCount()},
+              filesize{aHeader.filesize}, comp_size{aHeader.comp_size}, dateAdded{aHeader.dateAdded},
+              flags{aHeader.occupied} {}
+
+        size_t storedSize() const {return comp_size ? comp_size : filesize;}
+        bool   isDelta() const {return flags & kBlockDelta;} //comp_size is then the delta's size
+        bool   isSparse() const {return flags & kBlockSparse;} //comp_size is then the data kept plus the map
+    };
+
+    //sorted, copy-on-write: entries live in small immutable leaves that copies of the index share.
+    //changing one name copies the leaf list (pointers only) and the one leaf it lands in,
+    //so a writer can build the next version while readers keep using the old one
+    class EntryIndex {
+    protected:
+        //entries in name order, plus their name hashes packed alongside: a lookup scans the
+        //hashes (a few cache lines) and only compares the name where the hash matches
+        struct Leaf {
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            std::vector<EntryInfo> entries;
+            std::vector<uint64_t>  hashes;
+
+            size_t size() const {return entries.size();}
+            size_t find(uint64_t aHash, const std::string &aName) const; //npos when missing
+            void   insert(size_t aPos, const EntryInfo &anEntry, uint64_t aHash) {
+                entries.insert(entries.begin() + aPos, anEntry);
+                hashes.insert(hashes.begin() + aPos, aHash);
+            }
+            void   erase(size_t aPos) {
+                entries.erase(entries.begin() + aPos);
+                hashes.erase(hashes.begin() + aPos);
+            }
+        };
+        using Leaves = std::vector<std::shared_ptr<const Leaf>>;
+
+    public:
+        static constexpr size_t kLeafSize = 128;
+
+        //walks the entries in name order; valid as long as the index it came from
+        class const_iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = EntryInfo;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const EntryInfo*;
+            using reference = const EntryInfo&;
+
+            const_iterator() = default;
+
+            reference operator*() const {return (*leaves)[leaf]->entries[pos];}
+            pointer operator->() const {return &**this;}
+            const_iterator& operator++() { //leaves are never empty
+                if (++pos == (*leaves)[leaf]->size()) {
+                    ++leaf;
+                    pos = 0;
+                }
+                return *this;
+            }
+            const_iterator operator++(int) {
+                const_iterator theOld = *this;
+                ++*this;
+                return theOld;
+            }
+            bool operator==(const const_iterator &anOther) const {return leaf == anOther.leaf && pos == anOther.pos;}
+            bool operator!=(const const_iterator &anOther) const {return !(*this == anOther);}
+
+        protected:
+            friend class EntryIndex;
+            const_iterator(const Leaves *aLeaves, size_t aLeaf, size_t aPos = 0) : leaves{aLeaves}, leaf{aLeaf}, pos{aPos} {}
+
+            const Leaves *leaves{nullptr};
+            size_t leaf{0};
+            size_t pos{0};
+        };
+
+        //bulk build from entries already sorted by name (names must be unique)
+        static EntryIndex fromSorted(std::vector<EntryInfo> &&anEntries);
+
+        const EntryInfo* find(const std::string &aName) const; //misses usually stop at the name filter
+        void   insert(const EntryInfo &anEntry); //replaces an entry with the same name
+        bool   erase(const std::string &aName);
+        size_t size() const {return count;}
+
+        //in name order, stop when aVisitor returns false
+        void   forEach(const std::function<bool(const EntryInfo&)> &aVisitor) const;
+
+        const_iterator begin() const {return const_iterator(&leaves, 0);}
+        const_iterator end() const {return const_iterator(&leaves, leaves.size());}
+
+        //a run of entries in name order, usable in a range-for
+        struct Range {
+            const_iterator first, last;
+            const_iterator begin() const {return first;}
+            const_iterator end() const {return last;}
+            bool empty() const {return first == last;}
+        };
+
+        //binary search over the leaf fences, then within one leaf: O(log n) to find, O(k) to walk
+        const_iterator lowerBound(const std::string &aName) const; //first entry >= aName
+        Range range(const std::string &aLow, const std::string &aHigh) const; //[aLow, aHigh), empty aHigh = to the end
+        Range withPrefix(const std::string &aPrefix) const;
+
+    protected:
+        size_t leafFor(const std::string &aName) const;
+        void   rebuildFilter(size_t aCapacity);
+
+        Leaves leaves;
+        std::shared_ptr<NameFilter> filter; //shared by copies of the index, rebuilt bigger when full
+        size_t count{0};
+    };
+
+}
+
+#endif /* EntryIndex_hpp */
@@ -0,0 +1,105 @@
+//
+//  FrameCache.cpp
+//
+
+#include "FrameCache.hpp"
+
+namespace ECE141 {
+
+    SegmentPtr FrameCache::find(const Key &aKey) {
+        Shard &theShard = shardFor(aKey);
+        std::lock_guard<std::mutex> theGuard(theShard.lock);
+        auto theIt = theShard.map.find(aKey);
+        if (theIt == theShard.map.end()) {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        theShard.order.splice(theShard.order.begin(), theShard.order, theIt->second); //now most recent
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return theIt->second->second;
+    }
+
+    void FrameCache::insert(const Key &aKey, SegmentPtr aSegment) {
+        const size_t theBudget = shardBudget.load(std::memory_order_relaxed);
+        if (!aSegment || aSegment->data.size() > theBudget) return; //would only push everything else out
+
+        Shard &theShard = shardFor(aKey);
+        std::lock_guard<std::mutex> theGuard(theShard.lock);
+        auto theIt = theShard.map.find(aKey);
+        if (theIt != theShard.map.end()) { //another reader decoded it too
+            theShard.bytes -= theIt->second->second->data.size();
+            theShard.order.erase(theIt->second);
+            theShard.map.erase(theIt);
+        }
+        theShard.bytes += aSegment->data.size();
+        theShard.order.emplace_front(aKey, std::move(aSegment));
+        theShard.map[aKey] = theShard.order.begin();
+        inserts.fetch_add(1, std::memory_order_relaxed);
+        trim(theShard);
+    }
+
+    void FrameCache::eraseEntry(uint64_t aFileId, uint64_t aHead, size_t aSegments) {
+        for (size_t s = 0; s < aSegments; ++s) {
+            Key theKey{aFileId, aHead, s};
+            Shard &theShard = shardFor(theKey);
+            std::lock_guard<std::mutex> theGuard(theShard.lock);
+            auto theIt = theShard.map.find(theKey);
+            if (theIt == theShard.map.end()) continue;
+            theShard.bytes -= theIt->second->second->data.size();
+            theShard.order.erase(theIt->second);
+            theShard.map.erase(theIt);
+        }
+    }
+
+    void FrameCache::trim(Shard &aShard) {
+        const size_t theBudget = shardBudget.load(std::memory_order_relaxed);
+        while (aShard.bytes > theBudget && !aShard.order.empty()) {
+            auto &theOldest = aShard.order.back();
+            aShard.bytes -= theOldest.second->data.size();
+            aShard.map.erase(theOldest.first);
+            aShard.order.pop_back();
+            evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void FrameCache::setBudget(size_t aBytes) {
+        shardBudget.store(aBytes / kShards, std::memory_order_relaxed);
+        for (auto &theShard : shards) {
+            std::lock_guard<std::mutex> theGuard(theShard.lock);
+            trim(theShard);
+        }
+    }
+
+    void FrameCache::clear() {
+        for (auto &theShard : shards) {
+            std::lock_guard<std::mutex> theGuard(theShard.lock);
+            theShard.map.clear();
+            theShard.order.clear();
+            theShard.bytes = 0;
+        }
+    }
+
+    FrameCache::Stats FrameCache::getStats() const {
+        Stats theStats;
+        theStats.hits = hits.load(std::memory_order_relaxed);
+        theStats.misses = misses.load(std::memory_order_relaxed);
+        theStats.inserts = inserts.load(std::memory_order_relaxed);
+        theStats.evictions = evictions.load(std::memory_order_relaxed);
+        theStats.budget = shardBudget.load(std::memory_order_relaxed) * kShards;
+        for (auto &theShard : shards) {
+            std::lock_guard<std::mutex> theGuard(theShard.lock);
+            theStats.bytes += theShard.bytes;
+            theStats.segments += theShard.map.size();
+        }
+        return theStats;
+    }
+
+    void FrameCache::report(std::ostream &aStream) const {
+        Stats theStats = getStats();
+        aStream << "{\"hits\": " << theStats.hits << ", \"misses\": " << theStats.misses
+                << ", \"hit_rate\": " << theStats.hitRate() << ", \"inserts\": " << theStats.inserts
+                << ", \"evictions\": " << theStats.evictions << ", \"bytes\": " << theStats.bytes
+                << ", \"segments\": " << theStats.segments << ", \"budget\": " << theStats.budget << "}";
+    }
+
+}
@@ -0,0 +1,92 @@
+//
+//  FrameCache.hpp
+//
+//  decoded entry data kept in memory so hot entries are read without I/O or decompression
+//
+
+#ifndef FrameCache_hpp
+#define FrameCache_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace ECE141 {
+
+    //one decoded piece of an entry: a frame of a processed entry, or a run of raw blocks
+    struct FrameSegment {
+        std::vector<uint8_t> data;
+        size_t storedEnd{0}; //stored offset just past this piece, where the next one starts
+    };
+    using SegmentPtr = std::shared_ptr<const FrameSegment>;
+
+    //sharded LRU under a byte budget. a segment is named by the open archive file (BlockFile::cacheId,
+    //never reused, unlike an inode), the entry's head block and its index in the entry, so a compacted
+    //or replaced file never hits old data.
+    //lookups hand out shared pointers: an evicted segment stays valid for whoever is reading it
+    class FrameCache {
+    public:
+        static constexpr size_t kShards = 16;
+        static constexpr size_t kDefaultBudget = 64 * 1024 * 1024;
+
+        struct Key {
+            uint64_t fileId{0};
+            uint64_t head{0};
+            uint64_t segment{0};
+            bool operator==(const Key &anOther) const {
+                return fileId == anOther.fileId && head == anOther.head && segment == anOther.segment;
+            }
+        };
+
+        struct Stats {
+            uint64_t hits{0}, misses{0}, inserts{0}, evictions{0};
+            size_t   bytes{0}, segments{0}, budget{0};
+            double   hitRate() const {return hits + misses ? double(hits) / (hits + misses) : 0.0;}
+        };
+
+        explicit FrameCache(size_t aBudget = kDefaultBudget) {setBudget(aBudget);}
+
+        FrameCache(const FrameCache&) = delete;
+        FrameCache& operator=(const FrameCache&) = delete;
+
+        SegmentPtr find(const Key &aKey);          //nullptr on a miss
+        void       insert(const Key &aKey, SegmentPtr aSegment);
+        void       eraseEntry(uint64_t aFileId, uint64_t aHead, size_t aSegments); //an entry rewritten in place
+        void       setBudget(size_t aBytes);       //0 turns caching off; shrinking evicts right away
+        void       clear();
+
+        Stats      getStats() const;
+        void       report(std::ostream &aStream) const; //JSON
+
+    protected:
+        struct KeyHash {
+            size_t operator()(const Key &aKey) const {
+                uint64_t theHash = aKey.fileId * 0x9E3779B97F4A7C15ull ^ aKey.head * 0xC2B2AE3D27D4EB4Full ^ aKey.segment;
+                return static_cast<size_t>(theHash ^ (theHash >> 29));
+            }
+        };
+
+        struct Shard {
+            using Order = std::list<std::pair<Key, SegmentPtr>>; //most recently used first
+            mutable std::mutex lock;
+            Order      order;
+            std::unordered_map<Key, Order::iterator, KeyHash> map;
+            size_t     bytes{0};
+        };
+
+        Shard& shardFor(const Key &aKey) {return shards[KeyHash()(aKey) % kShards];}
+        void   trim(Shard &aShard); //caller holds aShard.lock
+
+        Shard shards[kShards];
+        std::atomic<size_t>   shardBudget{0};
+        std::atomic<uint64_t> hits{0}, misses{0}, inserts{0}, evictions{0};
+    };
+
+}
+
+#endif /* FrameCache_hpp */
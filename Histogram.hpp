@@ -0,0 +1,108 @@
+//
+//  Histogram.hpp
+//
+//  log-linear latency histogram: 4 buckets per power of two, lock-free to record into
+//
+
+#ifndef Histogram_hpp
+#define Histogram_hpp
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+namespace ECE141 {
+
+    //values are nanoseconds; every bucket is within 25% of its neighbours, which is plenty
+    //for p50/p99 and costs ~2 KB per histogram no matter how many samples go in
+    class LatencyHistogram {
+    public:
+        static constexpr size_t kBuckets = 4 * 63;
+
+        LatencyHistogram() = default;
+        LatencyHistogram(const LatencyHistogram &aCopy) {merge(aCopy);}
+        LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+        void record(uint64_t aNanos) {
+            counts[bucketFor(aNanos)].fetch_add(1, std::memory_order_relaxed);
+            total.fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(aNanos, std::memory_order_relaxed);
+            for (uint64_t theMax = max.load(std::memory_order_relaxed); aNanos > theMax;) {
+                if (max.compare_exchange_weak(theMax, aNanos, std::memory_order_relaxed)) break;
+            }
+        }
+        void recordSeconds(double aSeconds) {record(static_cast<uint64_t>(aSeconds * 1e9));}
+
+        void merge(const LatencyHistogram &anOther) {
+            for (size_t i = 0; i < kBuckets; i++) {
+                counts[i].fetch_add(anOther.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            total.fetch_add(anOther.count(), std::memory_order_relaxed);
+            sum.fetch_add(anOther.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            uint64_t theOther = anOther.maximum();
+            for (uint64_t theMax = max.load(std::memory_order_relaxed); theOther > theMax;) {
+                if (max.compare_exchange_weak(theMax, theOther, std::memory_order_relaxed)) break;
+            }
+        }
+
+        uint64_t count() const   {return total.load(std::memory_order_relaxed);}
+        uint64_t maximum() const {return max.load(std::memory_order_relaxed);}
+        uint64_t sumNanos() const {return sum.load(std::memory_order_relaxed);}
+        double   mean() const    {return count() ? double(sumNanos()) / count() : 0.0;}
+
+        //samples below aLimit; exact when aLimit is a power of two (a bucket edge)
+        uint64_t countBelow(uint64_t aLimit) const {
+            uint64_t theCount = 0;
+            for (size_t i = 0; i < kBuckets && lowerBound(i + 1) <= aLimit; i++) {
+                theCount += counts[i].load(std::memory_order_relaxed);
+            }
+            return theCount;
+        }
+
+        //upper edge of the bucket holding the aFraction'th sample
+        uint64_t percentile(double aFraction) const {
+            uint64_t theTarget = static_cast<uint64_t>(aFraction * count() + 0.5);
+            uint64_t theSeen = 0;
+            for (size_t i = 0; i < kBuckets; i++) {
+                theSeen += counts[i].load(std::memory_order_relaxed);
+                if (theSeen >= theTarget && theSeen) return std::min(lowerBound(i + 1) - 1, maximum());
+            }
+            return maximum();
+        }
+
+        //[[lower_ns, count], ...] for the non-empty buckets
+        void toJSON(std::ostream &aStream) const {
+            const char *thePrefix = "";
+            aStream << "[";
+            for (size_t i = 0; i < kBuckets; i++) {
+                if (uint64_t theCount = counts[i].load(std::memory_order_relaxed)) {
+                    aStream << thePrefix << "[" << lowerBound(i) << ", " << theCount << "]";
+                    thePrefix = ", ";
+                }
+            }
+            aStream << "]";
+        }
+
+        static size_t bucketFor(uint64_t aValue) {
+            if (aValue < 4) return static_cast<size_t>(aValue);
+            int theMSB = 63 - __builtin_clzll(aValue);
+            return (theMSB - 1) * 4 + ((aValue >> (theMSB - 2)) & 3);
+        }
+
+        static uint64_t lowerBound(size_t aBucket) {
+            if (aBucket < 4) return aBucket;
+            return (4 + aBucket % 4) << (aBucket / 4 - 1);
+        }
+
+    protected:
+        std::array<std::atomic<uint64_t>, kBuckets> counts{};
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+}
+
+#endif /* Histogram_hpp */
@@ -0,0 +1,247 @@
+//
+//  LoadGenerator.hpp
+//
+//  sustained, configurable load against one Archive: op mix, file sizes, name count,
+//  threads and duration, with per-op latency histograms and throughput over time
+//
+
+#ifndef LoadGenerator_hpp
+#define LoadGenerator_hpp
+
+#include "Archive.hpp"
+#include "Histogram.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ECE141 {
+
+    struct LoadConfig {
+        //relative weights, they don't need to add up to anything
+        double addWeight{40}, extractWeight{40}, removeWeight{15}, listWeight{5};
+        size_t minSize{1024}, maxSize{2048};
+        bool   logSizes{false};   //log-uniform sizes (lots of small, a few big) instead of uniform
+        size_t fileCount{1000};   //distinct names in play, the archive never holds more
+        size_t threads{4};
+        double duration{5.0};     //seconds
+        size_t maxOps{0};         //stop early after this many ops (0: run for duration)
+        double interval{1.0};     //seconds between timeline samples
+        bool   compress{false};
+        bool   verify{true};      //check extracted sizes and op results
+        unsigned seed{0};         //0: random
+    };
+
+    //one timeline sample; ops/bytes are for the interval, the rest is the state at its end
+    struct LoadSample {
+        double time;
+        size_t ops, bytes, entries, archiveBytes;
+    };
+
+    class LoadGenerator {
+    public:
+        enum Op {opAdd, opExtract, opRemove, opList, kOpCount};
+        static constexpr const char* kOpNames[kOpCount] = {"add", "extract", "remove", "list"};
+
+        //names go to a "load" folder under aFolder; every worker owns the names
+        //id % threads == worker, so the expected contents need no locking
+        LoadGenerator(Archive &anArchive, const std::string &aFolder, const LoadConfig &aConfig)
+            : archive{anArchive}, folder{aFolder + "/load"}, config{aConfig} {
+            if (!config.threads) config.threads = 1;
+            if (config.maxSize < config.minSize) config.maxSize = config.minSize;
+            if (!config.seed) config.seed = std::random_device{}();
+        }
+
+        //false if any op failed (or, with verify, returned the wrong data)
+        bool run() {
+            std::filesystem::create_directories(folder);
+            makeText();
+
+            auto theStart = std::chrono::steady_clock::now();
+            std::vector<std::thread> theWorkers;
+            for (size_t t = 0; t < config.threads; t++) {
+                theWorkers.emplace_back([this, t]() {work(t); finished++;});
+            }
+
+            //sample throughput until time is up or the workers ran out of ops
+            size_t theLastOps = 0, theLastBytes = 0;
+            auto theNext = theStart;
+            while (finished < config.threads) {
+                theNext += std::chrono::microseconds(static_cast<int64_t>(config.interval * 1e6));
+                while (finished < config.threads && std::chrono::steady_clock::now() < theNext) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+                double theTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - theStart).count();
+                if (theTime >= config.duration) stopping = true;
+                size_t theOps = opsDone, theBytes = bytesDone;
+                timeline.push_back({theTime, theOps - theLastOps, theBytes - theLastBytes, live, archiveSize()});
+                theLastOps = theOps;
+                theLastBytes = theBytes;
+            }
+            for (auto &theWorker : theWorkers) theWorker.join();
+
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - theStart).count();
+            std::filesystem::remove_all(folder);
+            return 0 == failures;
+        }
+
+        size_t getOps() const      {return opsDone;}
+        size_t getFailures() const {return failures;}
+        size_t getLive() const     {return live;} //entries the archive should hold now
+        const LatencyHistogram& getLatency(Op anOp) const {return latency[anOp];}
+
+        void report(std::ostream &aStream) const {
+            aStream << "{\"load\": {\"threads\": " << config.threads << ", \"files\": " << config.fileCount
+                    << ", \"min_size\": " << config.minSize << ", \"max_size\": " << config.maxSize
+                    << ", \"compressed\": " << (config.compress ? "true" : "false")
+                    << ", \"elapsed_s\": " << elapsed << ", \"ops\": " << opsDone
+                    << ", \"failures\": " << failures
+                    << ", \"ops_per_sec\": " << (elapsed > 0 ? opsDone / elapsed : 0.0)
+                    << ", \"mb_per_sec\": " << (elapsed > 0 ? bytesDone / elapsed / (1024.0 * 1024.0) : 0.0)
+                    << ",\n  \"latency\": {";
+            for (size_t i = 0; i < kOpCount; i++) {
+                auto &theHistogram = latency[i];
+                aStream << (i ? ",\n    \"" : "\n    \"") << kOpNames[i] << "\": {\"count\": " << theHistogram.count()
+                        << ", \"mean_ms\": " << theHistogram.mean() / 1e6
+                        << ", \"p50_ms\": " << theHistogram.percentile(0.50) / 1e6
+                        << ", \"p99_ms\": " << theHistogram.percentile(0.99) / 1e6
+                        << ", \"max_ms\": " << theHistogram.maximum() / 1e6 << ", \"histogram_ns\": ";
+                theHistogram.toJSON(aStream);
+                aStream << "}";
+            }
+            aStream << "},\n  \"timeline\": [";
+            const char *thePrefix = "\n    ";
+            for (auto &theSample : timeline) {
+                aStream << thePrefix << "{\"t\": " << theSample.time << ", \"ops\": " << theSample.ops
+                        << ", \"bytes\": " << theSample.bytes << ", \"entries\": " << theSample.entries
+                        << ", \"archive_bytes\": " << theSample.archiveBytes << "}";
+                thePrefix = ",\n    ";
+            }
+            aStream << "]}}\n";
+        }
+
+    protected:
+        Archive               &archive;
+        std::string           folder;
+        LoadConfig            config;
+        std::string           text;     //source data, files are cut from it
+        LatencyHistogram      latency[kOpCount];
+        std::atomic<size_t>   opsIssued{0}, opsDone{0}, bytesDone{0}, failures{0}, live{0}, finished{0};
+        std::atomic<bool>     stopping{false};
+        std::vector<LoadSample> timeline;
+        double                elapsed{0.0};
+
+        static std::string nameFor(size_t anId) {return "L" + std::to_string(anId) + ".dat";}
+
+        void makeText() {
+            static const char* theWords[] = {"class", "happy", "coding", "pattern", "design", "method",
+                                             "dyad", "story", "monad", "data", "compile", "debug"};
+            std::mt19937 theRandom(config.seed);
+            while (text.size() < 1024 * 1024) {
+                text += theWords[theRandom() % 12];
+                text += (theRandom() % 10) ? ", " : "\n";
+            }
+        }
+
+        size_t archiveSize() const {
+            std::error_code theError;
+            auto theSize = std::filesystem::file_size(archive.getFullPath().getValue(), theError);
+            return theError ? 0 : static_cast<size_t>(theSize);
+        }
+
+        bool writeSource(const std::string &aPath, size_t aSize, size_t anOffset) const {
+            std::ofstream theFile(aPath, std::ios::binary | std::ios::trunc);
+            for (size_t theLeft = aSize; theLeft;) {
+                size_t theStart = anOffset % text.size();
+                size_t theCount = std::min(theLeft, text.size() - theStart);
+                theFile.write(text.data() + theStart, theCount);
+                theLeft -= theCount;
+                anOffset += theCount;
+            }
+            return theFile.good();
+        }
+
+        void work(size_t aWorker) {
+            std::mt19937_64 theRandom(config.seed + aWorker);
+            std::discrete_distribution<int> theMix({config.addWeight, config.extractWeight,
+                                                    config.removeWeight, config.listWeight});
+            std::uniform_real_distribution<double> theUnit(0.0, 1.0);
+            Compression theCompression;
+            IDataProcessor *theProcessor = config.compress ? &theCompression : nullptr;
+            std::ofstream theNull; //unopened, swallows list output
+            std::string theOut(folder + "/out" + std::to_string(aWorker) + ".dat");
+
+            //this worker's names are ids aWorker, aWorker + threads, ...; slot k <-> id aWorker + k * threads
+            size_t theSlots = (config.fileCount + config.threads - 1 - aWorker) / config.threads;
+            if (!theSlots) return;
+            std::vector<size_t> theSizes(theSlots, 0); //0: not in the archive
+            std::vector<size_t> thePresent;            //slots in the archive...
+            std::vector<size_t> thePosition(theSlots); //...and where each sits in thePresent
+
+            auto pickSize = [&]() {
+                double theLow = double(config.minSize), theHigh = double(config.maxSize);
+                double theSize = config.logSizes
+                    ? std::exp(std::log(theLow) + theUnit(theRandom) * (std::log(theHigh) - std::log(theLow)))
+                    : theLow + theUnit(theRandom) * (theHigh - theLow);
+                return std::max<size_t>(1, static_cast<size_t>(theSize));
+            };
+
+            while (!stopping && (!config.maxOps || opsIssued++ < config.maxOps)) {
+                Op theOp = static_cast<Op>(theMix(theRandom));
+                if (thePresent.empty() && (opExtract == theOp || opRemove == theOp)) theOp = opAdd;
+
+                size_t theSlot = opAdd == theOp ? theRandom() % theSlots : thePresent.empty()
+                                 ? 0 : thePresent[theRandom() % thePresent.size()];
+                std::string theName = nameFor(aWorker + theSlot * config.threads);
+                size_t theSize = opAdd == theOp ? pickSize() : theSizes[theSlot];
+                std::string theSource(folder + "/" + theName);
+                if (opAdd == theOp) writeSource(theSource, theSize, theRandom() % text.size());
+
+                bool theOK = true;
+                auto theBegin = std::chrono::steady_clock::now();
+                switch (theOp) {
+                    case opAdd:     theOK = archive.add(theSource, theProcessor).isOK(); break;
+                    case opExtract: theOK = archive.extract(theName, theOut).isOK(); break;
+                    case opRemove:  theOK = archive.remove(theName).isOK(); break;
+                    default:        archive.list(theNull); theSize = 0; break;
+                }
+                latency[theOp].record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                            std::chrono::steady_clock::now() - theBegin).count()));
+
+                if (opAdd == theOp) {
+                    std::remove(theSource.c_str());
+                    if (theOK && !theSizes[theSlot]) {
+                        thePosition[theSlot] = thePresent.size();
+                        thePresent.push_back(theSlot);
+                        live++;
+                    }
+                    if (theOK) theSizes[theSlot] = theSize;
+                }
+                else if (opRemove == theOp && theOK) {
+                    size_t theLast = thePresent.back();
+                    thePresent[thePosition[theSlot]] = theLast;
+                    thePosition[theLast] = thePosition[theSlot];
+                    thePresent.pop_back();
+                    theSizes[theSlot] = 0;
+                    live--;
+                }
+                else if (opExtract == theOp && theOK && config.verify) {
+                    std::error_code theError;
+                    theOK = std::filesystem::file_size(theOut, theError) == theSize && !theError;
+                }
+
+                if (!theOK) failures++;
+                opsDone++;
+                bytesDone += theSize;
+            }
+        }
+    };
+
+}
+
+#endif /* LoadGenerator_hpp */
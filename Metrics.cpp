@@ -0,0 +1,90 @@
+//
+//  Metrics.cpp
+//
+
+#include "Metrics.hpp"
+#include <cstdio>
+#include <fstream>
+
+namespace ECE141 {
+
+    const char* MetricsObserver::actionName(ActionType anAction) {
+        static const char* theNames[kActionCount] = {"add", "extract", "remove", "list", "dump", "compact", "update", "append", "merge"};
+        return theNames[static_cast<size_t>(anAction)];
+    }
+
+    void MetricsObserver::operator()(ActionType anAction, const std::string &/*aName*/, bool status,
+                                     const OperationMetrics &aMetrics) {
+        OperationTotals &theTotals = totals[static_cast<size_t>(anAction)];
+        auto bump = [](std::atomic<uint64_t> &aCounter, uint64_t aValue) {
+            aCounter.fetch_add(aValue, std::memory_order_relaxed);
+        };
+        bump(status ? theTotals.succeeded : theTotals.failed, 1);
+        bump(theTotals.bytesIn, aMetrics.bytesIn);
+        bump(theTotals.bytesOut, aMetrics.bytesOut);
+        bump(theTotals.blocksRead, aMetrics.blocksRead);
+        bump(theTotals.blocksWritten, aMetrics.blocksWritten);
+        bump(theTotals.rawBytes, aMetrics.rawBytes);
+        bump(theTotals.storedBytes, aMetrics.storedBytes);
+        bump(theTotals.ioWaitNanos, static_cast<uint64_t>(aMetrics.ioWait * 1e9));
+        theTotals.latency.recordSeconds(aMetrics.wallTime);
+    }
+
+    void MetricsObserver::writePrometheus(std::ostream &aStream) const {
+        auto load = [](const std::atomic<uint64_t> &aCounter) {return aCounter.load(std::memory_order_relaxed);};
+
+        //one family at a time, a sample per operation
+        auto family = [&](const char *aName, const char *aType, const char *aHelp,
+                          const std::function<void(const char*, const OperationTotals&)> &aSamples) {
+            aStream << "# HELP " << aName << " " << aHelp << "\n# TYPE " << aName << " " << aType << "\n";
+            for (size_t i = 0; i < kActionCount; i++) {
+                aSamples(actionName(static_cast<ActionType>(i)), totals[i]);
+            }
+        };
+        auto counter = [&](const char *aName, const char *aHelp, std::atomic<uint64_t> OperationTotals::*aField) {
+            family(aName, "counter", aHelp, [&](const char *anOp, const OperationTotals &aTotals) {
+                aStream << aName << "{op=\"" << anOp << "\"} " << load(aTotals.*aField) << "\n";
+            });
+        };
+
+        family("archive_operations_total", "counter", "Archive operations by result.",
+               [&](const char *anOp, const OperationTotals &aTotals) {
+                   aStream << "archive_operations_total{op=\"" << anOp << "\",status=\"ok\"} " << load(aTotals.succeeded) << "\n"
+                           << "archive_operations_total{op=\"" << anOp << "\",status=\"error\"} " << load(aTotals.failed) << "\n";
+               });
+        counter("archive_bytes_in_total", "Bytes read from the source or the archive.", &OperationTotals::bytesIn);
+        counter("archive_bytes_out_total", "Bytes written to the archive or the caller.", &OperationTotals::bytesOut);
+        counter("archive_blocks_read_total", "Archive blocks read.", &OperationTotals::blocksRead);
+        counter("archive_blocks_written_total", "Archive blocks written.", &OperationTotals::blocksWritten);
+        counter("archive_raw_bytes_total", "Entry bytes before processing.", &OperationTotals::rawBytes);
+        counter("archive_stored_bytes_total", "Entry bytes as stored.", &OperationTotals::storedBytes);
+        family("archive_io_wait_seconds_total", "counter", "Time spent in archive file I/O.",
+               [&](const char *anOp, const OperationTotals &aTotals) {
+                   aStream << "archive_io_wait_seconds_total{op=\"" << anOp << "\"} " << load(aTotals.ioWaitNanos) / 1e9 << "\n";
+               });
+
+        //cumulative buckets at powers of 4 from ~1us, they line up with the histogram's own edges
+        family("archive_operation_seconds", "histogram", "Wall time per operation.",
+               [&](const char *anOp, const OperationTotals &aTotals) {
+                   for (unsigned theShift = 10; theShift <= 34; theShift += 2) {
+                       aStream << "archive_operation_seconds_bucket{op=\"" << anOp << "\",le=\""
+                               << double(uint64_t(1) << theShift) / 1e9 << "\"} "
+                               << aTotals.latency.countBelow(uint64_t(1) << theShift) << "\n";
+                   }
+                   aStream << "archive_operation_seconds_bucket{op=\"" << anOp << "\",le=\"+Inf\"} " << aTotals.latency.count() << "\n"
+                           << "archive_operation_seconds_sum{op=\"" << anOp << "\"} " << aTotals.latency.sumNanos() / 1e9 << "\n"
+                           << "archive_operation_seconds_count{op=\"" << anOp << "\"} " << aTotals.latency.count() << "\n";
+               });
+    }
+
+    bool MetricsObserver::dumpTo(const std::string &aPath) const {
+        std::string theTemp = aPath + ".tmp";
+        {
+            std::ofstream theFile(theTemp, std::ios::trunc);
+            writePrometheus(theFile);
+            if (!theFile.good()) return false;
+        }
+        return 0 == std::rename(theTemp.c_str(), aPath.c_str());
+    }
+
+}
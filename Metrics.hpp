@@ -0,0 +1,50 @@
+//
+//  Metrics.hpp
+//
+//  an observer that aggregates OperationMetrics and dumps them in Prometheus text format
+//
+
+#ifndef Metrics_hpp
+#define Metrics_hpp
+
+#include "Archive.hpp"
+#include "Histogram.hpp"
+#include <atomic>
+#include <ostream>
+#include <string>
+
+namespace ECE141 {
+
+    //lock-free totals for one kind of operation
+    struct OperationTotals {
+        std::atomic<uint64_t> succeeded{0}, failed{0};
+        std::atomic<uint64_t> bytesIn{0}, bytesOut{0};
+        std::atomic<uint64_t> blocksRead{0}, blocksWritten{0};
+        std::atomic<uint64_t> rawBytes{0}, storedBytes{0};
+        std::atomic<uint64_t> ioWaitNanos{0};
+        LatencyHistogram      latency; //wall time, ns
+    };
+
+    //add it with Archive::addObserver; safe to share between archives and threads
+    class MetricsObserver : public ArchiveObserver {
+    public:
+        static constexpr size_t kActionCount = static_cast<size_t>(ActionType::merged) + 1;
+
+        using ArchiveObserver::operator();
+        void operator()(ActionType anAction, const std::string &aName, bool status,
+                        const OperationMetrics &aMetrics) override;
+
+        const OperationTotals& getTotals(ActionType anAction) const {return totals[static_cast<size_t>(anAction)];}
+
+        void writePrometheus(std::ostream &aStream) const;
+        bool dumpTo(const std::string &aPath) const; //replaces aPath atomically, for a textfile collector
+
+        static const char* actionName(ActionType anAction);
+
+    protected:
+        OperationTotals totals[kActionCount];
+    };
+
+}
+
+#endif /* Metrics_hpp */
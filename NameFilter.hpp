@@ -0,0 +1,75 @@
+//
+//  NameFilter.hpp
+//
+//  bloom filter over entry names: answers "not in the archive" without searching the index
+//
+
+#ifndef NameFilter_hpp
+#define NameFilter_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "NameHash.hpp"
+
+namespace ECE141 {
+
+    //10 bits and 7 probes per name, ~1% false positives at capacity. bits are only ever set,
+    //so successive versions of the index share one filter while the writer adds to it;
+    //removed names stay "maybe" until the filter is rebuilt
+    class NameFilter {
+    public:
+        static constexpr size_t kBitsPerName = 10;
+        static constexpr size_t kProbes = 7;
+        static constexpr size_t kMinCapacity = 1024;
+
+        explicit NameFilter(size_t aCapacity)
+            : capacity{std::max(aCapacity, kMinCapacity)}, words((capacity * kBitsPerName + 63) / 64) {}
+
+        NameFilter(const NameFilter&) = delete;
+        NameFilter& operator=(const NameFilter&) = delete;
+
+        void add(const std::string &aName) {add(hashName(aName));}
+        void add(uint64_t aHash) {
+            probe(aHash, [&](size_t aBit) {
+                words[aBit / 64].fetch_or(uint64_t(1) << (aBit % 64), std::memory_order_relaxed);
+                return true;
+            });
+            added.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        //false means aName was never added
+        bool mayContain(const std::string &aName) const {return mayContain(hashName(aName));}
+        bool mayContain(uint64_t aHash) const {
+            return probe(aHash, [&](size_t aBit) {
+                return 0 != (words[aBit / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (aBit % 64)));
+            });
+        }
+
+        //full once this many names went in (removed ones included), time to build a bigger one
+        bool   isFull() const {return added.load(std::memory_order_relaxed) >= capacity;}
+        size_t getCapacity() const {return capacity;}
+        size_t getBytes() const {return words.size() * sizeof(uint64_t);}
+
+    protected:
+        //double hashing off the name hash: probe i lands on h1 + i * h2
+        template <typename F>
+        bool probe(uint64_t aHash, F aVisitor) const {
+            uint64_t theStep = (aHash >> 32) | 1;
+            const uint64_t theBits = words.size() * 64;
+            for (size_t i = 0; i < kProbes; i++) {
+                if (!aVisitor(static_cast<size_t>((aHash + i * theStep) % theBits))) return false;
+            }
+            return true;
+        }
+
+        size_t capacity;
+        std::vector<std::atomic<uint64_t>> words;
+        std::atomic<size_t> added{0};
+    };
+
+}
+
+#endif /* NameFilter_hpp */
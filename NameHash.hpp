@@ -0,0 +1,79 @@
+//
+//  NameHash.hpp
+//
+//  64-bit hash for entry names (wyhash's construction: multiply-fold over 8-byte reads)
+//
+
+#ifndef NameHash_hpp
+#define NameHash_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace ECE141 {
+
+    namespace NameHashDetail {
+        constexpr uint64_t kSecret[4] = {0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+                                         0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull};
+
+        //128-bit product, folded
+        inline uint64_t mix(uint64_t a, uint64_t b) {
+            __uint128_t theProduct = static_cast<__uint128_t>(a) * b;
+            return static_cast<uint64_t>(theProduct) ^ static_cast<uint64_t>(theProduct >> 64);
+        }
+        inline uint64_t read64(const uint8_t *aPtr) {uint64_t theValue; memcpy(&theValue, aPtr, 8); return theValue;}
+        inline uint64_t read32(const uint8_t *aPtr) {uint32_t theValue; memcpy(&theValue, aPtr, 4); return theValue;}
+    }
+
+    //every input byte reaches every output bit; ~1 cycle/byte on long input, a few ns for a file name
+    inline uint64_t hashName(const void *aKey, size_t aLength, uint64_t aSeed = 0) {
+        using namespace NameHashDetail;
+        auto *p = static_cast<const uint8_t*>(aKey);
+        uint64_t theSeed = aSeed ^ mix(aSeed ^ kSecret[0], kSecret[1]);
+        uint64_t a, b;
+        if (aLength <= 16) {
+            if (aLength >= 4) {
+                size_t theStep = (aLength >> 3) << 2;
+                a = (read32(p) << 32) | read32(p + theStep);
+                b = (read32(p + aLength - 4) << 32) | read32(p + aLength - 4 - theStep);
+            }
+            else if (aLength > 0) {
+                a = (uint64_t(p[0]) << 16) | (uint64_t(p[aLength >> 1]) << 8) | p[aLength - 1];
+                b = 0;
+            }
+            else a = b = 0;
+        }
+        else {
+            size_t i = aLength;
+            if (i > 48) { //three independent lanes
+                uint64_t theSeed1 = theSeed, theSeed2 = theSeed;
+                do {
+                    theSeed = mix(read64(p) ^ kSecret[1], read64(p + 8) ^ theSeed);
+                    theSeed1 = mix(read64(p + 16) ^ kSecret[2], read64(p + 24) ^ theSeed1);
+                    theSeed2 = mix(read64(p + 32) ^ kSecret[3], read64(p + 40) ^ theSeed2);
+                    p += 48;
+                    i -= 48;
+                } while (i > 48);
+                theSeed ^= theSeed1 ^ theSeed2;
+            }
+            while (i > 16) {
+                theSeed = mix(read64(p) ^ kSecret[1], read64(p + 8) ^ theSeed);
+                p += 16;
+                i -= 16;
+            }
+            a = read64(p + i - 16);
+            b = read64(p + i - 8);
+        }
+        __uint128_t theProduct = static_cast<__uint128_t>(a ^ kSecret[1]) * (b ^ theSeed);
+        a = static_cast<uint64_t>(theProduct);
+        b = static_cast<uint64_t>(theProduct >> 64);
+        return mix(a ^ kSecret[0] ^ aLength, b ^ kSecret[1]);
+    }
+
+    inline uint64_t hashName(const std::string &aName) {return hashName(aName.data(), aName.size());}
+
+}
+
+#endif /* NameHash_hpp */
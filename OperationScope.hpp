@@ -0,0 +1,33 @@
+//
+//  OperationScope.hpp
+//
+//  names the archive operation a thread is working for (Tracker charges allocations to it)
+//
+
+#ifndef OperationScope_hpp
+#define OperationScope_hpp
+
+namespace ECE141 {
+
+    //RAII; scopes nest, the innermost one wins. aName must outlive the scope (use literals)
+    class OperationScope {
+    public:
+        explicit OperationScope(const char *aName) : previous{current()} {current() = aName;}
+        ~OperationScope() {current() = previous;}
+
+        OperationScope(const OperationScope&) = delete;
+        OperationScope& operator=(const OperationScope&) = delete;
+
+        //nullptr outside any operation
+        static const char*& current() {
+            static thread_local const char *theName = nullptr;
+            return theName;
+        }
+
+    protected:
+        const char *previous;
+    };
+
+}
+
+#endif /* OperationScope_hpp */
@@ -0,0 +1,118 @@
+//
+//  Pipeline.hpp
+//
+//  bounded queues + per-stage stats used to run add as a pipeline
+//
+
+#ifndef Pipeline_hpp
+#define Pipeline_hpp
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ECE141 {
+
+    constexpr size_t kPipelineDepth = 4; //frames in flight between two stages
+
+    //timing for one stage, filled in by the stage thread
+    struct StageStats {
+        std::string name;
+        size_t      items{0};
+        double      busy{0.0};    //seconds spent doing work
+        double      waitIn{0.0};  //seconds blocked on an empty input queue
+        double      waitOut{0.0}; //seconds blocked on a full output queue (backpressure)
+
+        double utilization(double aWallTime) const {
+            return aWallTime > 0.0 ? busy / aWallTime : 0.0;
+        }
+    };
+
+    struct PipelineStats {
+        std::vector<StageStats> stages;
+        double elapsed{0.0};
+        size_t bytesIn{0};
+        size_t bytesOut{0};
+
+        void report(std::ostream &aStream) const {
+            aStream << "stage       items   busy(s)   waitIn(s)  waitOut(s)  util\n";
+            for(auto &theStage : stages) {
+                aStream << theStage.name << "\t" << theStage.items << "\t"
+                        << theStage.busy << "\t" << theStage.waitIn << "\t"
+                        << theStage.waitOut << "\t" << theStage.utilization(elapsed) << "\n";
+            }
+            aStream << "elapsed " << elapsed << "s, in " << bytesIn << " bytes, out " << bytesOut << " bytes\n";
+        }
+    };
+
+    //fixed capacity fifo; push blocks when full, pop blocks when empty
+    //close() wakes everybody up: push fails, pop drains what is left then fails
+    template<typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t aCapacity=kPipelineDepth) : capacity{aCapacity ? aCapacity : 1} {}
+
+        bool push(T &&anItem, double *aWaited=nullptr) {
+            auto theStart = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> theLock(mutex);
+            notFull.wait(theLock, [this]{ return closed || items.size() < capacity; });
+            addWait(aWaited, theStart);
+            if(closed) return false;
+            items.push_back(std::move(anItem));
+            notEmpty.notify_one();
+            return true;
+        }
+
+        bool pop(T &anItem, double *aWaited=nullptr) {
+            auto theStart = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> theLock(mutex);
+            notEmpty.wait(theLock, [this]{ return closed || !items.empty(); });
+            addWait(aWaited, theStart);
+            if(items.empty()) return false;
+            anItem = std::move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> theLock(mutex);
+            closed = true;
+            notFull.notify_all();
+            notEmpty.notify_all();
+        }
+
+    protected:
+        static void addWait(double *aWaited, std::chrono::steady_clock::time_point aStart) {
+            if(aWaited) {
+                std::chrono::duration<double> theTime = std::chrono::steady_clock::now() - aStart;
+                *aWaited += theTime.count();
+            }
+        }
+
+        size_t                  capacity;
+        bool                    closed{false};
+        std::deque<T>           items;
+        std::mutex              mutex;
+        std::condition_variable notFull;
+        std::condition_variable notEmpty;
+    };
+
+    //measures total time spent in a stage thread, busy = total - waits
+    struct StageClock {
+        explicit StageClock(StageStats &aStats) : stats{aStats}, started{std::chrono::steady_clock::now()} {}
+        ~StageClock() {
+            std::chrono::duration<double> theTotal = std::chrono::steady_clock::now() - started;
+            stats.busy = theTotal.count() - stats.waitIn - stats.waitOut;
+        }
+        StageStats &stats;
+        std::chrono::steady_clock::time_point started;
+    };
+
+}
+
+#endif /* Pipeline_hpp */
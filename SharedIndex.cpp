@@ -0,0 +1,281 @@
+//
+//  SharedIndex.cpp
+//
+
+#include "SharedIndex.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <sstream>
+
+namespace ECE141 {
+
+    //ArchiveLock
+    // ----------------------------------------------------------------------------------------------------------
+
+    ArchiveLock::~ArchiveLock() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool ArchiveLock::open(const std::string &aPath) {
+        fd = ::open(aPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+        return fd >= 0;
+    }
+
+    bool ArchiveLock::setLock(bool aLock, bool anExclusive, off_t aByte, bool aWait) {
+        if (fd < 0) return false;
+        struct flock theLock{};
+        theLock.l_type = aLock ? (anExclusive ? F_WRLCK : F_RDLCK) : F_UNLCK;
+        theLock.l_whence = SEEK_SET;
+        theLock.l_start = aByte;
+        theLock.l_len = 1;
+#ifdef F_OFD_SETLKW //owned by this open file, so two Archive objects in one process exclude each other too
+        const int theCommand = aWait ? F_OFD_SETLKW : F_OFD_SETLK;
+#else
+        const int theCommand = aWait ? F_SETLKW : F_SETLK;
+#endif
+        while (::fcntl(fd, theCommand, &theLock) < 0) {
+            if (EINTR != errno) return false;
+        }
+        return true;
+    }
+
+    //SharedIndex
+    // ----------------------------------------------------------------------------------------------------------
+
+    constexpr uint64_t kSharedIndexMagic = 0x4543453134316934; //"ECE141i4"
+
+    struct SharedIndex::Header {
+        uint64_t magic;      //kSharedIndexMagic once the body is complete
+        uint64_t generation;
+        uint64_t fileId;
+        uint64_t device;
+        int64_t  modified;
+        uint64_t blockCount;
+        uint64_t epoch;      //bumped by every full store, a log only makes sense after its own
+        uint64_t entryCount; //records stored whole, in name order
+        uint64_t logCount;   //records logged after them
+        uint64_t bytes;      //size of the whole segment
+    };
+
+    enum SharedRecordKind : uint8_t {kSharedPut = 1, kSharedErase = 2};
+
+    struct __attribute__((packed)) SharedIndexRecord {
+        uint64_t head;
+        uint64_t blocks;
+        uint32_t filesize;
+        uint32_t comp_size;
+        int64_t  dateAdded;
+        uint8_t  flags;
+        uint8_t  kind;
+        char     name[maxFileName];
+    };
+
+    constexpr size_t kHeaderBytes = 4096; //records start on the second page
+    constexpr size_t kMinLogRecords = 1024; //the log may always grow this long before a full store
+
+    static void toRecord(const EntryInfo &anEntry, uint8_t aKind, SharedIndexRecord &aRecord) {
+        memset(&aRecord, 0, sizeof(SharedIndexRecord));
+        strncpy(aRecord.name, anEntry.name.c_str(), maxFileName - 1);
+        aRecord.head = anEntry.head;
+        aRecord.blocks = anEntry.blocks;
+        aRecord.filesize = anEntry.filesize;
+        aRecord.comp_size = anEntry.comp_size;
+        aRecord.dateAdded = anEntry.dateAdded;
+        aRecord.flags = anEntry.flags;
+        aRecord.kind = aKind;
+    }
+
+    static EntryInfo fromRecord(const SharedIndexRecord &aRecord) {
+        EntryInfo theEntry;
+        theEntry.name.assign(aRecord.name, strnlen(aRecord.name, maxFileName));
+        theEntry.head = aRecord.head;
+        theEntry.blocks = aRecord.blocks;
+        theEntry.filesize = aRecord.filesize;
+        theEntry.comp_size = aRecord.comp_size;
+        theEntry.dateAdded = static_cast<time_t>(aRecord.dateAdded);
+        theEntry.flags = aRecord.flags;
+        return theEntry;
+    }
+
+    //aCount records from record anIndex on, mapped from the page they start in
+    class RecordView {
+    public:
+        RecordView(int aFd, size_t anIndex, size_t aCount, int aProtection) {
+            static const size_t thePage = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            const size_t theOffset = kHeaderBytes + anIndex * sizeof(SharedIndexRecord);
+            const size_t theFrom = theOffset / thePage * thePage;
+            length = theOffset + aCount * sizeof(SharedIndexRecord) - theFrom;
+            void *theMap = ::mmap(nullptr, length, aProtection, MAP_SHARED, aFd, static_cast<off_t>(theFrom));
+            if (MAP_FAILED == theMap) return;
+            base = theMap;
+            records = reinterpret_cast<SharedIndexRecord*>(static_cast<char*>(theMap) + (theOffset - theFrom));
+        }
+        ~RecordView() {
+            if (base) ::munmap(base, length);
+        }
+
+        RecordView(const RecordView&) = delete;
+        RecordView& operator=(const RecordView&) = delete;
+
+        SharedIndexRecord *records{nullptr}; //null when the mapping failed
+
+    protected:
+        void  *base{nullptr};
+        size_t length{0};
+    };
+
+    SharedIndex::~SharedIndex() {
+        if (header) ::munmap(header, kHeaderBytes);
+        if (fd >= 0) ::close(fd);
+    }
+
+    std::string SharedIndex::segmentName(const std::string &anArchivePath) {
+        std::error_code theError;
+        auto thePath = std::filesystem::weakly_canonical(std::filesystem::absolute(anArchivePath), theError);
+        std::stringstream theName;
+        theName << "/ece141-arc-" << std::hex << std::hash<std::string>()(thePath.string());
+        return theName.str();
+    }
+
+    bool SharedIndex::attach(const std::string &anArchivePath) {
+        name = segmentName(anArchivePath);
+        fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0660);
+        if (fd < 0) return false;
+
+        struct stat theStat{};
+        if (::fstat(fd, &theStat) || (theStat.st_size < static_cast<off_t>(kHeaderBytes) &&
+                                      ::ftruncate(fd, kHeaderBytes))) { //new segment comes back zeroed (invalid)
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+
+        void *theMap = ::mmap(nullptr, kHeaderBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == theMap) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        header = static_cast<Header*>(theMap);
+        return true;
+    }
+
+    bool SharedIndex::unlink() {
+        return !name.empty() && 0 == ::shm_unlink(name.c_str());
+    }
+
+    uint64_t SharedIndex::generation() const {
+        if (!header || kSharedIndexMagic != __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE)) return 0;
+        return __atomic_load_n(&header->generation, __ATOMIC_ACQUIRE);
+    }
+
+    bool SharedIndex::load(SharedIndexState &aState, EntryIndex &anIndex,
+                           uint64_t aKnownGeneration, const EntryIndex *aKnown) {
+        if (!generation()) return false;
+
+        const size_t theBase = header->entryCount, theLogged = header->logCount;
+        const bool isKnown = aKnown && aKnownGeneration == seen.generation &&
+                             header->epoch == seen.epoch && seen.logged <= theLogged;
+        const size_t theFirst = isKnown ? theBase + seen.logged : 0;
+        const size_t theCount = theBase + theLogged - theFirst;
+        EntryIndex theIndex;
+        if (isKnown) theIndex = *aKnown; //shares its leaves, the log copies only what it touches
+        if (theCount) {
+            RecordView theView(fd, theFirst, theCount, PROT_READ);
+            if (!theView.records) return false;
+            size_t i = 0;
+            if (!isKnown) { //the whole index, already in name order
+                std::vector<EntryInfo> theEntries;
+                theEntries.reserve(theBase);
+                for (; i < theBase; ++i) theEntries.push_back(fromRecord(theView.records[i]));
+                theIndex = EntryIndex::fromSorted(std::move(theEntries));
+            }
+            for (; i < theCount; ++i) {
+                const SharedIndexRecord &theRecord = theView.records[i];
+                if (kSharedErase == theRecord.kind) theIndex.erase(std::string(theRecord.name, strnlen(theRecord.name, maxFileName)));
+                else theIndex.insert(fromRecord(theRecord));
+            }
+        }
+        aState.generation = header->generation;
+        aState.fileId = header->fileId;
+        aState.device = header->device;
+        aState.modified = header->modified;
+        aState.blockCount = header->blockCount;
+        seen = {header->generation, header->epoch, theLogged};
+        anIndex = std::move(theIndex);
+        return true;
+    }
+
+    bool SharedIndex::reserve(size_t aBytes) {
+        struct stat theStat{};
+        return !::fstat(fd, &theStat) && (theStat.st_size >= static_cast<off_t>(aBytes) ||
+                                          !::ftruncate(fd, static_cast<off_t>(aBytes)));
+    }
+
+    uint64_t SharedIndex::commit(const SharedIndexState &aState) {
+        uint64_t theGeneration = std::max(header->generation, aState.generation) + 1;
+        header->fileId = aState.fileId;
+        header->device = aState.device;
+        header->modified = aState.modified;
+        header->blockCount = aState.blockCount;
+        header->bytes = kHeaderBytes + (header->entryCount + header->logCount) * sizeof(SharedIndexRecord);
+        __atomic_store_n(&header->generation, theGeneration, __ATOMIC_RELEASE);
+        __atomic_store_n(&header->magic, kSharedIndexMagic, __ATOMIC_RELEASE);
+        seen = {theGeneration, header->epoch, header->logCount};
+        return theGeneration;
+    }
+
+    uint64_t SharedIndex::store(const SharedIndexState &aState, const EntryIndex &anIndex) {
+        if (!header) return 0;
+
+        //readers treat the cache as empty until the body is complete again
+        __atomic_store_n(&header->magic, 0, __ATOMIC_RELEASE);
+        if (!reserve(kHeaderBytes + anIndex.size() * sizeof(SharedIndexRecord))) return 0;
+        if (anIndex.size()) {
+            RecordView theView(fd, 0, anIndex.size(), PROT_READ | PROT_WRITE);
+            if (!theView.records) return 0;
+            SharedIndexRecord *theRecord = theView.records;
+            anIndex.forEach([&](const EntryInfo &anEntry) {
+                toRecord(anEntry, kSharedPut, *theRecord++);
+                return true;
+            });
+        }
+        header->epoch += 1;
+        header->entryCount = anIndex.size();
+        header->logCount = 0;
+        return commit(aState);
+    }
+
+    uint64_t SharedIndex::store(const SharedIndexState &aState, const EntryIndex &aNext,
+                                const std::vector<EntryInfo> &aPut, const std::vector<std::string> &anErased) {
+        if (!header) return 0;
+        const size_t theCount = aPut.size() + anErased.size();
+        const size_t theLogged = header->logCount + theCount;
+        if (!generation() || generation() != aState.generation || theLogged > std::max<size_t>(kMinLogRecords, header->entryCount))
+            return store(aState, aNext);
+
+        __atomic_store_n(&header->magic, 0, __ATOMIC_RELEASE);
+        const size_t theFirst = header->entryCount + header->logCount;
+        if (!reserve(kHeaderBytes + (theFirst + theCount) * sizeof(SharedIndexRecord))) return 0;
+        if (theCount) {
+            RecordView theView(fd, theFirst, theCount, PROT_READ | PROT_WRITE);
+            if (!theView.records) return 0;
+            SharedIndexRecord *theRecord = theView.records;
+            for (auto &theEntry : aPut) toRecord(theEntry, kSharedPut, *theRecord++);
+            for (auto &theName : anErased) {
+                EntryInfo theErased;
+                theErased.name = theName;
+                toRecord(theErased, kSharedErase, *theRecord++);
+            }
+        }
+        header->logCount = theLogged;
+        return commit(aState);
+    }
+
+}
@@ -0,0 +1,131 @@
+//
+//  SharedIndex.hpp
+//
+//  cross-process coordination: an advisory lock file and a shared-memory copy of the index
+//
+
+#ifndef SharedIndex_hpp
+#define SharedIndex_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "EntryIndex.hpp"
+
+namespace ECE141 {
+
+    //fcntl (open file description) lock on <archive>.lock; writers hold it exclusively,
+    //readers share it while they copy the cached index. the lock file is never replaced,
+    //so it keeps working across compact swapping the archive file itself
+    class ArchiveLock {
+    public:
+        ArchiveLock() = default;
+        ~ArchiveLock();
+
+        ArchiveLock(const ArchiveLock&) = delete;
+        ArchiveLock& operator=(const ArchiveLock&) = delete;
+
+        bool open(const std::string &aPath);
+        bool lockShared()    {return setLock(true, false);}
+        bool lockExclusive() {return setLock(true, true);}
+        bool unlock()        {return setLock(false, false);}
+
+        //every open Archive holds a second byte shared for its whole life; getting it exclusively
+        //(without waiting) proves nobody else has the archive open. markOpen() gives it back
+        bool markOpen()      {return setLock(true, false, kOpenByte);}
+        bool tryOnlyOpener() {return setLock(true, true, kOpenByte, false);}
+
+        //RAII holders
+        struct Shared {
+            explicit Shared(ArchiveLock &aLock) : lock{aLock} {lock.lockShared();}
+            ~Shared() {lock.unlock();}
+            ArchiveLock &lock;
+        };
+        struct Exclusive {
+            explicit Exclusive(ArchiveLock &aLock) : lock{aLock} {lock.lockExclusive();}
+            ~Exclusive() {release();}
+            void release() {
+                if (held) lock.unlock();
+                held = false;
+            }
+            ArchiveLock &lock;
+            bool held{true};
+        };
+
+    protected:
+        static constexpr off_t kWriterByte = 0;
+        static constexpr off_t kOpenByte = 1;
+
+        bool setLock(bool aLock, bool anExclusive, off_t aByte = kWriterByte, bool aWait = true);
+        int fd{-1};
+    };
+
+    //what the cache holds besides the entries. an inode number alone can name a different file
+    //later (a deleted archive's inode is reused), so the device, the file's modification time and
+    //its length in blocks at the commit have to match too
+    struct SharedIndexState {
+        uint64_t generation{0}; //bumped by every commit, in any process
+        uint64_t fileId{0};     //inode of the archive file the index describes
+        uint64_t device{0};     //st_dev of that file
+        int64_t  modified{0};   //its st_mtime in ns, after the commit's writes
+        uint64_t blockCount{0};
+    };
+
+    //POSIX shared memory segment named after the archive path: a small header, one packed record
+    //per entry, then a log of the commits since (put or erase, like the table of contents), so a
+    //commit costs what it changed, not the size of the archive. the whole index is written again
+    //once the log grows as long as it. processes attach to it at open instead of rescanning, and
+    //compare generations to notice another process's commit. all access happens under ArchiveLock,
+    //except generation(), which is a plain atomic read for the fast path. the segment outlives the
+    //processes using it, so the last one to close the archive unlinks it (the table of contents
+    //brings the next opener back quickly)
+    class SharedIndex {
+    public:
+        SharedIndex() = default;
+        ~SharedIndex();
+
+        SharedIndex(const SharedIndex&) = delete;
+        SharedIndex& operator=(const SharedIndex&) = delete;
+
+        bool     attach(const std::string &anArchivePath);
+        bool     isAttached() const {return header != nullptr;}
+        bool     unlink(); //remove the segment's name, those attached keep using it
+        static std::string segmentName(const std::string &anArchivePath); //"/ece141-arc-<hash>"
+        uint64_t generation() const; //0 when the cache holds nothing valid
+
+        //copy the cached index out (shared lock held), false if the cache is empty or stale. when
+        //aKnown (at aKnownGeneration) is what this object last stored or loaded, only the log written
+        //since is replayed onto a copy of it
+        bool     load(SharedIndexState &aState, EntryIndex &anIndex,
+                      uint64_t aKnownGeneration = 0, const EntryIndex *aKnown = nullptr);
+        //replace the cached index (exclusive lock held), returns the new generation
+        uint64_t store(const SharedIndexState &aState, const EntryIndex &anIndex);
+        //one commit on top of generation aState.generation: its changes go on the end of the log.
+        //aNext (the index after the commit) is stored whole when the log is full or the cache moved on
+        uint64_t store(const SharedIndexState &aState, const EntryIndex &aNext,
+                       const std::vector<EntryInfo> &aPut, const std::vector<std::string> &anErased);
+
+    protected:
+        struct Header;
+
+        //where this object's view of the cache stands: the generation, the full store it came from
+        //(epoch) and how much of that store's log it has
+        struct Position {
+            uint64_t generation{0};
+            uint64_t epoch{0};
+            uint64_t logged{0};
+        };
+        Position seen;
+
+        bool     reserve(size_t aBytes); //grow the segment to at least aBytes
+        uint64_t commit(const SharedIndexState &aState); //header after the records, then the new generation
+
+        std::string name;
+        int     fd{-1};
+        Header *header{nullptr}; //first page, mapped for the life of the object
+    };
+
+}
+
+#endif /* SharedIndex_hpp */
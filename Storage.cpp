@@ -0,0 +1,116 @@
+//
+//  Storage.cpp
+//
+
+#include "Storage.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+namespace ECE141 {
+
+    //FileStorage
+    // ----------------------------------------------------------------------------------------------------------
+
+    FileStorage::~FileStorage() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool FileStorage::open(const std::string &aPath, int aFlags) {
+        if (fd >= 0) ::close(fd);
+        fd = ::open(aPath.c_str(), aFlags | O_CLOEXEC, 0644);
+        return fd >= 0;
+    }
+
+    ssize_t FileStorage::read(size_t anOffset, void *aBuffer, size_t aLength) const {
+        return ::pread(fd, aBuffer, aLength, static_cast<off_t>(anOffset));
+    }
+
+    ssize_t FileStorage::write(size_t anOffset, const void *aBuffer, size_t aLength) {
+        return ::pwrite(fd, aBuffer, aLength, static_cast<off_t>(anOffset));
+    }
+
+    size_t FileStorage::size() const {
+        struct stat theStat{};
+        return fd < 0 || ::fstat(fd, &theStat) ? 0 : static_cast<size_t>(theStat.st_size);
+    }
+
+    bool FileStorage::sync() {
+        return fd >= 0 && 0 == ::fdatasync(fd);
+    }
+
+    bool FileStorage::truncate(size_t aSize) {
+        return fd >= 0 && 0 == ::ftruncate(fd, static_cast<off_t>(aSize));
+    }
+
+    void FileStorage::advise(size_t anOffset, size_t aLength, AccessHint aHint) const {
+        static constexpr int theAdvice[] = {POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED};
+        if (fd >= 0) ::posix_fadvise(fd, static_cast<off_t>(anOffset), static_cast<off_t>(aLength), theAdvice[static_cast<int>(aHint)]);
+    }
+
+    uint64_t FileStorage::id() const {
+        struct stat theStat{};
+        if (fd < 0 || ::fstat(fd, &theStat)) return 0;
+        return static_cast<uint64_t>(theStat.st_ino);
+    }
+
+    //MemoryStorage
+    // ----------------------------------------------------------------------------------------------------------
+
+    MemoryStorage::MemoryStorage() {
+        static std::atomic<uint64_t> theNext{1};
+        identity = (uint64_t(1) << 63) | theNext.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ssize_t MemoryStorage::read(size_t anOffset, void *aBuffer, size_t aLength) const {
+        std::shared_lock<std::shared_mutex> theGuard(lock);
+        if (anOffset >= length) return 0;
+        aLength = std::min(aLength, length - anOffset);
+        auto *theBuffer = static_cast<uint8_t*>(aBuffer);
+        for (size_t theDone = 0; theDone < aLength;) {
+            const size_t thePage = (anOffset + theDone) / kPageSize, theInside = (anOffset + theDone) % kPageSize;
+            const size_t theCount = std::min(aLength - theDone, kPageSize - theInside);
+            memcpy(theBuffer + theDone, pages[thePage].get() + theInside, theCount);
+            theDone += theCount;
+        }
+        return static_cast<ssize_t>(aLength);
+    }
+
+    ssize_t MemoryStorage::write(size_t anOffset, const void *aBuffer, size_t aLength) {
+        std::unique_lock<std::shared_mutex> theGuard(lock);
+        const size_t theEnd = anOffset + aLength;
+        while (pages.size() * kPageSize < theEnd) pages.push_back(std::make_unique<uint8_t[]>(kPageSize)); //zeroed
+        const auto *theBuffer = static_cast<const uint8_t*>(aBuffer);
+        for (size_t theDone = 0; theDone < aLength;) {
+            const size_t thePage = (anOffset + theDone) / kPageSize, theInside = (anOffset + theDone) % kPageSize;
+            const size_t theCount = std::min(aLength - theDone, kPageSize - theInside);
+            memcpy(pages[thePage].get() + theInside, theBuffer + theDone, theCount);
+            theDone += theCount;
+        }
+        length = std::max(length, theEnd);
+        return static_cast<ssize_t>(aLength);
+    }
+
+    size_t MemoryStorage::size() const {
+        std::shared_lock<std::shared_mutex> theGuard(lock);
+        return length;
+    }
+
+    //pages past the end go; the rest of the last one is cleared so a later write leaves zeros in the gap.
+    //past length every byte is zero, so growing only has to add pages
+    bool MemoryStorage::truncate(size_t aSize) {
+        std::unique_lock<std::shared_mutex> theGuard(lock);
+        const size_t thePages = (aSize + kPageSize - 1) / kPageSize;
+        pages.resize(std::min(pages.size(), thePages));
+        while (pages.size() < thePages) pages.push_back(std::make_unique<uint8_t[]>(kPageSize));
+        if (aSize % kPageSize && aSize / kPageSize < pages.size())
+            memset(pages[aSize / kPageSize].get() + aSize % kPageSize, 0, kPageSize - aSize % kPageSize);
+        length = aSize;
+        return true;
+    }
+
+}
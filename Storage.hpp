@@ -0,0 +1,90 @@
+//
+//  Storage.hpp
+//
+//  where a BlockFile's bytes live: a file on disk, or pages in memory
+//
+
+#ifndef Storage_hpp
+#define Storage_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace ECE141 {
+
+    enum class StorageKind {file, memory};
+
+    //how a range is about to be used, passed on to the kernel (posix_fadvise) where there is one
+    enum class AccessHint {normal, sequential, willNeed, dontNeed};
+
+    //positional byte storage, no shared cursor. read/write behave like pread/pwrite: they may
+    //move fewer bytes than asked (the caller loops), return 0 at the end and -1 on an error.
+    //any number of threads may read at once
+    class Storage {
+    public:
+        virtual ~Storage() = default;
+
+        virtual ssize_t  read(size_t anOffset, void *aBuffer, size_t aLength) const = 0;
+        virtual ssize_t  write(size_t anOffset, const void *aBuffer, size_t aLength) = 0;
+        virtual size_t   size() const = 0;
+        virtual bool     sync() = 0;
+        virtual bool     truncate(size_t aSize) = 0; //growing reads back as zeros
+        virtual uint64_t id() const = 0;             //names this storage, a replaced file gets a new one
+        virtual int      descriptor() const {return -1;} //for kernel copies, -1 when there is no file
+        virtual void     advise(size_t, size_t, AccessHint) const {} //aLength 0 runs to the end
+    };
+
+    //a file through its descriptor (pread/pwrite/fdatasync)
+    class FileStorage : public Storage {
+    public:
+        FileStorage() = default;
+        ~FileStorage() override;
+
+        FileStorage(const FileStorage&) = delete;
+        FileStorage& operator=(const FileStorage&) = delete;
+
+        bool     open(const std::string &aPath, int aFlags); //open(2) flags, O_CLOEXEC is added
+
+        ssize_t  read(size_t anOffset, void *aBuffer, size_t aLength) const override;
+        ssize_t  write(size_t anOffset, const void *aBuffer, size_t aLength) override;
+        size_t   size() const override;
+        bool     sync() override;
+        bool     truncate(size_t aSize) override;
+        uint64_t id() const override; //inode
+        int      descriptor() const override {return fd;}
+        void     advise(size_t anOffset, size_t aLength, AccessHint aHint) const override;
+
+    protected:
+        int fd{-1};
+    };
+
+    //bytes kept in fixed-size pages that never move, so growing doesn't copy what's there.
+    //nothing reaches the disk: sync has nothing to do and the data goes with the object
+    class MemoryStorage : public Storage {
+    public:
+        static constexpr size_t kPageSize = 256 * 1024;
+
+        MemoryStorage();
+
+        ssize_t  read(size_t anOffset, void *aBuffer, size_t aLength) const override;
+        ssize_t  write(size_t anOffset, const void *aBuffer, size_t aLength) override;
+        size_t   size() const override;
+        bool     sync() override {return true;}
+        bool     truncate(size_t aSize) override;
+        uint64_t id() const override {return identity;}
+
+    protected:
+        mutable std::shared_mutex lock; //readers share it, writers and truncate take it alone
+        std::vector<std::unique_ptr<uint8_t[]>> pages;
+        size_t   length{0};
+        uint64_t identity; //top bit set, never an inode number
+    };
+
+}
+
+#endif /* Storage_hpp */
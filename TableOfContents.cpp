@@ -0,0 +1,175 @@
+//
+//  TableOfContents.cpp
+//
+
+#include "TableOfContents.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <map>
+
+namespace ECE141 {
+
+    constexpr uint64_t kTOCMagic = 0x4543453134317432; //"ECE141t2"
+    constexpr size_t   kTOCSlack = 1024; //dead records tolerated before a rewrite, on top of the live count
+
+    enum TOCKind : uint8_t {kPutRecord = 1, kEraseRecord = 2};
+
+    struct TableOfContents::Header {
+        uint64_t magic;      //kTOCMagic once a rewrite completed
+        uint64_t fileId;     //inode of the archive file described
+        uint64_t blockCount; //archive blocks as of the last rewrite
+        uint64_t pending;    //non-zero while a commit is in flight
+    };
+
+    struct __attribute__((packed)) TableOfContents::Record {
+        uint8_t  kind;
+        char     name[maxFileName];
+        uint64_t head;
+        uint64_t blocks;
+        uint32_t filesize;
+        uint32_t comp_size;
+        int64_t  dateAdded;
+        uint8_t  flags;
+        uint64_t blockCount; //archive blocks after this commit
+        uint32_t checkSum;   //over the fields above, catches a torn append
+    };
+
+    static uint32_t recordSum(const void *aRecord, size_t aLength) { //FNV-1a
+        uint32_t theSum = 2166136261u;
+        auto *theByte = static_cast<const uint8_t*>(aRecord);
+        for (size_t i = 0; i < aLength; i++) theSum = (theSum ^ theByte[i]) * 16777619u;
+        return theSum;
+    }
+
+    template <typename T>
+    static void sealRecord(T &aRecord) {
+        aRecord.checkSum = recordSum(&aRecord, offsetof(T, checkSum));
+    }
+
+    template <typename T>
+    static void fillRecord(T &aRecord, const EntryInfo &anEntry) {
+        memset(&aRecord, 0, sizeof(aRecord));
+        aRecord.kind = kPutRecord;
+        strncpy(aRecord.name, anEntry.name.c_str(), maxFileName - 1);
+        aRecord.head = anEntry.head;
+        aRecord.blocks = anEntry.blocks;
+        aRecord.filesize = anEntry.filesize;
+        aRecord.comp_size = anEntry.comp_size;
+        aRecord.dateAdded = anEntry.dateAdded;
+        aRecord.flags = anEntry.flags;
+    }
+
+    bool TableOfContents::open(const std::string &anArchivePath) {
+        std::string thePath = anArchivePath + ".toc";
+        return file.open(thePath, false) || file.open(thePath, true); //an empty table just reads as stale
+    }
+
+    size_t TableOfContents::recordCount() const {
+        size_t theSize = file.size();
+        return theSize > sizeof(Header) ? (theSize - sizeof(Header)) / sizeof(Record) : 0;
+    }
+
+    bool TableOfContents::load(const BlockFile &aFile, EntryIndex &anIndex, size_t &aBlockCount) const {
+        TRACE_SPAN("toc.load");
+        Header theHeader{};
+        size_t theSize = file.size();
+        if (theSize < sizeof(Header) || (theSize - sizeof(Header)) % sizeof(Record)) return false;
+        if (!file.readAt(0, &theHeader, sizeof(Header)) || kTOCMagic != theHeader.magic ||
+            theHeader.pending || theHeader.fileId != aFile.fileId()) return false;
+
+        //the whole log in one read, then replay it
+        std::vector<Record> theRecords(recordCount());
+        if (!theRecords.empty() && !file.readAt(sizeof(Header), theRecords.data(), theRecords.size() * sizeof(Record)))
+            return false;
+
+        std::map<std::string, EntryInfo> theEntries;
+        size_t theBlocks = theHeader.blockCount;
+        for (auto &theRecord : theRecords) {
+            if (theRecord.checkSum != recordSum(&theRecord, offsetof(Record, checkSum))) return false;
+            std::string theName(theRecord.name, strnlen(theRecord.name, maxFileName));
+            if (kEraseRecord == theRecord.kind) theEntries.erase(theName);
+            else {
+                EntryInfo &theEntry = theEntries[theName];
+                theEntry.name = theName;
+                theEntry.head = theRecord.head;
+                theEntry.blocks = theRecord.blocks;
+                theEntry.filesize = theRecord.filesize;
+                theEntry.comp_size = theRecord.comp_size;
+                theEntry.dateAdded = static_cast<time_t>(theRecord.dateAdded);
+                theEntry.flags = theRecord.flags;
+            }
+            theBlocks = theRecord.blockCount;
+        }
+        if (theBlocks != aFile.blockCount()) return false; //the archive moved on without us
+
+        std::vector<EntryInfo> theSorted;
+        theSorted.reserve(theEntries.size());
+        for (auto &thePair : theEntries) theSorted.push_back(std::move(thePair.second));
+        anIndex = EntryIndex::fromSorted(std::move(theSorted));
+        aBlockCount = theBlocks;
+        return true;
+    }
+
+    bool TableOfContents::setPending(bool aPending) {
+        uint64_t thePending = aPending ? 1 : 0;
+        return file.writeAt(offsetof(Header, pending), &thePending, sizeof(thePending));
+    }
+
+    bool TableOfContents::beginUpdate() {
+        return setPending(true);
+    }
+
+    bool TableOfContents::append(const Record &aRecord, const EntryIndex &aNext, size_t aBlockCount) {
+        Header theHeader{};
+        if (!file.readAt(0, &theHeader, sizeof(Header)) || kTOCMagic != theHeader.magic) return false;
+        if (recordCount() >= 2 * aNext.size() + kTOCSlack)
+            return rewrite(theHeader.fileId, aNext, aBlockCount);
+
+        //pending stays set until the record is down
+        return file.writeAt(sizeof(Header) + recordCount() * sizeof(Record), &aRecord, sizeof(Record)) &&
+               setPending(false);
+    }
+
+    bool TableOfContents::put(const EntryInfo &anEntry, const EntryIndex &aNext, size_t aBlockCount) {
+        TRACE_SPAN("toc.put");
+        Record theRecord;
+        fillRecord(theRecord, anEntry);
+        theRecord.blockCount = aBlockCount;
+        sealRecord(theRecord);
+        return append(theRecord, aNext, aBlockCount);
+    }
+
+    bool TableOfContents::erase(const std::string &aName, const EntryIndex &aNext, size_t aBlockCount) {
+        TRACE_SPAN("toc.erase");
+        Record theRecord;
+        memset(&theRecord, 0, sizeof(theRecord));
+        theRecord.kind = kEraseRecord;
+        strncpy(theRecord.name, aName.c_str(), maxFileName - 1);
+        theRecord.blockCount = aBlockCount;
+        sealRecord(theRecord);
+        return append(theRecord, aNext, aBlockCount);
+    }
+
+    bool TableOfContents::rewrite(uint64_t aFileId, const EntryIndex &anIndex, size_t aBlockCount) {
+        TRACE_SPAN("toc.rewrite");
+        Header theHeader{0, aFileId, aBlockCount, 0}; //invalid until the records are down
+        if (!file.writeAt(0, &theHeader, sizeof(Header)) || !file.truncate(sizeof(Header))) return false;
+
+        std::vector<Record> theRecords(anIndex.size());
+        auto theRecord = theRecords.begin();
+        for (auto &theEntry : anIndex) {
+            fillRecord(*theRecord, theEntry);
+            theRecord->blockCount = aBlockCount;
+            sealRecord(*theRecord);
+            ++theRecord;
+        }
+        if (!theRecords.empty() && !file.writeAt(sizeof(Header), theRecords.data(), theRecords.size() * sizeof(Record)))
+            return false;
+
+        theHeader.magic = kTOCMagic;
+        return file.writeAt(0, &theHeader, sizeof(Header));
+    }
+
+}
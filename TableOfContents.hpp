@@ -0,0 +1,56 @@
+//
+//  TableOfContents.hpp
+//
+//  the entry index persisted next to the archive, so opening it reads one small file
+//  instead of a header from every entry
+//
+
+#ifndef TableOfContents_hpp
+#define TableOfContents_hpp
+
+#include <cstdint>
+#include <string>
+#include "BlockFile.hpp"
+#include "EntryIndex.hpp"
+
+namespace ECE141 {
+
+    //<archive>.toc: a header plus an append-only log of fixed-size records (put or erase),
+    //one per commit. the header names the archive file (inode) it describes, and every record
+    //carries the archive's block count after that commit, so a table that fell behind the
+    //archive (crash, older writer) is spotted and the caller rescans instead.
+    //writers use it under the exclusive ArchiveLock, load() needs at least the shared one
+    class TableOfContents {
+    public:
+        bool open(const std::string &anArchivePath);
+        bool isOpen() const {return file.isOpen();}
+
+        //replay the log into anIndex; false when the table doesn't describe aFile as it is now
+        bool load(const BlockFile &aFile, EntryIndex &anIndex, size_t &aBlockCount) const;
+
+        //mark the table stale until the next put/erase/cancel lands (a crash in between forces a rescan)
+        bool beginUpdate();
+        bool cancelUpdate() {return setPending(false);}
+
+        //log one commit; the whole table is rewritten instead once the log is mostly dead records
+        bool put(const EntryInfo &anEntry, const EntryIndex &aNext, size_t aBlockCount);
+        bool erase(const std::string &aName, const EntryIndex &aNext, size_t aBlockCount);
+
+        //replace the table with anIndex (after a rescan, a new archive or compact)
+        bool rewrite(uint64_t aFileId, const EntryIndex &anIndex, size_t aBlockCount);
+
+        size_t recordCount() const; //records in the log, live or not
+
+    protected:
+        struct Header;
+        struct Record;
+
+        bool append(const Record &aRecord, const EntryIndex &aNext, size_t aBlockCount);
+        bool setPending(bool aPending);
+
+        BlockFile file;
+    };
+
+}
+
+#endif /* TableOfContents_hpp */
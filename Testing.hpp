@@ -11,12 +11,21 @@
 
 #include "Archive.hpp"
 #include "Tracker.hpp"
+#include "LoadGenerator.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <map>
+#include <set>
 #include <filesystem>
 #include <cstring>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
 
 //If you are having trouble with this line make sure you are using C++17
 namespace fs = std::filesystem;
@@ -617,6 +626,10 @@ namespace ECE141 {
                 case ActionType::removed: std::cerr << "remove "; break;
                 case ActionType::listed: std::cerr << "list "; break;
                 case ActionType::dumped: std::cerr << "dump "; break;
+                case ActionType::compacted: std::cerr << "compact "; break;
+                case ActionType::updated: std::cerr << "update "; break;
+                case ActionType::appended: std::cerr << "append "; break;
+                case ActionType::merged: std::cerr << "merge "; break;
             }
             std::cerr << aName << "\n";
         }
@@ -690,6 +703,1672 @@ namespace ECE141 {
             return theResult;
         }
 
+        //-------------------------------------------
+
+        std::string readFile(const std::string& aFullPath) {
+            std::ifstream theFile(aFullPath, std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(theFile), std::istreambuf_iterator<char>());
+        }
+
+        bool doConcurrentTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/concurrenttest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            Compression theCompression;
+            addTestFiles(*theArc, 'A');
+            addTestFiles(*theArc, 'B', &theCompression);
+
+            const size_t theThreadCount = 8;
+            std::atomic<size_t> theFailures{0};
+            std::vector<std::thread> theThreads;
+            for (size_t t = 0; t < theThreadCount; t++) {
+                theThreads.emplace_back([&, t]() {
+                    std::string theOut(folder + "/concurrent" + std::to_string(t) + ".txt");
+                    for (size_t i = 0; i < 20; i++) {
+                        std::string theName = pickRandomFile(i % 2 ? 'A' : 'B');
+                        if (!theArc->extract(theName, theOut).isOK() || !filesMatch(theName, theOut))
+                            theFailures++;
+
+                        std::string theOriginal = readFile(folder + "/" + theName);
+                        size_t theOffset = rand() % theOriginal.size();
+                        std::vector<uint8_t> theRange;
+                        theArc->readRange(theName, theOffset, 100, theRange);
+                        if (theOriginal.substr(theOffset, 100) != std::string(theRange.begin(), theRange.end()))
+                            theFailures++;
+                    }
+                });
+            }
+            for (auto &theThread : theThreads) theThread.join();
+
+            if (theFailures) anOutput << theFailures << " concurrent reads failed\n";
+            return 0 == theFailures;
+        }
+
+        //-------------------------------------------
+
+        bool doSnapshotTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/snapshottest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            addTestFiles(*theArc, 'A');
+
+            //pin a view, then change the archive underneath it
+            ArchiveReader theReader = theArc->openReader();
+            std::string theName = pickRandomFile();
+            theArc->remove(theName);
+            addTestFiles(*theArc, 'B');
+            theArc->compact();
+
+            std::string theOut(folder + "/out.txt");
+            bool theResult = theReader.getCount() == 4 &&
+                             theReader.extract(theName, theOut).isOK() && filesMatch(theName, theOut);
+            if (!theResult) anOutput << "pinned reader lost its version\n";
+
+            ArchiveReader theLatest = theArc->openReader();
+            if (theLatest.getCount() != 7 || theLatest.extract(theName, theOut).isOK() ||
+                theLatest.getVersion() <= theReader.getVersion()) {
+                anOutput << "new reader doesn't see the latest version\n";
+                theResult = false;
+            }
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doMultiProcessTests(std::ostream& anOutput) {
+            std::string thePath(folder + "/multitest");
+            if (!Archive::createArchive(thePath).isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+
+            pid_t thePid = fork();
+            if (0 == thePid) { //child adds its set through its own Archive while the parent adds another
+                auto theArchive = Archive::openArchive(thePath);
+                if (theArchive.isOK()) addTestFiles(*theArchive.getValue(), 'B');
+                _exit(theArchive.isOK() ? 0 : 1);
+            }
+
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::openArchive(thePath);
+            if (thePid < 0 || !theArchive.isOK()) {
+                anOutput << "Failed to open archive\n";
+                return false;
+            }
+            addTestFiles(*theArchive.getValue(), 'A');
+            int theStatus = 0;
+            waitpid(thePid, &theStatus, 0);
+
+            //the parent picks up the child's entries without reopening, and nothing got overwritten
+            std::stringstream theStream;
+            theArchive.getValue()->list(theStream);
+            bool theResult = WIFEXITED(theStatus) && 0 == WEXITSTATUS(theStatus) && verifyAddList(theStream.str());
+            if (!theResult) anOutput << "lists didn't match!\n";
+
+            for (char theChar : {'A', 'B'}) {
+                std::string theName = pickRandomFile(theChar);
+                std::string theOut(folder + "/out.txt");
+                if (!theArchive.getValue()->extract(theName, theOut).isOK() || !filesMatch(theName, theOut)) {
+                    anOutput << "Extracted file doesn't match original.\n";
+                    theResult = false;
+                }
+            }
+
+            //the cached index doesn't describe a file rewritten under the same inode
+            const std::string theOtherPath(folder + "/multiother.arc");
+            {
+                auto theOther = Archive::createArchive(theOtherPath);
+                if (!theOther.isOK()) return false;
+                addTestFile(*theOther.getValue(), "small", 'B');
+            }
+            std::ofstream(thePath + ".arc", std::ios::binary | std::ios::trunc) << readFile(theOtherPath);
+            auto theRewritten = Archive::openArchive(thePath);
+            if (!theRewritten.isOK() || theRewritten.getValue()->openReader().getCount() != 1) {
+                anOutput << "opened a rewritten archive with the old index\n";
+                theResult = false;
+            }
+
+            //the last one to close an archive takes its shared index along
+            const std::string theSegment("/dev/shm" + SharedIndex::segmentName(theOtherPath));
+            if (auto theOther = Archive::openArchive(theOtherPath); theOther.isOK()) {
+                if (!std::filesystem::exists(theSegment)) {
+                    anOutput << "no shared index while the archive is open\n";
+                    theResult = false;
+                }
+            }
+            if (std::filesystem::exists(theSegment)) {
+                anOutput << "shared index left behind after the last close\n";
+                theResult = false;
+            }
+
+            //a commit to a large archive logs its change instead of rewriting every entry, and
+            //another process catches up by replaying the log onto the index it already has
+            const size_t theEntryCount = 200000, theCommits = 100;
+            std::vector<EntryInfo> theEntries(theEntryCount);
+            for (size_t i = 0; i < theEntryCount; ++i) {
+                char theName[32];
+                snprintf(theName, sizeof(theName), "entry%07zu.txt", i);
+                theEntries[i].name = theName;
+                theEntries[i].head = i;
+            }
+            EntryIndex theIndex = EntryIndex::fromSorted(std::move(theEntries));
+            SharedIndex theWriter, theReader;
+            if (!theWriter.attach(folder + "/bigindex.arc") || !theReader.attach(folder + "/bigindex.arc")) return false;
+            SharedIndexState theState;
+            Timer theFull;
+            theState.generation = theWriter.store(theState, theIndex);
+            theFull.stop();
+            EntryIndex theSeen;
+            SharedIndexState theSeenState;
+            theReader.load(theSeenState, theSeen);
+
+            Timer theLogged;
+            for (size_t i = 0; i < theCommits; ++i) {
+                EntryInfo theEntry;
+                theEntry.name = "new" + std::to_string(i) + ".txt";
+                const std::string theGone = theIndex.begin()->name;
+                theIndex.insert(theEntry);
+                theIndex.erase(theGone);
+                theState.generation = theWriter.store(theState, theIndex, {theEntry}, {theGone});
+            }
+            theLogged.stop();
+            Timer theCatchUp;
+            EntryIndex theCaughtUp;
+            bool isLoaded = theReader.load(theSeenState, theCaughtUp, theSeenState.generation, &theSeen);
+            theCatchUp.stop();
+            anOutput << "shared index of " << theEntryCount << " entries: stored in " << theFull.elapsed() * 1e3
+                     << "ms, a commit logged in " << theLogged.elapsed() / theCommits * 1e6 << "us, caught up on "
+                     << theCommits << " commits in " << theCatchUp.elapsed() * 1e3 << "ms\n";
+            if (!isLoaded || theCaughtUp.size() != theIndex.size() || !theCaughtUp.find("new99.txt") ||
+                theCaughtUp.find("entry0000099.txt") || !theCaughtUp.find("entry0000100.txt")) {
+                anOutput << "the logged commits didn't come across\n";
+                theResult = false;
+            }
+            if (theLogged.elapsed() / theCommits * 10 > theFull.elapsed()) {
+                anOutput << "a commit cost more than a tenth of storing the whole index\n";
+                theResult = false;
+            }
+            theWriter.unlink();
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doLoadTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/loadtest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+
+            LoadConfig theConfig;
+            theConfig.fileCount = 200;
+            theConfig.threads = 4;
+            theConfig.maxOps = 2000;
+            theConfig.duration = 60;
+            theConfig.minSize = 512;
+            theConfig.maxSize = 8192;
+            theConfig.logSizes = true;
+            theConfig.compress = rand() % 2;
+
+            LoadGenerator theLoad(*theArchive.getValue(), folder, theConfig);
+            bool theResult = theLoad.run();
+            if (!theResult) anOutput << theLoad.getFailures() << " ops failed under load\n";
+
+            //what's left in the archive is exactly what the workers think they left there
+            std::stringstream theStream;
+            theArchive.getValue()->list(theStream);
+            size_t theLines = std::count(std::istreambuf_iterator<char>(theStream), std::istreambuf_iterator<char>(), '\n');
+            if (theLines != theLoad.getLive() + 2) {
+                anOutput << "archive holds " << theLines - 2 << " entries, expected " << theLoad.getLive() << "\n";
+                theResult = false;
+            }
+            theLoad.report(anOutput);
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doMetricsTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/metricstest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            auto theMetrics = std::make_shared<MetricsObserver>();
+            theArc->addObserver(theMetrics);
+
+            Compression theCompression;
+            addTestFiles(*theArc, 'A');
+            addTestFiles(*theArc, 'B', &theCompression);
+            std::string theName = pickRandomFile('B');
+            theArc->extract(theName, folder + "/out.txt");
+            theArc->extract("missing.txt", folder + "/out.txt");
+            theArc->remove(pickRandomFile('A'));
+            theArc->compact();
+
+            //adds saw every source byte, wrote whole blocks, and compression paid off for 'B'
+            size_t theSourceBytes = 0;
+            for (const char *theFile : {"small", "medium", "large", "Xlarge"}) {
+                for (char theChar : {'A', 'B'}) theSourceBytes += getFileSize(folder + "/" + theFile + theChar + ".txt");
+            }
+            auto &theAdds = theMetrics->getTotals(ActionType::added);
+            auto &theExtracts = theMetrics->getTotals(ActionType::extracted);
+            bool theResult = theAdds.succeeded == 8 && theAdds.bytesIn == theSourceBytes &&
+                             theAdds.blocksWritten > 0 && theAdds.bytesOut >= theAdds.storedBytes &&
+                             theAdds.rawBytes > theAdds.storedBytes && theAdds.latency.count() == 8;
+            if (!theResult) anOutput << "add metrics are off\n";
+
+            if (theExtracts.succeeded != 1 || theExtracts.failed != 1 ||
+                theExtracts.bytesOut != getFileSize(folder + "/" + theName) || !theExtracts.blocksRead) {
+                anOutput << "extract metrics are off\n";
+                theResult = false;
+            }
+            if (theMetrics->getTotals(ActionType::compacted).blocksWritten == 0) {
+                anOutput << "compact metrics are off\n";
+                theResult = false;
+            }
+
+            std::string thePath(folder + "/metrics.prom");
+            std::string theText = theMetrics->dumpTo(thePath) ? readFile(thePath) : "";
+            if (theText.find("archive_operations_total{op=\"add\",status=\"ok\"} 8\n") == std::string::npos ||
+                theText.find("archive_operation_seconds_bucket{op=\"add\",le=\"+Inf\"} 8\n") == std::string::npos) {
+                anOutput << "prometheus dump is missing samples\n";
+                theResult = false;
+            }
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doTraceTests(std::ostream& anOutput) {
+            if (!Tracer::kCompiledIn) {
+                anOutput << "built without ARCHIVE_TRACING, nothing to check\n";
+                return true;
+            }
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/tracetest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            Compression theCompression;
+
+            Tracer::clear();
+            Tracer::enable(true);
+            addTestFiles(*theArc, 'A', &theCompression);
+            theArc->extract("XlargeA.txt", folder + "/out.txt");
+            theArc->remove(pickRandomFile('A'));
+            std::stringstream theList;
+            theArc->list(theList);
+            theArc->compact();
+            Tracer::enable(false);
+
+            std::string thePath(folder + "/trace.json");
+            std::string theTrace = Tracer::writeChromeTrace(thePath) ? readFile(thePath) : "";
+            bool theResult = 0 == theTrace.find("{\"displayTimeUnit\"");
+            for (const char *theSpan : {"add", "add.source", "process", "add.meta", "pwrite", "add.index",
+                                        "extract", "pread", "reverse process", "extract.output",
+                                        "remove", "remove.index", "list", "compact", "compact.copy", "compact.index"}) {
+                if (theTrace.find(std::string("\"name\": \"") + theSpan + "\"") == std::string::npos) {
+                    anOutput << "no \"" << theSpan << "\" span in the trace\n";
+                    theResult = false;
+                }
+            }
+
+            //threads that come and go one after another reuse rings, and their spans are all kept
+            Tracer::clear();
+            Tracer::enable(true);
+            const size_t theThreadCount = 32;
+            for (size_t t = 0; t < theThreadCount; t++) std::thread([]() {TRACE_SPAN("trace.thread");}).join();
+            Tracer::enable(false);
+            std::stringstream theThreadTrace;
+            Tracer::writeChromeTrace(theThreadTrace);
+            std::set<std::string> theTids;
+            size_t theSpans = 0;
+            for (std::string theLine; std::getline(theThreadTrace, theLine);) {
+                if (theLine.find("\"trace.thread\"") == std::string::npos) continue;
+                ++theSpans;
+                theTids.insert(theLine.substr(theLine.find("\"tid\"")));
+            }
+            if (theSpans != theThreadCount || theTids.size() > 4) { //other threads may be handing rings back too
+                anOutput << theSpans << " spans from " << theThreadCount << " threads in "
+                         << theTids.size() << " rings\n";
+                theResult = false;
+            }
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doTrackerTests(std::ostream& anOutput) {
+            auto& theTracker = Tracker::instance();
+            theTracker.enable(true).reset();
+            bool theResult = true;
+
+            //threads allocating and freeing each other's memory leave nothing behind
+            {
+                OperationScope theScope("tracker test");
+                const size_t theThreadCount = 8, theCount = 10000;
+                std::vector<std::vector<char*>> thePointers(theThreadCount);
+                std::vector<std::thread> theThreads;
+                for (size_t t = 0; t < theThreadCount; t++) {
+                    theThreads.emplace_back([&, t]() {
+                        OperationScope theThreadScope("tracker test");
+                        for (size_t i = 0; i < theCount; i++) thePointers[t].push_back(new char[1 + i % 256]);
+                    });
+                }
+                for (auto &theThread : theThreads) theThread.join();
+                theThreads.clear();
+                for (size_t t = 0; t < theThreadCount; t++) {
+                    theThreads.emplace_back([&, t]() { //free another thread's allocations
+                        for (auto thePtr : thePointers[(t + 1) % theThreadCount]) delete [] thePtr;
+                    });
+                }
+                for (auto &theThread : theThreads) theThread.join();
+                theThreads.clear();
+                thePointers.clear();
+                thePointers.shrink_to_fit();
+
+                auto *theTotals = theTracker.operationTotals("tracker test");
+                if (!theTotals || theTotals->count < theThreadCount * theCount || theTotals->live > 4096) {
+                    anOutput << "cross-thread allocations weren't accounted for\n";
+                    theResult = false;
+                }
+            }
+
+            //archive operations get charged for what they allocate
+            {
+                ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/trackertest");
+                if (!theArchive.isOK()) {
+                    anOutput << "Failed to create archive\n";
+                    return false;
+                }
+                addTestFiles(*theArchive.getValue());
+                theArchive.getValue()->extract(pickRandomFile(), folder + "/out.txt");
+            }
+            for (const char *theOp : {"add", "extract"}) {
+                auto *theTotals = theTracker.operationTotals(theOp);
+                if (!theTotals || !theTotals->count || !theTotals->peak) {
+                    anOutput << "no allocations recorded for " << theOp << "\n";
+                    theResult = false;
+                }
+            }
+
+            //watched pointers still report where they came from
+            int *theWatched = GPS(new int(141));
+            std::stringstream theLeaks;
+            theTracker.reportLeaks(theLeaks);
+            if (theLeaks.str().find("Testing.hpp(") == std::string::npos) {
+                anOutput << "watched allocation missing from the leak report\n";
+                theResult = false;
+            }
+            delete theWatched;
+
+            theTracker.reportOperations(anOutput);
+            theTracker.reportSites(anOutput, 10);
+            theTracker.enable(false);
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doCountersTests(std::ostream& anOutput) {
+            bool theResult = true;
+
+            //calibration: a 20ms sleep should read back as roughly 20ms
+            Archive::resetHotCounters();
+            {
+                ScopedTimer theTimer(HotCounter::fileSync);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            auto theSleep = Archive::getHotCounters()[static_cast<size_t>(HotCounter::fileSync)];
+            if (1 != theSleep.calls || theSleep.nanos < 19e6 || theSleep.nanos > 200e6) {
+                anOutput << "scoped timer measured " << theSleep.nanos << "ns for a 20ms sleep\n";
+                theResult = false;
+            }
+
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/counterstest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            Compression theCompression;
+            Archive::resetHotCounters();
+            addTestFiles(*theArc, 'A', &theCompression);
+            theArc->extract("XlargeA.txt", folder + "/out.txt");
+
+            //the pipeline's worker threads count too
+            for (auto &theValue : Archive::getHotCounters()) {
+                anOutput << theValue.name << ": " << theValue.calls << " calls, " << theValue.nanos << "ns\n";
+                bool isSync = 0 == std::string(theValue.name).compare("fileSync");
+                if (!isSync && (!theValue.calls || theValue.nanos <= 0)) {
+                    anOutput << "nothing counted for " << theValue.name << "\n";
+                    theResult = false;
+                }
+            }
+            //a thread's counts outlive it
+            Archive::resetHotCounters();
+            const size_t theThreadCount = 16;
+            for (size_t t = 0; t < theThreadCount; t++)
+                std::thread([]() {HotCounters::add(HotCounter::checksum, 1);}).join();
+            if (Archive::getHotCounters()[static_cast<size_t>(HotCounter::checksum)].calls != theThreadCount) {
+                anOutput << "finished threads' counts went missing\n";
+                theResult = false;
+            }
+
+            Archive::resetHotCounters();
+            if (Archive::getHotCounters()[static_cast<size_t>(HotCounter::compress)].calls) {
+                anOutput << "reset didn't clear the counters\n";
+                theResult = false;
+            }
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doTOCTests(std::ostream& anOutput) {
+            const std::string thePath = folder + "/toctest.arc";
+            {
+                ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(thePath);
+                if (!theArchive.isOK()) {
+                    anOutput << "Failed to create archive\n";
+                    return false;
+                }
+                auto theArc = theArchive.getValue();
+                addTestFiles(*theArc, 'A');
+                addTestFiles(*theArc, 'B');
+                theArc->remove(pickRandomFile('A'));
+                theArc->add(folder + "/XlargeB.txt"); //replaces the older copy
+            }
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::openArchive(thePath);
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to open archive\n";
+                return false;
+            }
+            ArchiveReader theReader = theArchive.getValue()->openReader();
+
+            //the iterator streams every entry once, in name order
+            bool theResult = true;
+            size_t theCount = 0;
+            std::string thePrevious;
+            for (auto &theEntry : theReader) {
+                if (theCount++ && theEntry.name <= thePrevious) theResult = false;
+                thePrevious = theEntry.name;
+            }
+            if (!theResult || theCount != theReader.getCount() || theCount != 7) {
+                anOutput << "iterator walked " << theCount << " entries out of order or short\n";
+                theResult = false;
+            }
+
+            //the table replays to the same index the archive has
+            TableOfContents theTOC;
+            BlockFile theFile;
+            EntryIndex theIndex;
+            size_t theBlocks = 0;
+            if (!theTOC.open(thePath) || !theFile.open(thePath, false) || !theTOC.load(theFile, theIndex, theBlocks)) {
+                anOutput << "table of contents didn't load\n";
+                return false;
+            }
+            auto theEntry = theReader.begin();
+            for (auto &theLoaded : theIndex) {
+                if (theEntry == theReader.end() || theLoaded.name != theEntry->name || theLoaded.head != theEntry->head ||
+                    theLoaded.blocks != theEntry->blocks || theLoaded.filesize != theEntry->filesize) {
+                    anOutput << "table of contents disagrees about " << theLoaded.name << "\n";
+                    theResult = false;
+                    break;
+                }
+                ++theEntry;
+            }
+            if (theIndex.size() != theCount || theBlocks != theFile.blockCount()) {
+                anOutput << "table of contents has " << theIndex.size() << " entries, " << theBlocks << " blocks\n";
+                theResult = false;
+            }
+
+            //a table that fell behind the archive is refused, so open rescans instead
+            Chunk theStray;
+            theFile.writeBlock(theFile.blockCount(), theStray);
+            if (theTOC.load(theFile, theIndex, theBlocks)) {
+                anOutput << "stale table of contents was accepted\n";
+                theResult = false;
+            }
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doPrefixTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/prefixtest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+
+            //enough names to span several index leaves
+            const std::string theSource = folder + "/prefix";
+            fs::create_directories(theSource);
+            size_t theSeptember = 0, theOctober = 0;
+            for (size_t i = 0; i < 300; i++) {
+                std::string theName = (i % 3 ? "log-2026-10-" : "log-2026-09-") + std::to_string(i) + ".txt";
+                if (0 == i % 5) theName = "misc-" + std::to_string(i) + ".txt";
+                else if (i % 3) theOctober++;
+                else theSeptember++;
+                std::ofstream(theSource + "/" + theName) << theName;
+                theArc->add(theSource + "/" + theName);
+            }
+
+            bool theResult = true;
+            ArchiveReader theReader = theArc->openReader();
+            size_t theCount = 0;
+            for (auto &theEntry : theReader.withPrefix("log-2026-10-")) {
+                if (0 != theEntry.name.rfind("log-2026-10-", 0)) theResult = false;
+                theCount++;
+            }
+            if (!theResult || theCount != theOctober) {
+                anOutput << "prefix scan found " << theCount << " names, expected " << theOctober << "\n";
+                theResult = false;
+            }
+            theCount = std::distance(theReader.range("log-2026-09-", "log-2026-10-").begin(),
+                                     theReader.range("log-2026-09-", "log-2026-10-").end());
+            if (theCount != theSeptember || !theReader.withPrefix("nope").empty() ||
+                theReader.withPrefix("log-2026-09-3.txt").empty()) {
+                anOutput << "range scan found " << theCount << " names, expected " << theSeptember << "\n";
+                theResult = false;
+            }
+
+            std::stringstream theList;
+            theArc->list(theList, "log-2026-10-");
+            size_t theLines = std::count(std::istreambuf_iterator<char>(theList), std::istreambuf_iterator<char>(), '\n');
+            if (theLines != theOctober + 2) {
+                anOutput << "prefix list has " << theLines - 2 << " entries\n";
+                theResult = false;
+            }
+
+            const std::string theOut = folder + "/prefixout";
+            fs::remove_all(theOut);
+            fs::create_directories(theOut);
+            auto theExtracted = theArc->extractPrefix("log-2026-09-", theOut);
+            if (!theExtracted.isOK() || theExtracted.getValue() != theSeptember ||
+                !filesMatch("prefix/log-2026-09-3.txt", theOut + "/log-2026-09-3.txt")) {
+                anOutput << "prefix extract didn't produce the september files\n";
+                theResult = false;
+            }
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doBloomTests(std::ostream& anOutput) {
+            bool theResult = true;
+
+            //no false negatives, and false positives near the design rate
+            NameFilter theFilter(10000);
+            for (size_t i = 0; i < 10000; i++) theFilter.add("in-" + std::to_string(i));
+            size_t theMisses = 0, thePositives = 0;
+            for (size_t i = 0; i < 10000; i++) {
+                if (!theFilter.mayContain("in-" + std::to_string(i))) theMisses++;
+                if (theFilter.mayContain("out-" + std::to_string(i))) thePositives++;
+            }
+            if (theMisses || thePositives > 300) {
+                anOutput << theMisses << " names lost, " << thePositives << " false positives in 10000\n";
+                theResult = false;
+            }
+
+            //a miss through the archive is answered without any I/O
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/bloomtest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            addTestFiles(*theArc, 'A');
+            theArc->remove("smallA.txt");
+            Archive::resetHotCounters();
+            auto theExtract = theArc->extract("missing.txt", folder + "/out.txt");
+            auto theRemove = theArc->remove("smallA.txt");
+            auto theReads = Archive::getHotCounters()[static_cast<size_t>(HotCounter::fileRead)].calls;
+            if (theExtract.isOK() || ArchiveErrors::fileNotFound != theExtract.getError() ||
+                theRemove.isOK() || ArchiveErrors::fileNotFound != theRemove.getError() || theReads) {
+                anOutput << "missing names weren't turned away cheaply (" << theReads << " reads)\n";
+                theResult = false;
+            }
+            if (!theArc->extract("mediumA.txt", folder + "/out.txt").isOK()) {
+                anOutput << "filter turned away a name that is there\n";
+                theResult = false;
+            }
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doHashTests(std::ostream& anOutput) {
+            bool theResult = true;
+
+            //the header hash is stable from call to call, however long the names
+            std::string theLong(60, 'x');
+            uint16_t theFirst = Chunk::calc_hash(theLong);
+            for (size_t i = 0; i < 10; i++) Chunk::calc_hash(theLong + std::to_string(i));
+            if (theFirst != Chunk::calc_hash(theLong) || Chunk::calc_hash(theLong + "a") == Chunk::calc_hash(theLong + "b")) {
+                anOutput << "calc_hash isn't a function of the name\n";
+                theResult = false;
+            }
+
+            //every length path (0-3, 4-16, 17-48, >48 bytes) sees every byte
+            std::set<uint64_t> theHashes;
+            std::string theName;
+            for (size_t i = 0; i < 100; i++) {
+                theHashes.insert(hashName(theName));
+                std::string theFlipped(theName + "a");
+                for (size_t j = 0; j < theName.size(); j++) {
+                    theFlipped[j] ^= 1;
+                    theHashes.insert(hashName(theFlipped));
+                    theFlipped[j] ^= 1;
+                }
+                theName += static_cast<char>('a' + i % 26);
+            }
+            if (theHashes.size() != 100 + 99 * 100 / 2) {
+                anOutput << "hashName collided on " << 100 + 99 * 100 / 2 - theHashes.size() << " near-identical names\n";
+                theResult = false;
+            }
+
+            //16-bit header hashes spread like random ones (~9270 distinct out of 10000)
+            std::set<uint16_t> theShort;
+            for (size_t i = 0; i < 10000; i++) theShort.insert(Chunk::calc_hash("file-" + std::to_string(i) + ".txt"));
+            if (theShort.size() < 9000) {
+                anOutput << "only " << theShort.size() << " distinct header hashes for 10000 names\n";
+                theResult = false;
+            }
+
+            //lookups through the packed hashes find every name and nothing else
+            std::vector<EntryInfo> theEntries;
+            for (size_t i = 0; i < 1000; i++) {
+                theEntries.emplace_back();
+                theEntries.back().name = "entry-" + std::to_string(i);
+                theEntries.back().head = i;
+            }
+            std::sort(theEntries.begin(), theEntries.end(), [](const EntryInfo &a, const EntryInfo &b) {return a.name < b.name;});
+            EntryIndex theIndex = EntryIndex::fromSorted(std::move(theEntries));
+            for (size_t i = 0; i < 1000 && theResult; i++) {
+                const EntryInfo *theEntry = theIndex.find("entry-" + std::to_string(i));
+                if (!theEntry || theEntry->head != i || theIndex.find("entry+" + std::to_string(i))) {
+                    anOutput << "index lookup failed for entry-" << i << "\n";
+                    theResult = false;
+                }
+            }
+            return theResult;
+        }
+
+        //-------------------------------------------
+
+        bool doCacheTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/cachetest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            Compression theCompression;
+            addTestFile(*theArc, "Xlarge", 'A', &theCompression);
+            addTestFile(*theArc, "Xlarge", 'B');
+            bool theResult = true;
+
+            //the first read fills the cache, the second is served from it
+            auto theExtractTwice = [&](const char *aName) {
+                Archive::resetHotCounters();
+                bool isOK = theArc->extract(aName, folder + "/out.txt").isOK() && filesMatch(aName, folder + "/out.txt");
+                auto theFirst = Archive::getHotCounters();
+                Archive::resetHotCounters();
+                isOK = isOK && theArc->extract(aName, folder + "/out.txt").isOK() && filesMatch(aName, folder + "/out.txt");
+                auto theSecond = Archive::getHotCounters();
+                const size_t theRead = static_cast<size_t>(HotCounter::fileRead);
+                const size_t theDecode = static_cast<size_t>(HotCounter::decompress);
+                if (!isOK || !theFirst[theRead].calls || theSecond[theRead].calls || theSecond[theDecode].calls) {
+                    anOutput << aName << ": second extract did " << theSecond[theRead].calls << " reads, "
+                             << theSecond[theDecode].calls << " decompressions\n";
+                    return false;
+                }
+                return true;
+            };
+            theResult = theExtractTwice("XlargeA.txt") && theExtractTwice("XlargeB.txt");
+            auto theStats = theArc->getCacheStats();
+            if (!theStats.hits || !theStats.misses || !theStats.bytes) {
+                anOutput << "cache reports " << theStats.hits << " hits, " << theStats.misses << " misses\n";
+                theResult = false;
+            }
+
+            //only the leading frames cached: the rest is read from the middle of the entry
+            theArc->setCacheBudget(0);
+            theArc->setCacheBudget(FrameCache::kDefaultBudget);
+            std::vector<uint8_t> theRange;
+            std::string theSource = readFile(folder + "/XlargeA.txt");
+            if (!theArc->readRange("XlargeA.txt", 70000, 100, theRange).isOK() ||
+                std::string(theRange.begin(), theRange.end()) != theSource.substr(70000, 100) ||
+                !theArc->extract("XlargeA.txt", folder + "/out.txt").isOK() || !filesMatch("XlargeA.txt", folder + "/out.txt")) {
+                anOutput << "extract after a partial read didn't match\n";
+                theResult = false;
+            }
+
+            //past the end, though still inside the first segment (or frame), there is nothing to read
+            std::istringstream theShort(std::string(1000, 's'));
+            theArc->add("short.txt", theShort);
+            for (const char *theName : {"short.txt", "XlargeA.txt", "XlargeB.txt"}) {
+                auto theRead = theArc->readRange(theName, "short.txt" == std::string(theName) ? 5000 : 300000, 100, theRange);
+                if (!theRead.isOK() || theRead.getValue() || !theRange.empty()) {
+                    anOutput << theName << ": a read past the end returned data\n";
+                    theResult = false;
+                }
+            }
+
+            //a small budget evicts instead of growing
+            theArc->setCacheBudget(64 * 1024);
+            theArc->extract("XlargeA.txt", folder + "/out.txt");
+            theArc->extract("XlargeB.txt", folder + "/out.txt");
+            theStats = theArc->getCacheStats();
+            if (theStats.bytes > 64 * 1024 || !theStats.evictions) {
+                anOutput << "cache holds " << theStats.bytes << " bytes over a 64K budget\n";
+                theResult = false;
+            }
+
+            //compact frees the old file's inode and the next compact may get it back: the cache
+            //must not hand out what it held for the first file
+            theArc->setCacheBudget(FrameCache::kDefaultBudget);
+            std::vector<uint8_t> theBuffer;
+            std::ofstream(folder + "/reused.txt", std::ios::binary | std::ios::trunc) << std::string(5000, 'A');
+            theArc->add(folder + "/reused.txt");
+            theArc->extract("reused.txt", theBuffer);
+            theArc->compact();
+            theArc->remove("reused.txt");
+            std::ofstream(folder + "/reused.txt", std::ios::binary | std::ios::trunc) << std::string(5000, 'B');
+            theArc->add(folder + "/reused.txt");
+            theArc->compact();
+            if (!theArc->extract("reused.txt", theBuffer).isOK() || std::string(theBuffer.begin(), theBuffer.end()) != std::string(5000, 'B')) {
+                anOutput << "extract after two compacts returned stale data\n";
+                theResult = false;
+            }
+            return theResult;
+        }
+
+        bool doUpdateTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/updatetest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            Compression theCompression;
+            addTestFile(*theArc, "Xlarge", 'B', &theCompression);
+            addTestFile(*theArc, "Xlarge", 'A');
+            addTestFile(*theArc, "small", 'A');
+            const std::string theArcPath = folder + "/updatetest.arc";
+            const std::string theNewPath = folder + "/update.txt";
+            const std::string theOriginal = readFile(folder + "/XlargeA.txt");
+
+            auto theUpdate = [&](const char *aName, const std::string &aContent, IDataProcessor *aProcessor = nullptr) {
+                std::ofstream(theNewPath, std::ios::binary | std::ios::trunc) << aContent;
+                auto theWritten = theArc->update(aName, theNewPath, aProcessor);
+                return theWritten.isOK() ? theWritten.getValue() : size_t(0);
+            };
+            auto theMatches = [&](const char *aName, const std::string &aContent, const char *aStep) {
+                bool isOK = theArc->extract(aName, folder + "/out.txt").isOK() && readFile(folder + "/out.txt") == aContent;
+                if (!isOK) anOutput << aStep << ": " << aName << " didn't match\n";
+                return isOK;
+            };
+            auto theBlocks = [&](const char *aName) {
+                ArchiveReader theReader = theArc->openReader();
+                for (auto &theEntry : theReader) if (theEntry.name == aName) return theEntry.blocks;
+                return size_t(0);
+            };
+
+            //a few bytes changed in one block: the head and that block are all that is written
+            std::string theEdited = theOriginal;
+            theEdited.replace(100000, 5, "EDIT!");
+            size_t theSize = getFileSize(theArcPath);
+            size_t theWritten = theUpdate("XlargeA.txt", theEdited);
+            bool theResult = theMatches("XlargeA.txt", theEdited, "edit") && theMatches("smallA.txt", readFile(folder + "/smallA.txt"), "edit");
+            if (2 != theWritten || getFileSize(theArcPath) != theSize) {
+                anOutput << "edit wrote " << theWritten << " blocks\n";
+                theResult = false;
+            }
+            if (1 != (theWritten = theUpdate("XlargeA.txt", theEdited))) {
+                anOutput << "unchanged content wrote " << theWritten << " blocks\n";
+                theResult = false;
+            }
+
+            //shorter: the tail is freed where it is; longer, up to the next entry, grows into it
+            std::string theShort = theEdited.substr(0, 50000);
+            theResult = theUpdate("XlargeA.txt", theShort) && theMatches("XlargeA.txt", theShort, "shrink") && theResult;
+            std::string theLonger = theEdited.substr(0, 200000);
+            theResult = theUpdate("XlargeA.txt", theLonger) && theMatches("XlargeA.txt", theLonger, "grow") && theResult;
+            if (getFileSize(theArcPath) != theSize) {
+                anOutput << "in place updates changed the archive size\n";
+                theResult = false;
+            }
+
+            //no room behind it: relocated to the end. once last, it grows by just the difference
+            std::string theDouble = theOriginal + theOriginal;
+            theResult = theUpdate("XlargeA.txt", theDouble) && theMatches("XlargeA.txt", theDouble, "relocate") && theResult;
+            theSize = getFileSize(theArcPath);
+            std::string theMore = theDouble + std::string(5000, 'x');
+            const size_t theBefore = theBlocks("XlargeA.txt");
+            theResult = theUpdate("XlargeA.txt", theMore) && theMatches("XlargeA.txt", theMore, "append") && theResult;
+            if (getFileSize(theArcPath) != theSize + (theBlocks("XlargeA.txt") - theBefore) * kChunkSize) {
+                anOutput << "last entry didn't grow in place\n";
+                theResult = false;
+            }
+
+            //a reader holding a version keeps seeing it; the update goes elsewhere
+            {
+                ArchiveReader theReader = theArc->openReader();
+                theResult = theUpdate("XlargeA.txt", theOriginal) && theResult;
+                std::vector<uint8_t> theRange;
+                if (!theReader.readRange("XlargeA.txt", 0, theMore.size(), theRange).isOK() ||
+                    std::string(theRange.begin(), theRange.end()) != theMore) {
+                    anOutput << "pinned reader saw the update\n";
+                    theResult = false;
+                }
+            }
+            theResult = theMatches("XlargeA.txt", theOriginal, "pinned") && theResult;
+
+            //processed entries compare stored blocks: frames before the edit stay as they are
+            std::string theCompressed = readFile(folder + "/XlargeB.txt");
+            theCompressed.replace(200000, 5, "EDIT!");
+            theWritten = theUpdate("XlargeB.txt", theCompressed, &theCompression);
+            theResult = theMatches("XlargeB.txt", theCompressed, "compressed") && theResult;
+            if (!theWritten || theWritten >= theBlocks("XlargeB.txt")) {
+                anOutput << "compressed edit wrote " << theWritten << " of " << theBlocks("XlargeB.txt") << " blocks\n";
+                theResult = false;
+            }
+
+            if (theArc->update("missing.txt", theNewPath).getError() != ArchiveErrors::fileNotFound) {
+                anOutput << "update of a missing entry didn't fail\n";
+                theResult = false;
+            }
+
+            //what was rewritten in place survives a reopen
+            theArc.reset();
+            auto theReopened = Archive::openArchive(folder + "/updatetest");
+            if (!theReopened.isOK()) return false;
+            theArc = theReopened.getValue();
+            return theMatches("XlargeA.txt", theOriginal, "reopen") && theMatches("XlargeB.txt", theCompressed, "reopen") &&
+                   theMatches("smallA.txt", readFile(folder + "/smallA.txt"), "reopen") && theResult;
+        }
+
+        bool doAppendTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/appendtest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            Compression theCompression;
+            addTestFile(*theArc, "small", 'A');
+            addTestFile(*theArc, "Xlarge", 'B', &theCompression);
+            addTestFile(*theArc, "medium", 'A');
+            std::map<std::string, std::string> theContents;
+            for (auto theName : {"smallA.txt", "XlargeB.txt", "mediumA.txt"}) theContents[theName] = readFile(folder + "/" + theName);
+
+            //appends a line and returns the archive bytes written and read for it
+            size_t theLine = 0;
+            auto theAppend = [&](const std::string &aName, size_t aSize, size_t &aRead) {
+                ++theLine;
+                std::string theText = "line " + std::to_string(theLine) + ": " + std::string(aSize, 'a' + theLine % 26) + "\n";
+                const IOStats theStart = BlockFile::threadStats();
+                auto theSize = theArc->append(aName, std::vector<uint8_t>(theText.begin(), theText.end()));
+                const IOStats theIO = BlockFile::threadStats() - theStart;
+                theContents[aName] += theText;
+                aRead = theIO.bytesRead;
+                return theSize.isOK() && theSize.getValue() == theContents[aName].size() ? theIO.bytesWritten : size_t(0);
+            };
+            auto theMatches = [&](const char *aStep) {
+                for (auto &[theName, theContent] : theContents) {
+                    if (!theArc->extract(theName, folder + "/out.txt").isOK() || readFile(folder + "/out.txt") != theContent) {
+                        anOutput << aStep << ": " << theName << " didn't match\n";
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            //last entry: slack, new blocks and the head header, nothing else
+            bool theResult = theMatches("before");
+            size_t theRead = 0;
+            size_t theWritten = theAppend("mediumA.txt", 4096, theRead);
+            if (!theWritten || theWritten > 4096 + 2 * kChunkSize || theRead > kChunkSize) {
+                anOutput << "4K append to the last entry wrote " << theWritten << " and read " << theRead << " bytes\n";
+                theResult = false;
+            }
+            theResult = theMatches("last") && theResult;
+
+            //boxed in: moved to the end once, then appends go into its headroom
+            theResult = theAppend("smallA.txt", 2000, theRead) && theMatches("moved") && theResult;
+            addTestFile(*theArc, "large", 'A');
+            theContents["largeA.txt"] = readFile(folder + "/largeA.txt");
+            theWritten = theAppend("smallA.txt", 4096, theRead);
+            if (!theWritten || theWritten > 4096 + 2 * kChunkSize) {
+                anOutput << "4K append into headroom wrote " << theWritten << " bytes\n";
+                theResult = false;
+            }
+            theResult = theMatches("headroom") && theResult;
+
+            //processed entries get a frame per append, earlier frames are never touched
+            theResult = theAppend("XlargeB.txt", 100, theRead) && theAppend("XlargeB.txt", 40000, theRead) &&
+                        theAppend("XlargeB.txt", 5, theRead) && theMatches("compressed") && theResult;
+
+            //a pinned reader keeps the sizes it knew; cached runs of the old tail are not served
+            {
+                ArchiveReader theReader = theArc->openReader();
+                std::string theOld = theContents["mediumA.txt"];
+                theResult = theAppend("mediumA.txt", 10, theRead) && theResult;
+                std::vector<uint8_t> theRange;
+                if (!theReader.readRange("mediumA.txt", 0, theOld.size() + 100, theRange).isOK() ||
+                    std::string(theRange.begin(), theRange.end()) != theOld) {
+                    anOutput << "pinned reader saw the append\n";
+                    theResult = false;
+                }
+            }
+            theResult = theMatches("pinned") && theResult;
+
+            if (theArc->append("missing.txt", {1, 2, 3}).getError() != ArchiveErrors::fileNotFound) {
+                anOutput << "append to a missing entry didn't fail\n";
+                theResult = false;
+            }
+
+            theArc.reset();
+            auto theReopened = Archive::openArchive(folder + "/appendtest");
+            if (!theReopened.isOK()) return false;
+            theArc = theReopened.getValue();
+            return theMatches("reopen") && theResult;
+        }
+
+        bool doVersionTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/versiontest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            const std::string thePath = folder + "/notes.txt";
+            std::string theText;
+            for (size_t i = 0; theText.size() < 300000; ++i)
+                theText += "note " + std::to_string(i * 7919 % 100003) + ": " + std::string(10 + i % 50, 'a' + i % 26) + "\n";
+
+            std::vector<std::string> theVersions; //content of version i + 1
+            auto theAdd = [&](const std::string &aContent) {
+                std::ofstream(thePath, std::ios::binary | std::ios::trunc) << aContent;
+                auto theVersion = theArc->addVersion(thePath);
+                theVersions.push_back(aContent);
+                return theVersion.isOK() && theVersion.getValue() == theVersions.size();
+            };
+            auto theStored = [&]() {
+                ArchiveReader theReader = theArc->openReader();
+                for (auto &theEntry : theReader) if (theEntry.name == "notes.txt") return theEntry.storedSize();
+                return size_t(0);
+            };
+            auto theMatches = [&](const char *aStep) {
+                for (size_t i = 0; i < theVersions.size(); ++i) {
+                    std::string theName = i + 1 == theVersions.size() ? "notes.txt" : "notes.txt;" + std::to_string(i + 1);
+                    if (!theArc->extract(theName, folder + "/out.txt").isOK() || readFile(folder + "/out.txt") != theVersions[i]) {
+                        anOutput << aStep << ": " << theName << " didn't match\n";
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            //small edits store small deltas
+            bool theResult = theAdd(theText);
+            std::string theEdit = theText;
+            theEdit.replace(1000, 20, "an edit near the start");
+            theEdit.insert(150000, std::string(300, 'Z'));
+            theResult = theAdd(theEdit) && theResult;
+            if (!theStored() || theStored() > theEdit.size() / 10) {
+                anOutput << "delta of a small edit stored " << theStored() << " bytes\n";
+                theResult = false;
+            }
+            theEdit.erase(200000, 5000);
+            theEdit += "a new last line\n";
+            theResult = theAdd(theEdit) && theMatches("deltas") && theResult;
+            if (!theStored() || theStored() > theEdit.size() / 10) {
+                anOutput << "delta of a delta stored " << theStored() << " bytes\n";
+                theResult = false;
+            }
+            if (Tracer::kCompiledIn) { //each delta down the chain is loaded once per extract, not per copy
+                Tracer::clear();
+                Tracer::enable(true);
+                theArc->extract("notes.txt", folder + "/out.txt");
+                Tracer::enable(false);
+                std::stringstream theTrace;
+                Tracer::writeChromeTrace(theTrace);
+                size_t theLoads = 0;
+                for (std::string theLine; std::getline(theTrace, theLine);)
+                    theLoads += theLine.find("\"name\": \"delta\"") != std::string::npos;
+                if (1 != theLoads) {
+                    anOutput << "extracting a delta of a delta read deltas " << theLoads << " times\n";
+                    theResult = false;
+                }
+            }
+
+            //a file that isn't there is an error, not an exception
+            try {
+                if (theArc->addVersion(folder + "/no such notes.txt").getError() != ArchiveErrors::fileOpenError) {
+                    anOutput << "added a version of a missing file\n";
+                    theResult = false;
+                }
+            }
+            catch (...) {
+                anOutput << "adding a version of a missing file threw\n";
+                theResult = false;
+            }
+
+            //versions others are built on stay put, deltas can't be appended to
+            if (theArc->remove("notes.txt;1").getError() != ArchiveErrors::badAction ||
+                theArc->remove("notes.txt;2").getError() != ArchiveErrors::badAction ||
+                theArc->update("notes.txt;2", thePath).getError() != ArchiveErrors::badAction ||
+                theArc->append("notes.txt", {1, 2, 3}).getError() != ArchiveErrors::badAction) {
+                anOutput << "a version in use was changed\n";
+                theResult = false;
+            }
+
+            //the chain limit forces a full copy, the next version is a delta against it
+            theArc->setMaxDeltaChain(2);
+            theEdit[5] = '#';
+            theResult = theAdd(theEdit) && theResult;
+            if (theStored() != theEdit.size()) {
+                anOutput << "version past the chain limit stored " << theStored() << " bytes\n";
+                theResult = false;
+            }
+            theEdit[6] = '#';
+            theResult = theAdd(theEdit) && theResult;
+            if (!theStored() || theStored() > theEdit.size() / 10) {
+                anOutput << "delta after a full copy stored " << theStored() << " bytes\n";
+                theResult = false;
+            }
+            theResult = theMatches("chain") && theResult;
+
+            //unrelated content still round trips, just without much to copy
+            theResult = theAdd(std::string(70000, 'q')) && theMatches("rewrite") && theResult;
+
+            theArc.reset();
+            auto theReopened = Archive::openArchive(folder + "/versiontest");
+            if (!theReopened.isOK()) return false;
+            theArc = theReopened.getValue();
+            return theMatches("reopen") && theResult;
+        }
+
+        bool doMergeTests(std::ostream& anOutput) {
+            //ours: a few files; theirs: others, a clashing smallA.txt, a compressed file and versions
+            Compression theCompression;
+            auto makeOurs = [&](const std::string &aName) {
+                auto theArchive = Archive::createArchive(folder + "/" + aName);
+                if (!theArchive.isOK()) return std::shared_ptr<Archive>();
+                auto theArc = theArchive.getValue();
+                addTestFile(*theArc, "small", 'A');
+                addTestFile(*theArc, "medium", 'A');
+                return theArc;
+            };
+            auto theArchive = Archive::createArchive(folder + "/mergetheirs");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theTheirs = theArchive.getValue();
+            const std::string theOther = folder + "/other";
+            std::filesystem::create_directories(theOther);
+            const std::string theClash(3000, 'c');
+            std::ofstream(theOther + "/smallA.txt", std::ios::binary | std::ios::trunc) << theClash;
+            theTheirs->add(theOther + "/smallA.txt");
+            addTestFile(*theTheirs, "small", 'B');
+            addTestFile(*theTheirs, "Xlarge", 'A');
+            addTestFile(*theTheirs, "Xlarge", 'B', &theCompression);
+            std::string theNotes(50000, 'n'), theEdit = theNotes;
+            theEdit.replace(20000, 10, "0123456789");
+            std::ofstream(theOther + "/notes.txt", std::ios::binary | std::ios::trunc) << theNotes;
+            theTheirs->addVersion(theOther + "/notes.txt");
+            std::ofstream(theOther + "/notes.txt", std::ios::binary | std::ios::trunc) << theEdit;
+            theTheirs->addVersion(theOther + "/notes.txt");
+
+            std::map<std::string, std::string> theFiles{
+                {"smallA.txt", readFile(folder + "/smallA.txt")}, {"mediumA.txt", readFile(folder + "/mediumA.txt")},
+                {"smallB.txt", readFile(folder + "/smallB.txt")}, {"XlargeA.txt", readFile(folder + "/XlargeA.txt")},
+                {"XlargeB.txt", readFile(folder + "/XlargeB.txt")}, {"notes.txt;1", theNotes}, {"notes.txt", theEdit}};
+            auto theMatches = [&](Archive &anArchive, const std::map<std::string, std::string> &aContents, const char *aStep) {
+                bool theResult = true;
+                for (auto &[theName, theContent] : aContents) {
+                    if (!anArchive.extract(theName, folder + "/out.txt").isOK() ||
+                        readFile(folder + "/out.txt") != theContent) {
+                        anOutput << aStep << ": " << theName << " didn't match\n";
+                        theResult = false;
+                    }
+                }
+                return theResult;
+            };
+            auto theStored = [](Archive &anArchive, const std::string &aName) {
+                ArchiveReader theReader = anArchive.openReader();
+                for (auto &theEntry : theReader) if (theEntry.name == aName) return theEntry.storedSize();
+                return size_t(0);
+            };
+
+            //skip keeps ours, everything else comes across as stored
+            bool theResult = true;
+            auto theOurs = makeOurs("mergeskip");
+            if (!theOurs) return false;
+            auto theCount = theOurs->merge(*theTheirs, MergePolicy::skip);
+            if (!theCount.isOK() || theCount.getValue() != 5) {
+                anOutput << "skip merged " << (theCount.isOK() ? theCount.getValue() : 0) << " entries\n";
+                theResult = false;
+            }
+            theResult = theMatches(*theOurs, theFiles, "skip") && theResult;
+            if (theStored(*theOurs, "XlargeB.txt") != theStored(*theTheirs, "XlargeB.txt")) {
+                anOutput << "compressed entry changed size in the merge\n";
+                theResult = false;
+            }
+
+            //replace takes theirs
+            theOurs = makeOurs("mergereplace");
+            if (!theOurs || !theOurs->merge(*theTheirs, MergePolicy::replace).isOK()) return false;
+            auto theReplaced = theFiles;
+            theReplaced["smallA.txt"] = theClash;
+            theResult = theMatches(*theOurs, theReplaced, "replace") && theResult;
+
+            //rename keeps both; a renamed delta still finds its base
+            theOurs = makeOurs("mergerename");
+            if (!theOurs) return false;
+            theOurs->merge(*theTheirs, MergePolicy::rename);
+            theCount = theOurs->merge(*theTheirs, MergePolicy::rename);
+            auto theRenamed = theFiles;
+            theRenamed["smallA.txt~2"] = theClash;
+            theRenamed["smallA.txt~3"] = theClash;
+            theRenamed["notes.txt~2;1"] = theNotes;
+            theRenamed["notes.txt~2"] = theEdit;
+            theRenamed["XlargeB.txt~2"] = theFiles["XlargeB.txt"];
+            if (!theCount.isOK() || theCount.getValue() != 6) {
+                anOutput << "second rename merged " << (theCount.isOK() ? theCount.getValue() : 0) << " entries\n";
+                theResult = false;
+            }
+            theResult = theMatches(*theOurs, theRenamed, "rename") && theResult;
+
+            //theirs as it is on disk, with what another handle added since
+            auto theOtherHandle = Archive::openArchive(folder + "/mergetheirs");
+            if (!theOtherHandle.isOK()) return false;
+            const std::string theLate(5000, 'l');
+            std::istringstream theLateInput(theLate);
+            theOtherHandle.getValue()->add("late.txt", theLateInput);
+            auto theLatest = makeOurs("mergelatest");
+            if (!theLatest) return false;
+            theLatest->merge(*theTheirs, MergePolicy::skip);
+            theResult = theMatches(*theLatest, {{"late.txt", theLate}}, "latest") && theResult;
+
+            if (theOurs->merge(*theOurs).getError() != ArchiveErrors::badAction) {
+                anOutput << "merged an archive into itself\n";
+                theResult = false;
+            }
+
+            theOurs.reset();
+            auto theReopened = Archive::openArchive(folder + "/mergerename");
+            if (!theReopened.isOK()) return false;
+            return theMatches(*theReopened.getValue(), theRenamed, "reopen") && theResult;
+        }
+
+        bool doVolumeTests(std::ostream& anOutput) {
+            VolumeLayout theLayout;
+            for (auto theDisk : {"/disk0", "/disk1", "/disk2"}) {
+                std::filesystem::create_directories(folder + theDisk);
+                theLayout.folders.push_back(folder + theDisk);
+            }
+            theLayout.stripeBlocks = 4;
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/volumetest", theLayout);
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            Compression theCompression;
+            addTestFiles(*theArc);
+            addTestFile(*theArc, "Xlarge", 'B', &theCompression);
+            std::map<std::string, std::string> theContents;
+            for (auto theName : {"smallA.txt", "mediumA.txt", "largeA.txt", "XlargeA.txt", "XlargeB.txt"})
+                theContents[theName] = readFile(folder + "/" + theName);
+            auto theMatches = [&](Archive &anArchive, const char *aStep) {
+                for (auto &[theName, theContent] : theContents) {
+                    if (!anArchive.extract(theName, folder + "/out.txt").isOK() || readFile(folder + "/out.txt") != theContent) {
+                        anOutput << aStep << ": " << theName << " didn't match\n";
+                        return false;
+                    }
+                }
+                return true;
+            };
+            auto theVolumes = [&](uint32_t aGeneration) { //sizes of that generation's volumes, 0 when missing
+                std::vector<size_t> theSizes;
+                VolumeLayout theNamed = theLayout;
+                theNamed.generation = aGeneration;
+                for (size_t i = 0; i < theNamed.folders.size(); ++i) {
+                    std::error_code theError;
+                    size_t theSize = std::filesystem::file_size(theNamed.volumePath(folder + "/volumetest.arc", i), theError);
+                    theSizes.push_back(theError ? 0 : theSize);
+                }
+                return theSizes;
+            };
+
+            //the data is spread over every volume, the .arc only names them
+            bool theResult = theMatches(*theArc, "striped");
+            size_t theTotal = 0;
+            for (size_t theSize : theVolumes(0)) {
+                if (theSize < 64 * kChunkSize) {
+                    anOutput << "a volume holds only " << theSize << " bytes\n";
+                    theResult = false;
+                }
+                theTotal += theSize;
+            }
+            if (std::filesystem::file_size(folder + "/volumetest.arc") > kChunkSize) {
+                anOutput << "the manifest holds data\n";
+                theResult = false;
+            }
+
+            //updates, appends and removes work across stripes
+            theContents["smallA.txt"] += "more";
+            theResult = theArc->append("smallA.txt", {'m', 'o', 'r', 'e'}).isOK() && theResult;
+            theResult = theArc->remove("largeA.txt").isOK() && theResult;
+            theContents.erase("largeA.txt");
+            theResult = theMatches(*theArc, "changed") && theResult;
+
+            //compact writes the next generation and drops the old one
+            theResult = theArc->compact().isOK() && theResult;
+            size_t theCompacted = 0;
+            for (size_t theSize : theVolumes(1)) theCompacted += theSize;
+            for (size_t theSize : theVolumes(0)) {
+                if (theSize) {
+                    anOutput << "old volumes left after compact\n";
+                    theResult = false;
+                }
+            }
+            if (!theCompacted || theCompacted >= theTotal) {
+                anOutput << "compact went from " << theTotal << " to " << theCompacted << " bytes\n";
+                theResult = false;
+            }
+            theResult = theMatches(*theArc, "compacted") && theResult;
+
+            theArc.reset();
+            auto theReopened = Archive::openArchive(folder + "/volumetest");
+            if (!theReopened.isOK()) return false;
+            theResult = theMatches(*theReopened.getValue(), "reopen") && theResult;
+
+            //a full volume fails the write, the archive stays usable
+            theLayout.volumeLimit = 32 * kChunkSize;
+            theArchive = Archive::createArchive(folder + "/volumelimit", theLayout);
+            if (!theArchive.isOK()) return false;
+            theArc = theArchive.getValue();
+            addTestFile(*theArc, "small", 'A');
+            addTestFile(*theArc, "Xlarge", 'A');
+            theContents = {{"smallA.txt", readFile(folder + "/smallA.txt")}};
+            ArchiveReader theReader = theArc->openReader();
+            for (auto &theEntry : theReader) {
+                if (theEntry.name == "XlargeA.txt") {
+                    anOutput << "added past the volume limit\n";
+                    theResult = false;
+                }
+            }
+            return theMatches(*theArc, "limit") && theResult;
+        }
+
+        bool doSparseTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/sparsetest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            //data, a long run of zeros, data, zeros to the end (like a preallocated image)
+            std::string theImage(100000, 'd');
+            theImage += std::string(1500000, '\0') + std::string(200000, 'e') + std::string(200000, '\0');
+            std::map<std::string, std::string> theContents{
+                {"image.bin", theImage}, {"zeros.bin", std::string(300000, '\0')}, {"dense.bin", std::string(100000, 'x')}};
+            for (auto &[theName, theContent] : theContents) {
+                std::ofstream(folder + "/" + theName, std::ios::binary | std::ios::trunc) << theContent;
+                theArc->add(folder + "/" + theName);
+            }
+            auto theStored = [&](const std::string &aName) {
+                ArchiveReader theReader = theArc->openReader();
+                for (auto &theEntry : theReader) if (theEntry.name == aName) return theEntry.storedSize();
+                return size_t(0);
+            };
+            auto theMatches = [&](const char *aStep) {
+                for (auto &[theName, theContent] : theContents) {
+                    if (!theArc->extract(theName, folder + "/out.bin").isOK() || readFile(folder + "/out.bin") != theContent) {
+                        anOutput << aStep << ": " << theName << " didn't match\n";
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            //only the data (rounded to whole segments) and the map are stored
+            bool theResult = theMatches("added");
+            if (theStored("image.bin") > 400000 || theStored("zeros.bin") > 100 || theStored("dense.bin") != 100000) {
+                anOutput << "stored " << theStored("image.bin") << ", " << theStored("zeros.bin") << " and "
+                         << theStored("dense.bin") << " bytes\n";
+                theResult = false;
+            }
+
+            //extract leaves holes where the zeros were
+            struct stat theStat{};
+            if (!theArc->extract("image.bin", folder + "/out.bin").isOK() || stat((folder + "/out.bin").c_str(), &theStat) ||
+                size_t(theStat.st_size) != theImage.size() || size_t(theStat.st_blocks) * 512 > theImage.size() / 2) {
+                anOutput << "extracted image isn't sparse (" << theStat.st_blocks * 512 << " bytes allocated)\n";
+                theResult = false;
+            }
+
+            //ranges across holes, and a hole at the start of a range
+            std::vector<uint8_t> theRange;
+            for (size_t theOffset : {size_t(90000), size_t(500000), size_t(1599990), size_t(1790000)}) {
+                if (!theArc->readRange("image.bin", theOffset, 20000, theRange).isOK() ||
+                    std::string(theRange.begin(), theRange.end()) != theImage.substr(theOffset, 20000)) {
+                    anOutput << "range at " << theOffset << " didn't match\n";
+                    theResult = false;
+                }
+            }
+            //past the end, inside the last segment (a hole)
+            auto thePastEnd = theArc->readRange("image.bin", theImage.size() + 5000, 100, theRange);
+            if (!thePastEnd.isOK() || thePastEnd.getValue() || !theRange.empty()) {
+                anOutput << "a range past the end returned data\n";
+                theResult = false;
+            }
+
+            //the hole map isn't content: no appends, but updates replace it
+            if (theArc->append("image.bin", {1}).getError() != ArchiveErrors::badAction) {
+                anOutput << "appended to a sparse entry\n";
+                theResult = false;
+            }
+            theContents["image.bin"] = std::string(40000, '\0') + "tail";
+            std::ofstream(folder + "/image.bin", std::ios::binary | std::ios::trunc) << theContents["image.bin"];
+            theResult = theArc->update("image.bin", folder + "/image.bin").isOK() && theMatches("updated") && theResult;
+
+            theArc.reset();
+            auto theReopened = Archive::openArchive(folder + "/sparsetest");
+            if (!theReopened.isOK()) return false;
+            theArc = theReopened.getValue();
+            return theMatches("reopen") && theResult;
+        }
+
+        bool doStreamTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/streamtest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            std::map<std::string, std::string> theContents;
+            auto theFind = [&](const std::string &aName, EntryInfo &anInfo) {
+                ArchiveReader theReader = theArc->openReader();
+                for (auto &theEntry : theReader) if (theEntry.name == aName) { anInfo = theEntry; return true; }
+                return false;
+            };
+            auto theMatches = [&](const char *aStep) {
+                for (auto &[theName, theContent] : theContents) {
+                    EntryInfo theInfo;
+                    if (!theArc->extract(theName, folder + "/out.bin").isOK() || readFile(folder + "/out.bin") != theContent ||
+                        !theFind(theName, theInfo) || theInfo.filesize != theContent.size()) {
+                        anOutput << aStep << ": " << theName << " didn't match\n";
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            auto theAdded = [](const ArchiveStatus<bool> &aStatus) {return aStatus.isOK() && aStatus.getValue();};
+
+            //from memory, raw and compressed, plus an empty one
+            std::string theText;
+            for (int i = 0; i < 20000; ++i) theText += "line " + std::to_string(i) + " of a streamed log\n";
+            Compression theCompression;
+            std::istringstream theFirst(theText), theSecond(theText), theEmpty;
+            bool theResult = theAdded(theArc->add("memory.txt", theFirst)) &&
+                             theAdded(theArc->add("packed.txt", theSecond, &theCompression)) &&
+                             theAdded(theArc->add("empty.txt", theEmpty));
+            theContents = {{"memory.txt", theText}, {"packed.txt", theText}, {"empty.txt", ""}};
+
+            //from a pipe, written a piece at a time while the add reads; zeros in it still become holes
+            std::string thePiped = std::string(50000, 'p') + std::string(200000, '\0') + std::string(70000, 'q');
+            int theFds[2];
+            if (pipe(theFds)) return false;
+            std::thread theWriter([&]() {
+                for (size_t theOffset = 0; theOffset < thePiped.size();) {
+                    ssize_t theCount = write(theFds[1], thePiped.data() + theOffset, std::min<size_t>(4099, thePiped.size() - theOffset));
+                    if (theCount <= 0) break;
+                    theOffset += theCount;
+                }
+                close(theFds[1]);
+            });
+            theResult = theAdded(theArc->addFd("piped.bin", theFds[0])) && theResult;
+            theWriter.join();
+            close(theFds[0]);
+            theContents["piped.bin"] = thePiped;
+            if (!theResult) anOutput << "a stream add failed\n";
+
+            theResult = theMatches("added") && theResult;
+            EntryInfo thePipedInfo;
+            if (!theFind("piped.bin", thePipedInfo) || !thePipedInfo.isSparse()) {
+                anOutput << "piped zeros weren't left out\n";
+                theResult = false;
+            }
+
+            //a stream that fails part way leaves nothing behind
+            std::istringstream theBroken("partial");
+            theBroken.setstate(std::ios::badbit);
+            EntryInfo theBrokenInfo;
+            if (theAdded(theArc->add("broken.txt", theBroken)) || theFind("broken.txt", theBrokenInfo)) {
+                anOutput << "a broken stream was added\n";
+                theResult = false;
+            }
+
+            theArc.reset();
+            auto theReopened = Archive::openArchive(folder + "/streamtest");
+            if (!theReopened.isOK()) return false;
+            theArc = theReopened.getValue();
+            return theMatches("reopen") && theResult;
+        }
+
+        bool doMemoryTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/memtest", StorageKind::memory);
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            auto theOnDisk = [&](const std::string &aPrefix) { //anything named after the archive
+                for (auto &theFile : std::filesystem::directory_iterator(folder))
+                    if (0 == theFile.path().filename().string().rfind(aPrefix, 0)) return true;
+                return false;
+            };
+            std::string theText;
+            for (int i = 0; i < 20000; ++i) theText += "entry " + std::to_string(i) + "\n";
+            std::map<std::string, std::string> theContents{{"one.txt", theText}, {"two.txt", theText.substr(0, 50000)},
+                                                           {"three.txt", theText.substr(1000, 5000)}};
+            Compression theCompression;
+            for (auto &[theName, theContent] : theContents)
+                std::ofstream(folder + "/" + theName, std::ios::binary | std::ios::trunc) << theContent;
+            theArc->add(folder + "/one.txt");
+            theArc->add(folder + "/two.txt", &theCompression);
+            theArc->add(folder + "/three.txt");
+            auto theMatches = [&](Archive &anArchive, const char *aStep) {
+                for (auto &[theName, theContent] : theContents) {
+                    std::vector<uint8_t> theBuffer;
+                    if (!anArchive.extract(theName, theBuffer).isOK() || std::string(theBuffer.begin(), theBuffer.end()) != theContent) {
+                        anOutput << aStep << ": " << theName << " didn't match\n";
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            //the usual writers work the same in memory
+            bool theResult = theMatches(*theArc, "added");
+            theArc->remove("three.txt");
+            theContents.erase("three.txt");
+            theContents["one.txt"] = theText.substr(0, 30000) + "changed" + theText.substr(30007);
+            std::ofstream(folder + "/one.txt", std::ios::binary | std::ios::trunc) << theContents["one.txt"];
+            theResult = theArc->update("one.txt", folder + "/one.txt").isOK() && theResult;
+            theResult = theArc->compact().isOK() && theMatches(*theArc, "compacted") && theResult;
+            if (theOnDisk("memtest")) {
+                anOutput << "a memory archive wrote to the folder\n";
+                theResult = false;
+            }
+
+            //opening in memory copies a file archive's blocks; what changes afterwards stays in memory
+            {
+                auto theFiled = Archive::createArchive(folder + "/memsource");
+                if (!theFiled.isOK()) return false;
+                for (auto &[theName, theContent] : theContents) theFiled.getValue()->add(folder + "/" + theName);
+            }
+            auto theCopy = Archive::openArchive(folder + "/memsource", StorageKind::memory);
+            if (!theCopy.isOK() || !theMatches(*theCopy.getValue(), "copied")) return false;
+            theCopy.getValue()->remove("two.txt");
+            auto theReopened = Archive::openArchive(folder + "/memsource");
+            if (!theReopened.isOK() || !theMatches(*theReopened.getValue(), "file after memory changes")) return false;
+            return theResult;
+        }
+
+        bool doReadaheadTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/readaheadtest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            theArc->setCacheBudget(0); //every read goes to the file
+            //noise doesn't compress, so the compressed entry spans about as many blocks as the raw one
+            std::string theNoise(2 * 1024 * 1024, '\0');
+            uint32_t theSeed = 141;
+            for (auto &theByte : theNoise) theByte = static_cast<char>((theSeed = theSeed * 1664525u + 1013904223u) >> 24);
+            std::ofstream(folder + "/noise.bin", std::ios::binary | std::ios::trunc) << theNoise;
+            Compression theCompression;
+            if (!theArc->add(folder + "/noise.bin", &theCompression).isOK()) return false;
+            const size_t theBlocks = theNoise.size() / kPayloadSize;
+
+            //blocks come in runs, not one read each
+            auto theReads = [&](const std::function<bool()> &anOperation) {
+                Archive::resetHotCounters();
+                if (!anOperation()) return SIZE_MAX;
+                return size_t(Archive::getHotCounters()[static_cast<size_t>(HotCounter::fileRead)].calls);
+            };
+            bool theResult = true;
+            std::vector<uint8_t> theBuffer;
+            size_t theCount = theReads([&]() {
+                return theArc->extract("noise.bin", theBuffer).isOK() && std::string(theBuffer.begin(), theBuffer.end()) == theNoise;
+            });
+            if (theCount > theBlocks / 16) {
+                anOutput << "compressed extract took " << theCount << " reads\n";
+                theResult = false;
+            }
+            std::ostringstream theDump;
+            theCount = theReads([&]() {return theArc->debugDump(theDump).isOK();});
+            if (theCount > theBlocks / 16) {
+                anOutput << "dump took " << theCount << " reads\n";
+                theResult = false;
+            }
+
+            //ranges from the middle and compaction see the same bytes
+            std::vector<uint8_t> theRange;
+            if (!theArc->readRange("noise.bin", 1500000, 100000, theRange).isOK() ||
+                std::string(theRange.begin(), theRange.end()) != theNoise.substr(1500000, 100000)) {
+                anOutput << "range didn't match\n";
+                theResult = false;
+            }
+            std::ofstream(folder + "/small.txt", std::ios::binary | std::ios::trunc) << "small";
+            theArc->add(folder + "/small.txt");
+            theArc->remove("small.txt");
+            theCount = theReads([&]() {return theArc->compact().isOK();});
+            if (theCount > theBlocks / 16) {
+                anOutput << "compact took " << theCount << " reads\n";
+                theResult = false;
+            }
+            theBuffer.clear();
+            if (!theArc->extract("noise.bin", theBuffer).isOK() || std::string(theBuffer.begin(), theBuffer.end()) != theNoise) {
+                anOutput << "compacted entry didn't match\n";
+                theResult = false;
+            }
+            return theResult;
+        }
+
+        bool doSinkTests(std::ostream& anOutput) {
+            ArchiveStatus<std::shared_ptr<Archive>> theArchive = Archive::createArchive(folder + "/sinktest");
+            if (!theArchive.isOK()) {
+                anOutput << "Failed to create archive\n";
+                return false;
+            }
+            auto theArc = theArchive.getValue();
+            //one entry of each kind the block walk knows: raw, compressed, sparse and a delta
+            std::string theText;
+            for (int i = 0; i < 30000; ++i) theText += "record " + std::to_string(i) + "\n";
+            std::string theSparse = std::string(20000, 's') + std::string(100000, '\0') + "end";
+            Compression theCompression;
+            std::map<std::string, std::string> theContents{{"raw.txt", theText}, {"packed.txt", theText},
+                                                           {"sparse.bin", theSparse}, {"notes.txt", theText}};
+            for (auto &[theName, theContent] : theContents)
+                std::ofstream(folder + "/" + theName, std::ios::binary | std::ios::trunc) << theContent;
+            theArc->add(folder + "/raw.txt");
+            theArc->add(folder + "/packed.txt", &theCompression);
+            theArc->add(folder + "/sparse.bin");
+            std::ofstream(folder + "/notes.txt", std::ios::binary | std::ios::trunc) << theText.substr(0, 200000);
+            theArc->addVersion(folder + "/notes.txt");
+            std::ofstream(folder + "/notes.txt", std::ios::binary | std::ios::trunc) << theText;
+            theArc->addVersion(folder + "/notes.txt");
+
+            bool theResult = true;
+            for (auto &[theName, theContent] : theContents) {
+                std::vector<uint8_t> theBuffer;
+                std::ostringstream theStream;
+                std::string theCalled;
+                auto theVector = theArc->extract(theName, theBuffer);
+                auto theStreamed = theArc->extract(theName, theStream);
+                auto theSunk = theArc->extract(theName, [&](const char *aData, size_t aLength) {
+                    theCalled.append(aData, aLength);
+                    return true;
+                });
+                if (!theVector.isOK() || std::string(theBuffer.begin(), theBuffer.end()) != theContent ||
+                    theVector.getValue() != theContent.size() || !theStreamed.isOK() || theStreamed.getValue() != theContent.size() ||
+                    theStream.str() != theContent || !theSunk.isOK() || theCalled != theContent) {
+                    anOutput << theName << " didn't come back the same\n";
+                    theResult = false;
+                }
+            }
+
+            //a sink can stop early; a missing entry and a failing stream are errors
+            size_t theCalls = 0;
+            auto theStopped = theArc->extract("raw.txt", [&](const char*, size_t) {return ++theCalls < 2;});
+            if (!theStopped.isOK() || 2 != theCalls || theStopped.getValue() >= theText.size()) {
+                anOutput << "sink didn't stop early\n";
+                theResult = false;
+            }
+            std::vector<uint8_t> theMissing{1, 2, 3};
+            if (theArc->extract("missing.txt", theMissing).getError() != ArchiveErrors::fileNotFound || !theMissing.empty()) {
+                anOutput << "missing entry wasn't reported\n";
+                theResult = false;
+            }
+            std::ostringstream theBad;
+            theBad.setstate(std::ios::badbit);
+            if (theArc->extract("raw.txt", theBad).getError() != ArchiveErrors::fileWriteError) {
+                anOutput << "failing stream wasn't reported\n";
+                theResult = false;
+            }
+
+            //a pinned reader serves from memory too
+            ArchiveReader theReader = theArc->openReader();
+            std::vector<uint8_t> theBuffer;
+            if (!theReader.extract("packed.txt", theBuffer).isOK() || std::string(theBuffer.begin(), theBuffer.end()) != theText) {
+                anOutput << "reader extract didn't match\n";
+                theResult = false;
+            }
+            return theResult;
+        }
+
     };
 
 
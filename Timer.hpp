@@ -9,6 +9,16 @@
 #define Timer_h
 
 #include <chrono>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 namespace ECE141 {
 
@@ -39,6 +49,158 @@ namespace ECE141 {
         std::chrono::time_point<std::chrono::high_resolution_clock> started;
         std::chrono::time_point<std::chrono::high_resolution_clock> stopped;
     };
+
+    //-------------------------------------------
+    //hot-path counters: cheap enough to leave on, so time can be pinned on checksum, hash, codec or I/O
+
+    //the CPU's time stamp counter where there is one (constant rate on anything recent), ns otherwise
+    inline uint64_t readTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    //ns per tick, calibrated once against steady_clock (a ~5ms spin the first time)
+    inline double nanosPerTick() {
+        static const double theRatio = []() {
+#if defined(__x86_64__) || defined(__i386__)
+            auto theStart = std::chrono::steady_clock::now();
+            uint64_t theTicks = readTicks();
+            std::chrono::steady_clock::time_point theNow;
+            do { theNow = std::chrono::steady_clock::now(); }
+            while (theNow - theStart < std::chrono::milliseconds(5));
+            uint64_t theElapsed = readTicks() - theTicks;
+            double theNanos = std::chrono::duration<double, std::nano>(theNow - theStart).count();
+            return theElapsed ? theNanos / theElapsed : 1.0;
+#else
+            return 1.0;
+#endif
+        }();
+        return theRatio;
+    }
+
+    //every counter is named here, at compile time; add new ones before the last
+    enum class HotCounter {checksum, hash, compress, decompress, fileRead, fileWrite, fileSync};
+    constexpr size_t kHotCounterCount = static_cast<size_t>(HotCounter::fileSync) + 1;
+    constexpr const char* kHotCounterNames[kHotCounterCount] = {
+        "checksum", "hash", "compress", "decompress", "fileRead", "fileWrite", "fileSync"};
+
+    struct HotCounterValue {
+        const char *name;
+        uint64_t    calls;
+        double      nanos;
+    };
+    using HotCounterValues = std::array<HotCounterValue, kHotCounterCount>;
+
+    //each thread adds to its own block (no shared cache lines, no RMW); read() sums the blocks, plus
+    //the totals of threads that have exited
+    class HotCounters {
+    public:
+        static void add(HotCounter aCounter, uint64_t aTicks) {
+            Block &theBlock = threadBlock();
+            size_t i = static_cast<size_t>(aCounter);
+            theBlock.calls[i].store(theBlock.calls[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            theBlock.ticks[i].store(theBlock.ticks[i].load(std::memory_order_relaxed) + aTicks, std::memory_order_relaxed);
+        }
+
+        //totals over every thread (finished ones too) since the last reset()
+        static HotCounterValues read() {
+            Totals theTotals = sum();
+            std::lock_guard<std::mutex> theGuard(registryLock());
+            HotCounterValues theValues;
+            for (size_t i = 0; i < kHotCounterCount; i++) {
+                theValues[i] = {kHotCounterNames[i], theTotals.calls[i] - baseline().calls[i],
+                                (theTotals.ticks[i] - baseline().ticks[i]) * nanosPerTick()};
+            }
+            return theValues;
+        }
+
+        //threads keep counting; reset just moves the zero point
+        static void reset() {
+            Totals theTotals = sum();
+            std::lock_guard<std::mutex> theGuard(registryLock());
+            baseline() = theTotals;
+        }
+
+    protected:
+        struct Block {
+            std::atomic<uint64_t> calls[kHotCounterCount]{};
+            std::atomic<uint64_t> ticks[kHotCounterCount]{};
+        };
+        struct Totals {
+            uint64_t calls[kHotCounterCount]{};
+            uint64_t ticks[kHotCounterCount]{};
+        };
+
+        static std::mutex& registryLock() {
+            static std::mutex theLock;
+            return theLock;
+        }
+        static std::vector<Block*>& registry() { //blocks of the threads running now
+            static std::vector<Block*> theBlocks;
+            return theBlocks;
+        }
+        static Totals& retired() { //what threads that have exited counted
+            static Totals theRetired;
+            return theRetired;
+        }
+        static Totals& baseline() {
+            static Totals theBaseline;
+            return theBaseline;
+        }
+
+        //a thread's block, folded into retired() and dropped when the thread exits
+        struct BlockHolder {
+            Block block;
+            BlockHolder() {
+                std::lock_guard<std::mutex> theGuard(registryLock());
+                registry().push_back(&block);
+            }
+            ~BlockHolder() {
+                std::lock_guard<std::mutex> theGuard(registryLock());
+                for (size_t i = 0; i < kHotCounterCount; i++) {
+                    retired().calls[i] += block.calls[i].load(std::memory_order_relaxed);
+                    retired().ticks[i] += block.ticks[i].load(std::memory_order_relaxed);
+                }
+                auto &theBlocks = registry();
+                theBlocks.erase(std::find(theBlocks.begin(), theBlocks.end(), &block));
+            }
+        };
+
+        static Block& threadBlock() {
+            static thread_local BlockHolder theHolder;
+            return theHolder.block;
+        }
+
+        static Totals sum() {
+            std::lock_guard<std::mutex> theGuard(registryLock());
+            Totals theTotals = retired();
+            for (auto theBlock : registry()) {
+                for (size_t i = 0; i < kHotCounterCount; i++) {
+                    theTotals.calls[i] += theBlock->calls[i].load(std::memory_order_relaxed);
+                    theTotals.ticks[i] += theBlock->ticks[i].load(std::memory_order_relaxed);
+                }
+            }
+            return theTotals;
+        }
+    };
+
+    //RAII: charges the ticks between construction and destruction to aCounter
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(HotCounter aCounter) : counter{aCounter}, start{readTicks()} {}
+        ~ScopedTimer() {HotCounters::add(counter, readTicks() - start);}
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    protected:
+        HotCounter counter;
+        uint64_t   start;
+    };
 }
 
 #endif /* Timer_h */
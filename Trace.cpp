@@ -0,0 +1,92 @@
+//
+//  Trace.cpp
+//
+
+#include "Trace.hpp"
+#include <fstream>
+#include <iomanip>
+#include <unistd.h>
+
+namespace ECE141 {
+
+    //every ring there is. a thread hands its ring back when it exits and the next new thread carries
+    //on in it, after the spans already there (which still export), so there are only as many rings
+    //as threads ever ran at once
+    static std::mutex theRingLock;
+    static std::vector<std::shared_ptr<TraceRing>> theRings;
+    static std::vector<std::shared_ptr<TraceRing>> theFreeRings;
+
+    namespace {
+        struct RingHolder {
+            std::shared_ptr<TraceRing> ring;
+
+            RingHolder() {
+                std::lock_guard<std::mutex> theGuard(theRingLock);
+                if (!theFreeRings.empty()) {
+                    ring = std::move(theFreeRings.back());
+                    theFreeRings.pop_back();
+                    return;
+                }
+                ring = std::make_shared<TraceRing>();
+                ring->thread = static_cast<uint32_t>(theRings.size() + 1);
+                theRings.push_back(ring);
+            }
+            ~RingHolder() {
+                std::lock_guard<std::mutex> theGuard(theRingLock);
+                theFreeRings.push_back(std::move(ring));
+            }
+        };
+    }
+
+    std::atomic<bool>& Tracer::enabled() {
+        static std::atomic<bool> theEnabled{false};
+        return theEnabled;
+    }
+
+    std::chrono::steady_clock::time_point Tracer::epoch() {
+        static const auto theEpoch = std::chrono::steady_clock::now();
+        return theEpoch;
+    }
+
+    TraceRing& Tracer::threadRing() {
+        static thread_local RingHolder theHolder;
+        return *theHolder.ring;
+    }
+
+    void Tracer::clear() {
+        std::lock_guard<std::mutex> theGuard(theRingLock);
+        for (auto &theRing : theRings) theRing->written.store(0, std::memory_order_release);
+    }
+
+    void Tracer::writeChromeTrace(std::ostream &aStream) {
+        std::lock_guard<std::mutex> theGuard(theRingLock);
+        const int thePid = static_cast<int>(getpid());
+        const char *thePrefix = "\n";
+        auto theFlags = aStream.flags();
+        auto thePrecision = aStream.precision();
+        aStream << std::fixed << std::setprecision(3);
+        aStream << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+        for (auto &theRing : theRings) {
+            uint64_t theEnd = theRing->written.load(std::memory_order_acquire);
+            uint64_t theBegin = theEnd > TraceRing::kCapacity ? theEnd - TraceRing::kCapacity : 0;
+            for (uint64_t i = theBegin; i < theEnd; i++) {
+                const TraceEvent &theEvent = theRing->events[i % TraceRing::kCapacity];
+                //complete ("X") events, timestamps in microseconds
+                aStream << thePrefix << "{\"name\": \"" << theEvent.name << "\", \"cat\": \"archive\", \"ph\": \"X\""
+                        << ", \"ts\": " << theEvent.start / 1000.0 << ", \"dur\": " << theEvent.duration / 1000.0
+                        << ", \"pid\": " << thePid << ", \"tid\": " << theRing->thread << "}";
+                thePrefix = ",\n";
+            }
+        }
+        aStream << "\n]}\n";
+        aStream.flags(theFlags);
+        aStream.precision(thePrecision);
+    }
+
+    bool Tracer::writeChromeTrace(const std::string &aPath) {
+        std::ofstream theFile(aPath, std::ios::trunc);
+        writeChromeTrace(theFile);
+        return theFile.good();
+    }
+
+}
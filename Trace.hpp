@@ -0,0 +1,104 @@
+//
+//  Trace.hpp
+//
+//  trace spans around the phases of archive operations, exported as Chrome trace-event JSON
+//  (load the file in chrome://tracing or ui.perfetto.dev)
+//
+
+#ifndef Trace_hpp
+#define Trace_hpp
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//spans are compiled in only when ARCHIVE_TRACING is set (cmake -DARCHIVE_TRACING=ON, the default);
+//otherwise TRACE_SPAN expands to nothing. when compiled in, a span costs one relaxed load
+//until Tracer::enable(true), and two clock reads plus a ring slot after
+#ifdef ARCHIVE_TRACING
+    #define TRACE_JOIN2(a, b) a##b
+    #define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+    #define TRACE_SPAN(aName) ECE141::TraceSpan TRACE_JOIN(theTraceSpan, __LINE__)(aName)
+#else
+    #define TRACE_SPAN(aName) ((void)0)
+#endif
+
+namespace ECE141 {
+
+    struct TraceEvent {
+        const char *name;  //string literal, never copied
+        uint64_t    start; //ns since the tracer's epoch
+        uint64_t    duration;
+    };
+
+    //the last kCapacity spans finished on the thread that holds it, the only one writing to it;
+    //an exiting thread hands it on to the next new one
+    struct TraceRing {
+        static constexpr size_t kCapacity = 16384;
+        std::array<TraceEvent, kCapacity> events;
+        std::atomic<uint64_t> written{0};
+        uint32_t thread{0};
+    };
+
+    class Tracer {
+    public:
+        static constexpr bool kCompiledIn =
+#ifdef ARCHIVE_TRACING
+            true;
+#else
+            false;
+#endif
+
+        static void enable(bool anEnable) {enabled().store(anEnable, std::memory_order_relaxed);}
+        static bool isEnabled() {return enabled().load(std::memory_order_relaxed);}
+
+        static uint64_t now() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - epoch()).count());
+        }
+
+        static void record(const char *aName, uint64_t aStart, uint64_t anEnd) {
+            TraceRing &theRing = threadRing();
+            uint64_t theSlot = theRing.written.load(std::memory_order_relaxed);
+            theRing.events[theSlot % TraceRing::kCapacity] = {aName, aStart, anEnd - aStart};
+            theRing.written.store(theSlot + 1, std::memory_order_release);
+        }
+
+        //take it while operations are quiet; a thread still tracing may overwrite what is being copied
+        static void writeChromeTrace(std::ostream &aStream);
+        static bool writeChromeTrace(const std::string &aPath);
+        static void clear();
+
+    protected:
+        static std::atomic<bool>& enabled();
+        static std::chrono::steady_clock::time_point epoch();
+        static TraceRing& threadRing();
+    };
+
+    //records [construction, destruction) as a complete event named aName
+    class TraceSpan {
+    public:
+        explicit TraceSpan(const char *aName) : name{Tracer::isEnabled() ? aName : nullptr} {
+            if (name) start = Tracer::now();
+        }
+        ~TraceSpan() {
+            if (name) Tracer::record(name, start, Tracer::now());
+        }
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+    protected:
+        const char *name;
+        uint64_t    start{0};
+    };
+
+}
+
+#endif /* Trace_hpp */
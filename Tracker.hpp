@@ -9,8 +9,21 @@
 #define Tracker_h
 
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 #include <filesystem>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include "OperationScope.hpp"
 
 namespace fs = std::filesystem;
 
@@ -22,6 +35,11 @@ namespace fs = std::filesystem;
 #define GPS(aPtr) (aPtr)
 #endif
 
+//live allocations sit in open-addressing tables sharded by address: track/untrack are O(1)
+//and threads rarely meet on a shard lock. (sharding beats one table per thread here, since
+//add's pipeline frees most buffers on a different thread than allocated them.) totals are
+//kept per call site (operator new's return address) and per archive operation (OperationScope).
+//the tables come from malloc, so the tracker never feeds itself
 struct Tracker {
 
     static Tracker single;
@@ -31,11 +49,34 @@ struct Tracker {
     }
 
     struct Memo {
-        void*   ptr;
-        size_t  line;
-        size_t  filenum;
+        void*    ptr;
+        size_t   size;
+        size_t   line;
+        uint32_t filenum;
+        uint16_t site;
+        uint16_t scope;
     };
 
+    //what one call site or operation allocated
+    struct Totals {
+        std::atomic<size_t> count{0}, bytes{0}, live{0}, peak{0};
+
+        void add(size_t aSize) {
+            count.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(aSize, std::memory_order_relaxed);
+            size_t theLive = live.fetch_add(aSize, std::memory_order_relaxed) + aSize;
+            for (size_t thePeak = peak.load(std::memory_order_relaxed); theLive > thePeak;) {
+                if (peak.compare_exchange_weak(thePeak, theLive, std::memory_order_relaxed)) break;
+            }
+        }
+        void remove(size_t aSize) {live.fetch_sub(aSize, std::memory_order_relaxed);}
+        void clear() {count = 0; bytes = 0; live = 0; peak = 0;}
+    };
+
+    static constexpr size_t kShards = 64;
+    static constexpr size_t kSites  = 4096; //the last slot collects sites that don't fit
+    static constexpr size_t kScopes = 64;   //slot 0 is "outside any operation"
+
     Tracker(bool aEnabled=false) {
         enabled=aEnabled;
         names.push_back("unknown");
@@ -49,70 +90,308 @@ struct Tracker {
     }
 
     Tracker& reset() { //called to forget prior ptrs...
+        Busy theBusy;
+        for (auto &theShard : shards) {
+            ShardLock theLock(theShard);
+            theShard.clear();
+        }
+        tracked = 0;
+        for (auto &theSite : sites) {
+            theSite.address = nullptr;
+            theSite.totals.clear();
+        }
+        for (auto &theScope : scopes) {
+            theScope.name = nullptr;
+            theScope.totals.clear();
+        }
+        std::lock_guard<std::mutex> theGuard(nameLock);
         names.clear();
-        list.clear();
+        names.push_back("unknown");
         return *this;
     }
 
-    void* track(void* aPtr) {
-        if(enabled) {
-            enabled=false;
-            list.push_back(Memo{aPtr});
-            enabled=true;
+    void* track(void* aPtr, size_t aSize=0, void* aSite=nullptr) {
+        if(enabled && aPtr && !busy()) {
+            Busy theBusy;
+            uint16_t theSite = siteFor(aSite);
+            uint16_t theScope = scopeFor(ECE141::OperationScope::current());
+            sites[theSite].totals.add(aSize);
+            scopes[theScope].totals.add(aSize);
+
+            Shard &theShard = shardFor(aPtr);
+            ShardLock theLock(theShard);
+            if (theShard.insert(Memo{aPtr, aSize, 0, 0, theSite, theScope})) tracked++;
         }
         return aPtr;
     }
 
     template<typename T>
     T* watch(T* aPtr, size_t aLine=0, const char* aFile=nullptr) {
-        if(aLine) {
-            bool wasEnabled=enabled;
-            enabled=false;
-            std::string theName=fs::path(aFile).filename().u8string();
-            auto theIt = find(names.begin(), names.end(), theName);
-            size_t theIndex=names.size();
-            if (theIt != names.end()) {
-                theIndex = theIt - names.begin();
+        if(aLine && !busy()) {
+            Busy theBusy;
+            uint32_t theIndex;
+            {
+                std::lock_guard<std::mutex> theGuard(nameLock);
+                std::string theName=fs::path(aFile).filename().u8string();
+                auto theIt = find(names.begin(), names.end(), theName);
+                theIndex = static_cast<uint32_t>(theIt - names.begin());
+                if (theIt == names.end()) names.push_back(theName);
             }
-            else names.push_back(theName);
-            enabled=wasEnabled;
-
-            auto theEnd=list.rend();
-            for (auto it = list.rbegin(); it!=theEnd; it++) {
-                if(it->ptr==aPtr) {
-                    it->line=aLine;
-                    it->filenum=theIndex;
-                    break;
-                }
+
+            Shard &theShard = shardFor((void*)aPtr);
+            ShardLock theLock(theShard);
+            if (Memo *theMemo = theShard.find((void*)aPtr)) {
+                theMemo->line=aLine;
+                theMemo->filenum=theIndex;
             }
         }
         return aPtr;
     }
 
     Tracker& untrack(void* aPtr) {
-        auto theIter = std::find_if(
-                list.begin(), list.end(), [aPtr](Memo const& aMemo){
-                    return aMemo.ptr == aPtr;
-                });
-        if(theIter != list.end()) {list.erase(theIter);}
+        if(aPtr && tracked.load(std::memory_order_relaxed) && !busy()) {
+            Memo theMemo;
+            bool wasTracked;
+            {
+                Shard &theShard = shardFor(aPtr);
+                ShardLock theLock(theShard);
+                wasTracked = theShard.erase(aPtr, theMemo);
+            }
+            if (wasTracked) {
+                tracked--;
+                sites[theMemo.site].totals.remove(theMemo.size);
+                scopes[theMemo.scope].totals.remove(theMemo.size);
+            }
+        }
         return *this;
     }
 
+    size_t liveCount() const {return tracked;}
+
+    //totals for the operation named aName (an OperationScope), nullptr if it never allocated
+    const Totals* operationTotals(const char* aName) const {
+        for (size_t i = 1; i < kScopes; i++) {
+            const char *theName = scopes[i].name.load(std::memory_order_acquire);
+            if (theName && 0 == strcmp(theName, aName)) return &scopes[i].totals;
+        }
+        return nullptr;
+    }
+
     Tracker& reportLeaks(std::ostream &aStream) {
-        for(auto &theMem: list) {
+        //copy first: writing to aStream may free tracked memory, which needs the shard locks
+        std::vector<Memo> theLive;
+        {
+            Busy theBusy;
+            theLive.reserve(tracked);
+            for (auto &theShard : shards) {
+                ShardLock theLock(theShard);
+                theShard.forEach([&](const Memo &theMem) {theLive.push_back(theMem);});
+            }
+        }
+        std::lock_guard<std::mutex> theGuard(nameLock);
+        for(auto &theMem: theLive) {
             aStream << theMem.ptr << " : "
-                    << names[theMem.filenum] << "("
+                    << names[theMem.filenum < names.size() ? theMem.filenum : 0] << "("
                     << theMem.line << ")\n";
         }
         return *this;
     }
 
+    //allocations per archive operation
+    Tracker& reportOperations(std::ostream &aStream) {
+        aStream << std::left << std::setw(16) << "operation" << std::right << std::setw(12) << "allocs"
+                << std::setw(14) << "bytes" << std::setw(14) << "peak" << std::setw(14) << "live" << "\n";
+        for (size_t i = 0; i < kScopes; i++) {
+            const char *theName = i ? scopes[i].name.load(std::memory_order_acquire) : "(none)";
+            if (theName && scopes[i].totals.count) report(aStream, theName, scopes[i].totals);
+        }
+        return *this;
+    }
+
+    //the aLimit call sites that allocated the most bytes
+    Tracker& reportSites(std::ostream &aStream, size_t aLimit=20) {
+        std::vector<size_t> theSites;
+        for (size_t i = 0; i < kSites; i++) {
+            if (sites[i].totals.count) theSites.push_back(i);
+        }
+        std::sort(theSites.begin(), theSites.end(), [this](size_t a, size_t b) {
+            return sites[a].totals.bytes > sites[b].totals.bytes;
+        });
+        if (theSites.size() > aLimit) theSites.resize(aLimit);
+
+        aStream << std::left << std::setw(16) << "site" << std::right << std::setw(12) << "allocs"
+                << std::setw(14) << "bytes" << std::setw(14) << "peak" << std::setw(14) << "live" << "\n";
+        for (auto theSite : theSites) {
+            std::ostringstream theAddress;
+            theAddress << sites[theSite].address.load();
+            report(aStream, theAddress.str(), sites[theSite].totals);
+            aStream << "    " << symbolFor(sites[theSite].address.load()) << "\n";
+        }
+        return *this;
+    }
+
 protected:
 
     Tracker(const Tracker &aTracker) {}
 
-    bool                      enabled;
-    std::vector<Memo>         list;
+    //one slice of the live table: linear probing, backward-shift deletes (no tombstones)
+    struct Shard {
+        std::atomic_flag locked = ATOMIC_FLAG_INIT;
+        Memo*  slots{nullptr};
+        size_t capacity{0}; //power of two
+        size_t count{0};
+
+        static size_t hash(void* aPtr) {
+            uint64_t theHash = (reinterpret_cast<uintptr_t>(aPtr) >> 4) * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(theHash ^ (theHash >> 32));
+        }
+
+        bool insert(const Memo &aMemo) {
+            if ((count + 1) * 4 > capacity * 3 && !grow()) return false;
+            size_t theMask = capacity - 1;
+            size_t i = hash(aMemo.ptr) & theMask;
+            while (slots[i].ptr && slots[i].ptr != aMemo.ptr) i = (i + 1) & theMask;
+            bool isNew = !slots[i].ptr;
+            slots[i] = aMemo;
+            count += isNew;
+            return isNew;
+        }
+
+        Memo* find(void* aPtr) {
+            if (!count) return nullptr;
+            size_t theMask = capacity - 1;
+            for (size_t i = hash(aPtr) & theMask; slots[i].ptr; i = (i + 1) & theMask) {
+                if (slots[i].ptr == aPtr) return &slots[i];
+            }
+            return nullptr;
+        }
+
+        bool erase(void* aPtr, Memo &aMemo) {
+            Memo *theSlot = find(aPtr);
+            if (!theSlot) return false;
+            aMemo = *theSlot;
+
+            //pull later members of the probe run into the hole unless they'd move before their home
+            size_t theMask = capacity - 1;
+            size_t theHole = theSlot - slots;
+            for (size_t j = (theHole + 1) & theMask; slots[j].ptr; j = (j + 1) & theMask) {
+                size_t theHome = hash(slots[j].ptr) & theMask;
+                if (((j - theHome) & theMask) >= ((j - theHole) & theMask)) {
+                    slots[theHole] = slots[j];
+                    theHole = j;
+                }
+            }
+            slots[theHole].ptr = nullptr;
+            count--;
+            return true;
+        }
+
+        bool grow() {
+            size_t theCapacity = capacity ? capacity * 2 : 256;
+            auto *theSlots = static_cast<Memo*>(std::calloc(theCapacity, sizeof(Memo)));
+            if (!theSlots) return false;
+            Memo  *theOld = slots;
+            size_t theOldCapacity = capacity;
+            slots = theSlots;
+            capacity = theCapacity;
+            count = 0;
+            for (size_t i = 0; i < theOldCapacity; i++) {
+                if (theOld[i].ptr) insert(theOld[i]);
+            }
+            std::free(theOld);
+            return true;
+        }
+
+        void clear() {
+            if (slots) memset(slots, 0, capacity * sizeof(Memo));
+            count = 0;
+        }
+
+        template<typename Visitor>
+        void forEach(Visitor aVisitor) const {
+            for (size_t i = 0; i < capacity; i++) {
+                if (slots[i].ptr) aVisitor(slots[i]);
+            }
+        }
+    };
+
+    struct ShardLock {
+        explicit ShardLock(Shard &aShard) : shard{aShard} {
+            while (shard.locked.test_and_set(std::memory_order_acquire)) {}
+        }
+        ~ShardLock() {shard.locked.clear(std::memory_order_release);}
+        Shard &shard;
+    };
+
+    //the tracker's own allocations (names, reports) must not be tracked
+    static bool& busy() {
+        static thread_local bool theBusy = false;
+        return theBusy;
+    }
+    struct Busy {
+        Busy() : was{busy()} {busy() = true;}
+        ~Busy() {busy() = was;}
+        bool was;
+    };
+
+    struct Site {
+        std::atomic<void*> address{nullptr};
+        Totals totals;
+    };
+
+    struct Scope {
+        std::atomic<const char*> name{nullptr};
+        Totals totals;
+    };
+
+    Shard& shardFor(void* aPtr) {
+        return shards[(Shard::hash(aPtr) >> 16) % kShards];
+    }
+
+    uint16_t siteFor(void* anAddress) {
+        if (!anAddress) return kSites - 1;
+        size_t theStart = Shard::hash(anAddress);
+        for (size_t n = 0; n < kSites - 1; n++) {
+            size_t i = (theStart + n) % (kSites - 1);
+            void *theKey = sites[i].address.load(std::memory_order_acquire);
+            if (!theKey && sites[i].address.compare_exchange_strong(theKey, anAddress)) return i;
+            if (theKey == anAddress) return i;
+        }
+        return kSites - 1;
+    }
+
+    uint16_t scopeFor(const char* aName) {
+        if (!aName) return 0;
+        for (size_t i = 1; i < kScopes; i++) {
+            const char *theName = scopes[i].name.load(std::memory_order_acquire);
+            if (!theName && scopes[i].name.compare_exchange_strong(theName, aName)) return i;
+            if (theName == aName || 0 == strcmp(theName, aName)) return i;
+        }
+        return 0;
+    }
+
+    static std::string symbolFor(void* anAddress) {
+        Dl_info theInfo;
+        if (!dladdr(anAddress, &theInfo) || !theInfo.dli_sname) return "?";
+        int theStatus = 0;
+        char *theName = abi::__cxa_demangle(theInfo.dli_sname, nullptr, nullptr, &theStatus);
+        std::string theResult(theStatus == 0 && theName ? theName : theInfo.dli_sname);
+        std::free(theName);
+        return theResult;
+    }
+
+    static void report(std::ostream &aStream, const std::string &aName, const Totals &aTotals) {
+        aStream << std::left << std::setw(16) << aName << std::right << std::setw(12) << aTotals.count
+                << std::setw(14) << aTotals.bytes << std::setw(14) << aTotals.peak
+                << std::setw(14) << aTotals.live << "\n";
+    }
+
+    std::atomic<bool>         enabled;
+    std::atomic<size_t>       tracked{0};
+    Shard                     shards[kShards];
+    Site                      sites[kSites];
+    Scope                     scopes[kScopes];
+    std::mutex                nameLock;
     std::vector<std::string>  names;
 };
 
@@ -122,13 +401,17 @@ Tracker Tracker::single(false);
 
 #ifdef _TRACKER_ON
 void * operator new(size_t aSize) {
-    auto thePtr=std::malloc(aSize);
-    Tracker::instance().track(thePtr);
+    auto thePtr=std::malloc(aSize ? aSize : 1);
+    if (!thePtr) throw std::bad_alloc();
+    Tracker::instance().track(thePtr, aSize, __builtin_return_address(0));
     return thePtr;
 }
 
 void * operator new[](size_t aSize) {
-    return operator new(aSize);
+    auto thePtr=std::malloc(aSize ? aSize : 1);
+    if (!thePtr) throw std::bad_alloc();
+    Tracker::instance().track(thePtr, aSize, __builtin_return_address(0));
+    return thePtr;
 }
 
 void operator delete(void* aPtr) noexcept {
@@ -139,6 +422,14 @@ void operator delete(void* aPtr) noexcept {
 void operator delete[](void* aPtr) noexcept {
     operator delete(aPtr);
 }
+
+void operator delete(void* aPtr, size_t) noexcept {
+    operator delete(aPtr);
+}
+
+void operator delete[](void* aPtr, size_t) noexcept {
+    operator delete(aPtr);
+}
 #endif
 
 #endif /* Tracker_h */
@@ -0,0 +1,121 @@
+//
+//  bench.cpp
+//
+//  archive_bench [folder] [--max-size bytes] [--iterations n] [--fills n,n,...] [--out file.json]
+//      runs the Benchmarking suite and writes the JSON report to stdout (or --out)
+//      (either mode also takes --trace file.json to record a Chrome trace of the run,
+//      and --memory to keep the archive in memory instead of a file)
+//
+//  archive_bench [folder] --load [--threads n] [--files n] [--duration s] [--ops n] [--sizes lo,hi]
+//                [--log-sizes] [--mix add,extract,remove,list] [--compress] [--interval s] [--out file.json]
+//      runs the LoadGenerator against a fresh archive instead
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Benchmarking.hpp"
+#include "LoadGenerator.hpp"
+#include "Trace.hpp"
+
+static std::vector<double> splitNumbers(const std::string &aList) {
+    std::vector<double> theNumbers;
+    std::stringstream theStream(aList);
+    for (std::string theValue; std::getline(theStream, theValue, ',');) {
+        theNumbers.push_back(std::stod(theValue));
+    }
+    return theNumbers;
+}
+
+int main(int argc, const char * argv[]) {
+    srand(time(NULL));
+    ECE141::Benchmarking theBench("/tmp");
+    ECE141::LoadConfig theLoad;
+    std::string theOutPath;
+    std::string theTracePath;
+    size_t theMaxSize = theBench.sizes.back();
+    bool isLoad = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string theArg(argv[i]);
+        bool hasValue = i + 1 < argc;
+        if ("--max-size" == theArg && hasValue) theMaxSize = std::stoull(argv[++i]);
+        else if ("--iterations" == theArg && hasValue) theBench.iterations = std::max(1ull, std::stoull(argv[++i]));
+        else if ("--out" == theArg && hasValue) theOutPath = argv[++i];
+        else if ("--trace" == theArg && hasValue) theTracePath = argv[++i];
+        else if ("--fills" == theArg && hasValue) {
+            theBench.fills.clear();
+            for (auto theFill : splitNumbers(argv[++i])) theBench.fills.push_back(static_cast<size_t>(theFill));
+        }
+        else if ("--load" == theArg) isLoad = true;
+        else if ("--memory" == theArg) theBench.storage = ECE141::StorageKind::memory;
+        else if ("--threads" == theArg && hasValue) theLoad.threads = std::stoull(argv[++i]);
+        else if ("--files" == theArg && hasValue) theLoad.fileCount = std::stoull(argv[++i]);
+        else if ("--duration" == theArg && hasValue) theLoad.duration = std::stod(argv[++i]);
+        else if ("--ops" == theArg && hasValue) theLoad.maxOps = std::stoull(argv[++i]);
+        else if ("--interval" == theArg && hasValue) theLoad.interval = std::stod(argv[++i]);
+        else if ("--log-sizes" == theArg) theLoad.logSizes = true;
+        else if ("--compress" == theArg) theLoad.compress = true;
+        else if ("--sizes" == theArg && hasValue) {
+            auto theSizes = splitNumbers(argv[++i]);
+            if (theSizes.size() > 0) theLoad.minSize = theLoad.maxSize = static_cast<size_t>(theSizes[0]);
+            if (theSizes.size() > 1) theLoad.maxSize = static_cast<size_t>(theSizes[1]);
+        }
+        else if ("--mix" == theArg && hasValue) {
+            auto theMix = splitNumbers(argv[++i]);
+            theMix.resize(4, 0.0);
+            theLoad.addWeight = theMix[0];
+            theLoad.extractWeight = theMix[1];
+            theLoad.removeWeight = theMix[2];
+            theLoad.listWeight = theMix[3];
+        }
+        else if ('-' != theArg[0]) theBench.folder = theArg;
+        else {
+            std::cerr << "usage: archive_bench [folder] [--max-size bytes] [--iterations n] "
+                         "[--fills n,n,...] [--out file.json] [--trace file.json] [--memory]\n"
+                         "       archive_bench [folder] --load [--threads n] [--files n] [--duration s] [--ops n]\n"
+                         "                     [--sizes lo,hi] [--log-sizes] [--mix a,e,r,l] [--compress]\n"
+                         "                     [--interval s] [--out file.json]\n";
+            return 1;
+        }
+    }
+
+    theBench.sizes.erase(std::remove_if(theBench.sizes.begin(), theBench.sizes.end(),
+                                        [&](size_t aSize) {return aSize > theMaxSize;}),
+                         theBench.sizes.end());
+
+    //Archive reports some operations on std::cout, keep that out of the JSON
+    std::ostringstream theChatter;
+    auto *theCout = std::cout.rdbuf(theChatter.rdbuf());
+    std::ostringstream theReport;
+    bool theResult = true;
+    ECE141::Tracer::enable(!theTracePath.empty());
+    if (isLoad) {
+        auto theArchive = ECE141::Archive::createArchive(theBench.folder + "/loadbench", theBench.storage);
+        if (!theArchive.isOK()) {
+            std::cout.rdbuf(theCout);
+            std::cerr << "can't create " << theBench.folder << "/loadbench.arc\n";
+            return 1;
+        }
+        ECE141::LoadGenerator theGenerator(*theArchive.getValue(), theBench.folder, theLoad);
+        theResult = theGenerator.run();
+        theGenerator.report(theReport);
+    }
+    else {
+        theBench.run(std::cerr);
+        theBench.report(theReport);
+    }
+    std::cout.rdbuf(theCout);
+
+    if (!theTracePath.empty()) {
+        ECE141::Tracer::enable(false);
+        if (!ECE141::Tracer::kCompiledIn) std::cerr << "built without ARCHIVE_TRACING, the trace is empty\n";
+        ECE141::Tracer::writeChromeTrace(theTracePath);
+    }
+    if (theOutPath.empty()) std::cout << theReport.str();
+    else std::ofstream(theOutPath) << theReport.str();
+    return theResult ? 0 : 2;
+}
@@ -40,6 +40,29 @@ int main(int argc, const char * argv[]) {
                 {"Dump",    [&](){return theTester.doDumpTests(theOutput);}  },
                 {"Stress",  [&](){return theTester.doStressTests(theOutput);}  },
                 {"Compress",  [&](){return theTester.doCompressTests(theOutput);}  },
+                {"Concurrent",  [&](){return theTester.doConcurrentTests(theOutput);}  },
+                {"Snapshot",  [&](){return theTester.doSnapshotTests(theOutput);}  },
+                {"MultiProcess",  [&](){return theTester.doMultiProcessTests(theOutput);}  },
+                {"Load",  [&](){return theTester.doLoadTests(theOutput);}  },
+                {"Metrics",  [&](){return theTester.doMetricsTests(theOutput);}  },
+                {"Trace",  [&](){return theTester.doTraceTests(theOutput);}  },
+                {"Tracker",  [&](){return theTester.doTrackerTests(theOutput);}  },
+                {"Counters",  [&](){return theTester.doCountersTests(theOutput);}  },
+                {"TOC",  [&](){return theTester.doTOCTests(theOutput);}  },
+                {"Prefix",  [&](){return theTester.doPrefixTests(theOutput);}  },
+                {"Bloom",  [&](){return theTester.doBloomTests(theOutput);}  },
+                {"Hash",  [&](){return theTester.doHashTests(theOutput);}  },
+                {"Cache",  [&](){return theTester.doCacheTests(theOutput);}  },
+                {"Update",  [&](){return theTester.doUpdateTests(theOutput);}  },
+                {"Append",  [&](){return theTester.doAppendTests(theOutput);}  },
+                {"Version",  [&](){return theTester.doVersionTests(theOutput);}  },
+                {"Merge",  [&](){return theTester.doMergeTests(theOutput);}  },
+                {"Volume",  [&](){return theTester.doVolumeTests(theOutput);}  },
+                {"Sparse",  [&](){return theTester.doSparseTests(theOutput);}  },
+                {"Stream",  [&](){return theTester.doStreamTests(theOutput);}  },
+                {"Sink",  [&](){return theTester.doSinkTests(theOutput);}  },
+                {"Memory",  [&](){return theTester.doMemoryTests(theOutput);}  },
+                {"Readahead",  [&](){return theTester.doReadaheadTests(theOutput);}  },
                 {"All",     [&](){return theTester.doAllTests(theOutput);}  },
         };
 